@@ -123,22 +123,7 @@ public:
 	}
 
 	CAT_INLINE void zeroRegion(u16 x, u16 len) {
-		u8 * CAT_RESTRICT pixels = _pixels + x;
-
-		while (len >= 4) {
-			pixels[0] = 0;
-			pixels[1] = 0;
-			pixels[2] = 0;
-			pixels[3] = 0;
-			pixels += 4;
-			len -= 4;
-		}
-
-		while (len > 0) {
-			pixels[0] = 0;
-			++pixels;
-			--len;
-		}
+		CAT_CLR(_pixels + x, len);
 	}
 
 	CAT_INLINE u8 get(u16 x) {
@@ -219,22 +204,7 @@ public:
 	}
 
 	CAT_INLINE void zeroRegion(u16 x, u16 len) {
-		u32 * CAT_RESTRICT pixels = reinterpret_cast<u32 * CAT_RESTRICT>( &_pixels[x << 2] );
-
-		while (len >= 4) {
-			pixels[0] = 0;
-			pixels[1] = 0;
-			pixels[2] = 0;
-			pixels[3] = 0;
-			pixels += 4;
-			len -= 4;
-		}
-
-		while (len > 0) {
-			pixels[0] = 0;
-			++pixels;
-			--len;
-		}
+		CAT_CLR(&_pixels[x << 2], len << 2);
 	}
 
 	CAT_INLINE void get(u16 x, u8 & CAT_RESTRICT y, u8 & CAT_RESTRICT u, u8 & CAT_RESTRICT v) {
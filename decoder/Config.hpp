@@ -41,6 +41,9 @@ namespace cat {
 // Unroll reader
 #define CAT_UNROLL_READER
 
+// Disable SSE2/AVX2 code paths and use the portable versions instead
+//#define CAT_DISABLE_SIMD
+
 // Dump filter choices
 //#define CAT_DUMP_FILTERS
 
@@ -28,25 +28,51 @@
 #include "EntropyDecoder.hpp"
 using namespace cat;
 
-bool EntropyDecoder::init(int num_syms, int zrle_syms, int huff_lut_bits, ImageReader &reader) {
+bool EntropyDecoder::initHuffman(HuffmanDecoder &decoder, int num_syms, int huff_lut_bits, ImageReader &reader, EntropyDecoder *shared, int shared_count) {
+	// If there are no earlier decoders,
+	if (shared_count <= 0) {
+		return decoder.init(num_syms, reader, huff_lut_bits);
+	}
+
+	HuffmanDecoder *others[MAX_SHARED * 2];
+	int others_count = 0;
+
+	if (shared_count > MAX_SHARED) {
+		shared = shared + shared_count - MAX_SHARED;
+		shared_count = MAX_SHARED;
+	}
+
+	for (int ii = 0; ii < shared_count; ++ii) {
+		others[others_count++] = &shared[ii]._bz;
+
+		if (shared[ii]._hasAZ) {
+			others[others_count++] = &shared[ii]._az;
+		}
+	}
+
+	return decoder.initShared(num_syms, reader, huff_lut_bits, others, others_count);
+}
+
+bool EntropyDecoder::init(int num_syms, int zrle_syms, int huff_lut_bits, ImageReader &reader, EntropyDecoder *shared, int shared_count) {
 	_num_syms = num_syms;
 
 	CAT_DEBUG_ENFORCE(num_syms > 0 && zrle_syms > 0);
 
 	// If using AZ symbols,
-	if (reader.readBit()) {
+	_hasAZ = reader.readBit() != 0;
+	if (_hasAZ) {
 		_zrle_offset = zrle_syms - 1;
 
-		if (!_az.init(num_syms, reader, huff_lut_bits)) {
+		if (!initHuffman(_az, num_syms, huff_lut_bits, reader, shared, shared_count)) {
 			return false;
 		}
 
-		if (!_bz.init(num_syms + zrle_syms, reader, huff_lut_bits)) {
+		if (!initHuffman(_bz, num_syms + zrle_syms, huff_lut_bits, reader, shared, shared_count)) {
 			return false;
 		}
 	} else {
 		// Cool: Does not slow down decoder to conditionally turn off zRLE!
-		if (!_bz.init(num_syms, reader, huff_lut_bits)) {
+		if (!initHuffman(_bz, num_syms, huff_lut_bits, reader, shared, shared_count)) {
 			return false;
 		}
 	}
@@ -57,6 +83,27 @@ bool EntropyDecoder::init(int num_syms, int zrle_syms, int huff_lut_bits, ImageR
 	return true;
 }
 
+void EntropyDecoder::initMulti(int multi_bits) {
+	// Zero run symbols end a lookup since extra bits may follow them
+	_bz.initMulti(multi_bits, 0, _num_syms);
+}
+
+u16 EntropyDecoder::readZeroRun(u16 sym, ImageReader &reader) {
+	// Decode zero run
+	u32 zeroRun = sym - _num_syms;
+
+	// If extra bits were used,
+	if (zeroRun >= _zrle_offset) {
+		CAT_DEBUG_ENFORCE(zeroRun == _zrle_offset);
+
+		zeroRun += reader.read255255();
+	}
+
+	_zeroRun = zeroRun;
+	_afterZero = true;
+	return 0;
+}
+
 u16 EntropyDecoder::next(ImageReader &reader) {
 	// If in a zero run,
 	if (_zeroRun > 0) {
@@ -79,18 +126,48 @@ u16 EntropyDecoder::next(ImageReader &reader) {
 		return sym;
 	}
 
-	// Decode zero run
-	u32 zeroRun = sym - num_syms;
+	return readZeroRun(sym, reader);
+}
 
-	// If extra bits were used,
-	if (zeroRun >= _zrle_offset) {
-		CAT_DEBUG_ENFORCE(zeroRun == _zrle_offset);
+bool EntropyDecoder::hasSymbolIn(u32 first, u32 end) {
+	// Before-zero symbols past _num_syms are zero runs
+	const u32 bz_end = end < (u32)_num_syms ? end : (u32)_num_syms;
 
-		zeroRun += reader.read255255();
+	if (first < bz_end && _bz.hasSymbolIn(first, bz_end)) {
+		return true;
 	}
 
-	_zeroRun = zeroRun;
-	_afterZero = true;
-	return 0;
+	return _hasAZ && _az.hasSymbolIn(first, end);
+}
+
+bool EntropyDecoder::getConstant(u16 &sym) {
+	u32 bz_sym;
+
+	// Zero run symbols read extra bits and switch to the after-zero decoder
+	if (!_bz.getOneSymbol(bz_sym) || bz_sym >= (u32)_num_syms) {
+		return false;
+	}
+
+	sym = static_cast<u16>( bz_sym );
+	return true;
+}
+
+int EntropyDecoder::nextMulti(ImageReader &reader, u16 *syms) {
+	// If in a zero run or after zero,
+	if (_zeroRun > 0 || _afterZero) {
+		syms[0] = next(reader);
+		return 1;
+	}
+
+	// Read before-zero symbols
+	const int count = _bz.nextMulti(reader, syms);
+
+	// Only the last one can start a zero run
+	const u16 last = syms[count - 1];
+	if (last >= _num_syms) {
+		syms[count - 1] = readZeroRun(last, reader);
+	}
+
+	return count;
 }
 
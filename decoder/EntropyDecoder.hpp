@@ -57,12 +57,36 @@ public:
 protected:
 	int _zeroRun;
 	HuffmanDecoder _bz, _az;
+	bool _hasAZ;
 	bool _afterZero;
 
+	// Start a zero run from a before-zero run symbol
+	u16 readZeroRun(u16 sym, ImageReader &reader);
+
+	// Read one Huffman table, sharing tables with earlier decoders if possible
+	bool initHuffman(HuffmanDecoder &decoder, int num_syms, int huff_lut_bits, ImageReader &reader, EntropyDecoder *shared, int shared_count);
+
 public:
-	bool init(int num_syms, int zrle_syms, int huff_lut_bits, ImageReader &reader);
+	static const int MAX_SHARED = 16; // Max earlier decoders to share tables with
+
+	// Tables identical to those of the shared_count decoders in shared are
+	// copied from them rather than built again (like across chaos levels)
+	bool init(int num_syms, int zrle_syms, int huff_lut_bits, ImageReader &reader, EntropyDecoder *shared = 0, int shared_count = 0);
+
+	// Optionally build a multi-symbol table after init() for nextMulti()
+	void initMulti(int multi_bits);
 
 	u16 next(ImageReader &reader);
+
+	// Returns true if any symbol in [first, end) can be decoded
+	bool hasSymbolIn(u32 first, u32 end);
+
+	// Returns true if next() always returns sym without reading any bits
+	bool getConstant(u16 &sym);
+
+	// Decode 1..HuffmanDecoder::MULTI_MAX_SYMS symbols into syms, returning
+	// the count.  Only worthwhile for runs of symbols from the same decoder
+	int nextMulti(ImageReader &reader, u16 *syms);
 };
 
 } // namespace cat
@@ -2975,3 +2975,450 @@ int main() {
 }
 
  */
+
+
+//// Batched Filters
+
+/*
+ * The batched filters process whole vectors of pixels at a time with SSE2,
+ * or AVX2 when the compiler is targeting it, and finish the run with the
+ * scalar versions.  Each 32-bit lane holds one RGBA pixel, so the color
+ * filters can do their math on 32-bit lanes exactly like the scalar code.
+ */
+
+#if defined(CAT_HAS_AVX2)
+
+#include <immintrin.h>
+
+typedef __m256i vec_t;
+static const int VEC_PIXELS = 8;
+
+#define VEC_LOAD(p) _mm256_loadu_si256(reinterpret_cast<const __m256i *>( p ))
+#define VEC_STORE(p, v) _mm256_storeu_si256(reinterpret_cast<__m256i *>( p ), v)
+#define VEC_SET32(x) _mm256_set1_epi32(x)
+#define VEC_AND _mm256_and_si256
+#define VEC_OR _mm256_or_si256
+#define VEC_XOR _mm256_xor_si256
+#define VEC_ADD8 _mm256_add_epi8
+#define VEC_SUB8 _mm256_sub_epi8
+#define VEC_AVG8 _mm256_avg_epu8
+#define VEC_ADD32 _mm256_add_epi32
+#define VEC_SUB32 _mm256_sub_epi32
+#define VEC_SRL32 _mm256_srli_epi32
+#define VEC_SLL32 _mm256_slli_epi32
+#define VEC_SRA32 _mm256_srai_epi32
+
+#elif defined(CAT_HAS_SSE2)
+
+#include <emmintrin.h>
+
+typedef __m128i vec_t;
+static const int VEC_PIXELS = 4;
+
+#define VEC_LOAD(p) _mm_loadu_si128(reinterpret_cast<const __m128i *>( p ))
+#define VEC_STORE(p, v) _mm_storeu_si128(reinterpret_cast<__m128i *>( p ), v)
+#define VEC_SET32(x) _mm_set1_epi32(x)
+#define VEC_AND _mm_and_si128
+#define VEC_OR _mm_or_si128
+#define VEC_XOR _mm_xor_si128
+#define VEC_ADD8 _mm_add_epi8
+#define VEC_SUB8 _mm_sub_epi8
+#define VEC_AVG8 _mm_avg_epu8
+#define VEC_ADD32 _mm_add_epi32
+#define VEC_SUB32 _mm_sub_epi32
+#define VEC_SRL32 _mm_srli_epi32
+#define VEC_SLL32 _mm_slli_epi32
+#define VEC_SRA32 _mm_srai_epi32
+
+#endif
+
+
+//// Batched Color Filters
+
+static CAT_INLINE void cfRowScalar(YUV2RGBFilterFunction filter, u8 * CAT_RESTRICT rgba, int count) {
+	for (; count > 0; --count, rgba += 4) {
+		const u8 yuv[3] = { rgba[0], rgba[1], rgba[2] };
+		filter(yuv, rgba);
+	}
+}
+
+#if defined(CAT_HAS_SSE2)
+
+// Channel c of each pixel, zero-extended (CF_U) or sign-extended (CF_S)
+#define CF_U(c) VEC_AND(VEC_SRL32(v, 8 * (c)), lo8)
+#define CF_S(c) VEC_SRA32(VEC_SLL32(v, 24 - 8 * (c)), 24)
+
+// Truncate to a byte like a u8 intermediate in the scalar code
+#define CF_LO8(x) VEC_AND(x, lo8)
+
+#define CF_ROW(NAME, BODY) \
+static void CFR_##NAME(u8 * CAT_RESTRICT rgba, int count) { \
+	const vec_t lo8 = VEC_SET32(0xff); \
+	const vec_t alpha = VEC_SET32(0xff000000); \
+	for (; count >= VEC_PIXELS; count -= VEC_PIXELS, rgba += VEC_PIXELS * 4) { \
+		const vec_t v = VEC_LOAD(rgba); \
+		vec_t R, G, B; \
+		BODY \
+		R = CF_LO8(R); \
+		G = VEC_SLL32(CF_LO8(G), 8); \
+		B = VEC_SLL32(CF_LO8(B), 16); \
+		VEC_STORE(rgba, VEC_OR(VEC_OR(R, G), VEC_OR(B, VEC_AND(v, alpha)))); \
+	} \
+	cfRowScalar(CFF_Y2R_##NAME, rgba, count); \
+}
+
+#else
+
+#define CF_ROW(NAME, BODY) \
+static void CFR_##NAME(u8 * CAT_RESTRICT rgba, int count) { \
+	cfRowScalar(CFF_Y2R_##NAME, rgba, count); \
+}
+
+#endif
+
+CF_ROW(GB_RG,
+	B = CF_U(0);
+	G = VEC_ADD32(CF_U(1), B);
+	R = VEC_SUB32(G, CF_U(2));
+)
+
+CF_ROW(GR_BG,
+	R = CF_U(2);
+	G = VEC_ADD32(CF_U(1), R);
+	B = VEC_SUB32(G, CF_U(0));
+)
+
+CF_ROW(YUVr,
+	const vec_t U = CF_S(1);
+	const vec_t V = CF_S(2);
+	G = VEC_SUB32(CF_U(0), VEC_SRA32(VEC_ADD32(U, V), 2));
+	R = VEC_ADD32(V, G);
+	B = VEC_ADD32(U, G);
+)
+
+CF_ROW(D9,
+	R = CF_U(0);
+	G = CF_LO8(VEC_ADD32(CF_U(2), R));
+	B = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(R, VEC_ADD32(VEC_SLL32(G, 1), G)), 2));
+)
+
+CF_ROW(D12,
+	B = CF_U(0);
+	R = CF_LO8(VEC_ADD32(B, CF_U(2)));
+	G = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(B, VEC_ADD32(VEC_SLL32(R, 1), R)), 2));
+)
+
+CF_ROW(D8,
+	R = CF_U(0);
+	G = CF_LO8(VEC_ADD32(CF_U(2), R));
+	B = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(R, G), 1));
+)
+
+CF_ROW(E2_R,
+	const vec_t Co = CF_S(2);
+	const vec_t Cg = CF_S(1);
+	const vec_t t = VEC_SUB32(CF_U(0), VEC_SRA32(Cg, 1));
+	B = VEC_ADD32(Cg, t);
+	G = CF_LO8(VEC_SUB32(t, VEC_SRA32(Co, 1)));
+	R = VEC_ADD32(Co, G);
+)
+
+CF_ROW(BG_RG,
+	G = CF_U(1);
+	B = VEC_SUB32(G, CF_U(0));
+	R = VEC_SUB32(G, CF_U(2));
+)
+
+CF_ROW(GR_BR,
+	R = CF_U(2);
+	B = VEC_ADD32(CF_U(0), R);
+	G = VEC_ADD32(CF_U(1), R);
+)
+
+CF_ROW(D18,
+	B = CF_U(0);
+	G = CF_LO8(VEC_ADD32(CF_U(2), B));
+	R = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(B, VEC_ADD32(VEC_SLL32(G, 1), G)), 2));
+)
+
+CF_ROW(B_GR_R,
+	R = CF_U(2);
+	G = VEC_ADD32(CF_U(1), R);
+	B = CF_U(0);
+)
+
+CF_ROW(D11,
+	B = CF_U(0);
+	R = CF_LO8(VEC_ADD32(CF_U(2), B));
+	G = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(B, R), 1));
+)
+
+CF_ROW(D14,
+	R = CF_U(0);
+	B = CF_LO8(VEC_ADD32(CF_U(2), R));
+	G = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(R, B), 1));
+)
+
+CF_ROW(D10,
+	B = CF_U(0);
+	R = CF_LO8(VEC_ADD32(CF_U(2), B));
+	G = VEC_ADD32(CF_U(1), VEC_SRL32(VEC_ADD32(R, VEC_ADD32(VEC_SLL32(B, 1), B)), 2));
+)
+
+CF_ROW(YCgCo_R,
+	const vec_t Co = CF_S(2);
+	const vec_t Cg = CF_S(1);
+	const vec_t t = VEC_SUB32(CF_U(0), VEC_SRA32(Cg, 1));
+	G = VEC_ADD32(Cg, t);
+	B = CF_LO8(VEC_SUB32(t, VEC_SRA32(Co, 1)));
+	R = VEC_ADD32(Co, B);
+)
+
+CF_ROW(GB_RB,
+	B = CF_U(0);
+	G = VEC_ADD32(CF_U(1), B);
+	R = VEC_ADD32(CF_U(2), B);
+)
+
+CF_ROW(NONE,
+	B = CF_U(0);
+	G = CF_U(1);
+	R = CF_U(2);
+)
+
+#undef CF_ROW
+#undef CF_U
+#undef CF_S
+#undef CF_LO8
+
+const YUV2RGBRowFunction cat::YUV2RGB_ROW_FILTERS[CF_COUNT] = {
+	CFR_GB_RG,
+	CFR_GR_BG,
+	CFR_YUVr,
+	CFR_D9,
+	CFR_D12,
+	CFR_D8,
+	CFR_E2_R,
+	CFR_BG_RG,
+	CFR_GR_BR,
+	CFR_D18,
+	CFR_B_GR_R,
+	CFR_D11,
+	CFR_D14,
+	CFR_D10,
+	CFR_YCgCo_R,
+	CFR_GB_RB,
+	CFR_NONE
+};
+
+
+//// Batched Spatial Filters
+
+// Neighbors of the current pixel for channel ii
+#define SF_A(ii) p[(ii) - 4]
+#define SF_B(ii) p[(ii) - stride]
+#define SF_C(ii) p[(ii) - stride - 4]
+#define SF_D(ii) p[(ii) - stride + 4]
+
+#define SF_ROW_LOOP(PRED) \
+	for (; count > 0; --count, p += 4) { \
+		for (int ii = 0; ii < 3; ++ii) { \
+			p[ii] += static_cast<u8>( PRED ); \
+		} \
+	}
+
+// Filters that predict from A must go one pixel at a time
+#define SF_ROW(NAME, PRED) \
+static void SFR_##NAME(u8 *p, int count, int x, int y, int width) { \
+	const int stride = width * 4; \
+	SF_ROW_LOOP(PRED) \
+}
+
+#if defined(CAT_HAS_SSE2)
+
+// Round-down average from the round-up average instruction
+#define SF_AVG(x, y) VEC_SUB8(VEC_AVG8(x, y), VEC_AND(VEC_XOR(x, y), VEC_SET32(0x01010101)))
+#define SF_VB VEC_LOAD(p - stride)
+#define SF_VC VEC_LOAD(p - stride - 4)
+#define SF_VD VEC_LOAD(p - stride + 4)
+
+// Filters that only predict from the row above can do whole vectors at once
+#define SF_ROW_UP(NAME, PRED, VPRED) \
+static void SFR_##NAME(u8 *p, int count, int x, int y, int width) { \
+	const int stride = width * 4; \
+	const vec_t rgb_mask = VEC_SET32(0x00ffffff); \
+	for (; count >= VEC_PIXELS; count -= VEC_PIXELS, p += VEC_PIXELS * 4) { \
+		const vec_t pred = VEC_AND(VPRED, rgb_mask); \
+		VEC_STORE(p, VEC_ADD8(VEC_LOAD(p), pred)); \
+	} \
+	SF_ROW_LOOP(PRED) \
+}
+
+#else
+
+#define SF_ROW_UP(NAME, PRED, VPRED) SF_ROW(NAME, PRED)
+
+#endif
+
+static void SFR_Z(u8 *p, int count, int x, int y, int width) {
+}
+
+// Only looks left, so it has no need for the row stride
+static void SFR_A(u8 *p, int count, int x, int y, int width) {
+	SF_ROW_LOOP(SF_A(ii))
+}
+
+SF_ROW_UP(B, SF_B(ii), SF_VB)
+SF_ROW_UP(C, SF_C(ii), SF_VC)
+SF_ROW_UP(D, SF_D(ii), SF_VD)
+
+SF_ROW(AVG_AB, (SF_A(ii) + (u16)SF_B(ii)) >> 1)
+SF_ROW(AVG_AC, (SF_A(ii) + (u16)SF_C(ii)) >> 1)
+SF_ROW(AVG_AD, (SF_A(ii) + (u16)SF_D(ii)) >> 1)
+SF_ROW_UP(AVG_BC, (SF_B(ii) + (u16)SF_C(ii)) >> 1, SF_AVG(SF_VB, SF_VC))
+SF_ROW_UP(AVG_BD, (SF_B(ii) + (u16)SF_D(ii)) >> 1, SF_AVG(SF_VB, SF_VD))
+SF_ROW_UP(AVG_CD, (SF_C(ii) + (u16)SF_D(ii)) >> 1, SF_AVG(SF_VC, SF_VD))
+
+SF_ROW(AVG_AB1, (SF_A(ii) + (u16)SF_B(ii) + 1) >> 1)
+SF_ROW(AVG_AC1, (SF_A(ii) + (u16)SF_C(ii) + 1) >> 1)
+SF_ROW(AVG_AD1, (SF_A(ii) + (u16)SF_D(ii) + 1) >> 1)
+SF_ROW_UP(AVG_BC1, (SF_B(ii) + (u16)SF_C(ii) + 1) >> 1, VEC_AVG8(SF_VB, SF_VC))
+SF_ROW_UP(AVG_BD1, (SF_B(ii) + (u16)SF_D(ii) + 1) >> 1, VEC_AVG8(SF_VB, SF_VD))
+SF_ROW_UP(AVG_CD1, (SF_C(ii) + (u16)SF_D(ii) + 1) >> 1, VEC_AVG8(SF_VC, SF_VD))
+
+SF_ROW(AVG_ABC, (SF_A(ii) + (u16)SF_B(ii) + SF_C(ii)) / 3)
+SF_ROW(AVG_ACD, (SF_A(ii) + (u16)SF_C(ii) + SF_D(ii)) / 3)
+SF_ROW(AVG_ABD, (SF_A(ii) + (u16)SF_B(ii) + SF_D(ii)) / 3)
+SF_ROW(AVG_BCD, (SF_B(ii) + (u16)SF_C(ii) + SF_D(ii)) / 3)
+
+SF_ROW(AVG_ABCD, (SF_A(ii) + (u16)SF_B(ii) + SF_C(ii) + (u16)SF_D(ii)) >> 2)
+SF_ROW(AVG_ABCD1, (SF_A(ii) + (u16)SF_B(ii) + SF_C(ii) + (u16)SF_D(ii) + 2) >> 2)
+
+SF_ROW(CLAMP_GRAD, clampGrad(SF_B(ii), SF_A(ii), SF_C(ii)))
+SF_ROW(SKEW_GRAD, skewGrad(SF_B(ii), SF_A(ii), SF_C(ii)))
+SF_ROW(ABC_CLAMP, abcClamp(SF_A(ii), SF_B(ii), SF_C(ii)))
+SF_ROW(PAETH, paeth(SF_A(ii), SF_B(ii), SF_C(ii)))
+SF_ROW(ABC_PAETH, abc_paeth(SF_A(ii), SF_B(ii), SF_C(ii)))
+SF_ROW(PLO, predLevel(SF_A(ii), SF_D(ii), SF_B(ii)))
+SF_ROW(SELECT, predSelect(SF_A(ii), SF_B(ii), SF_C(ii)))
+
+// Pick A or C based on which is closer to F, the pixel left of C
+static void SFR_SELECT_F(u8 *p, int count, int x, int y, int width) {
+	const int stride = width * 4;
+
+	// F is off the image for x = 1, so predict from A there
+	if (x <= 1) {
+		SFR_A(p, 1, x, y, width);
+		--count;
+		p += 4;
+	}
+
+#define SF_F(ii) p[(ii) - stride - 8]
+	SF_ROW_LOOP(leftSel(SF_F(ii), SF_C(ii), SF_A(ii)))
+#undef SF_F
+}
+
+// Continue the gradient from E to D, where E is up and right of D
+static void SFR_ED_GRAD(u8 *p, int count, int x, int y, int width) {
+	const int stride = width * 4;
+
+	// E is off the image for the first two rows and the last pixels
+	const int edge = width - 2 - x;
+	if (y <= 1 || edge <= 0) {
+		SFR_A(p, count, x, y, width);
+		return;
+	}
+
+	const int inner = count < edge ? count : edge;
+	const int outer = count - inner;
+	count = inner;
+
+#define SF_E(ii) p[(ii) - stride * 2 + 8]
+	SF_ROW_LOOP(SF_D(ii) * 2 - SF_E(ii))
+#undef SF_E
+
+	SFR_A(p, outer, x, y, width);
+}
+
+/*
+ * Tapped filters get a loop each with the taps as constants, so the compiler
+ * can fold away zero taps and turn small multiplies into shifts and adds
+ */
+template<int TAP> static void SFR_TAPS(u8 *p, int count, int x, int y, int width) {
+	const int stride = width * 4;
+	const int TA = DIV2_FILTER_TAPS[TAP][0];
+	const int TB = DIV2_FILTER_TAPS[TAP][1];
+	const int TC = DIV2_FILTER_TAPS[TAP][2];
+	const int TD = DIV2_FILTER_TAPS[TAP][3];
+
+	SF_ROW_LOOP((TA * SF_A(ii) + TB * SF_B(ii) + TC * SF_C(ii) + TD * SF_D(ii)) >> 1)
+}
+
+#undef SF_ROW_UP
+#undef SF_ROW
+#undef SF_ROW_LOOP
+#undef SF_A
+#undef SF_B
+#undef SF_C
+#undef SF_D
+#if defined(CAT_HAS_SSE2)
+#undef SF_AVG
+#undef SF_VB
+#undef SF_VC
+#undef SF_VD
+#endif
+
+#define LIST_TAPS(TAP) SFR_TAPS<TAP>
+
+const RGBAFilterRowFunc cat::RGBA_ROW_FILTERS[SF_COUNT] = {
+	SFR_A,
+	SFR_B,
+	SFR_C,
+	SFR_D,
+	SFR_Z,
+	SFR_AVG_AB,
+	SFR_AVG_AC,
+	SFR_AVG_AD,
+	SFR_AVG_BC,
+	SFR_AVG_BD,
+	SFR_AVG_CD,
+	SFR_AVG_AB1,
+	SFR_AVG_AC1,
+	SFR_AVG_AD1,
+	SFR_AVG_BC1,
+	SFR_AVG_BD1,
+	SFR_AVG_CD1,
+	SFR_AVG_ABC,
+	SFR_AVG_ACD,
+	SFR_AVG_ABD,
+	SFR_AVG_BCD,
+	SFR_AVG_ABCD,
+	SFR_AVG_ABCD1,
+	SFR_CLAMP_GRAD,
+	SFR_SKEW_GRAD,
+	SFR_ABC_CLAMP,
+	SFR_PAETH,
+	SFR_ABC_PAETH,
+	SFR_PLO,
+	SFR_SELECT,
+	SFR_SELECT_F,
+	SFR_ED_GRAD,
+	LIST_TAPS( 0), LIST_TAPS( 1), LIST_TAPS( 2), LIST_TAPS( 3), LIST_TAPS( 4),
+	LIST_TAPS( 5), LIST_TAPS( 6), LIST_TAPS( 7), LIST_TAPS( 8), LIST_TAPS( 9),
+	LIST_TAPS(10), LIST_TAPS(11), LIST_TAPS(12), LIST_TAPS(13), LIST_TAPS(14),
+	LIST_TAPS(15), LIST_TAPS(16), LIST_TAPS(17), LIST_TAPS(18), LIST_TAPS(19),
+	LIST_TAPS(20), LIST_TAPS(21), LIST_TAPS(22), LIST_TAPS(23), LIST_TAPS(24),
+	LIST_TAPS(25), LIST_TAPS(26), LIST_TAPS(27), LIST_TAPS(28), LIST_TAPS(29),
+	LIST_TAPS(30), LIST_TAPS(31), LIST_TAPS(32), LIST_TAPS(33), LIST_TAPS(34),
+	LIST_TAPS(35), LIST_TAPS(36), LIST_TAPS(37), LIST_TAPS(38), LIST_TAPS(39),
+	LIST_TAPS(40), LIST_TAPS(41), LIST_TAPS(42), LIST_TAPS(43), LIST_TAPS(44),
+	LIST_TAPS(45), LIST_TAPS(46), LIST_TAPS(47), LIST_TAPS(48), LIST_TAPS(49),
+	LIST_TAPS(50), LIST_TAPS(51), LIST_TAPS(52), LIST_TAPS(53), LIST_TAPS(54),
+	LIST_TAPS(55), LIST_TAPS(56), LIST_TAPS(57), LIST_TAPS(58), LIST_TAPS(59),
+	LIST_TAPS(60), LIST_TAPS(61), LIST_TAPS(62), LIST_TAPS(63), LIST_TAPS(64),
+	LIST_TAPS(65), LIST_TAPS(66), LIST_TAPS(67), LIST_TAPS(68), LIST_TAPS(69),
+	LIST_TAPS(70), LIST_TAPS(71), LIST_TAPS(72), LIST_TAPS(73), LIST_TAPS(74),
+	LIST_TAPS(75), LIST_TAPS(76), LIST_TAPS(77), LIST_TAPS(78), LIST_TAPS(79)
+};
+
+#undef LIST_TAPS
@@ -131,6 +131,29 @@ struct RGBAFilterFuncs {
 
 extern const RGBAFilterFuncs RGBA_FILTERS[SF_COUNT];
 
+/*
+ * Batched RGBA filter
+ *
+ * p: Pointer to first RGBA pixel of a run
+ * count: Number of pixels in the run
+ * x, y: Location of the first pixel
+ * width: Pixels in width of p buffer
+ *
+ * Reverses the filter for a run of pixels sharing the same filter, adding the
+ * prediction to RGB and leaving alpha alone.  Pixels are done left to right
+ * so that predictions from A see the finished pixel.  Each filter has its own
+ * loop with the prediction inlined.
+ *
+ * Same restrictions as the unsafe version: The run must start at x > 0, y > 0
+ * and end before the last pixel in the row.
+ */
+typedef void (*RGBAFilterRowFunc)(u8 *p, int count, int x, int y, int width);
+
+extern const RGBAFilterRowFunc RGBA_ROW_FILTERS[SF_COUNT];
+
+// Most rows above p that an RGBA filter reads (for ED_GRAD)
+static const int RGBA_FILTER_ROWS = 2;
+
 /*
  * Monochrome filter
  *
@@ -153,6 +176,9 @@ struct MonoFilterFuncs {
 
 extern const MonoFilterFuncs MONO_FILTERS[SF_COUNT];
 
+// Most rows above p that a monochrome filter reads (for ED_GRAD)
+static const int MONO_FILTER_ROWS = 2;
+
 
 //// Color Filters
 
@@ -194,6 +220,16 @@ typedef void (*YUV2RGBFilterFunction)(const u8 * CAT_RESTRICT yuv_in, u8 * CAT_R
 extern const RGB2YUVFilterFunction RGB2YUV_FILTERS[];
 extern const YUV2RGBFilterFunction YUV2RGB_FILTERS[];
 
+/*
+ * Batched color filter
+ *
+ * Reverses the color filter in place for a run of RGBA pixels that hold YUV
+ * in the first three bytes.  Alpha is left alone.
+ */
+typedef void (*YUV2RGBRowFunction)(u8 * CAT_RESTRICT rgba, int count);
+
+extern const YUV2RGBRowFunction YUV2RGB_ROW_FILTERS[];
+
 const char *GetColorFilterString(int cf);
 
 
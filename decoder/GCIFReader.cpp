@@ -32,58 +32,447 @@
 #include "ImageMaskReader.hpp"
 #include "ImagePaletteReader.hpp"
 #include "ImageRGBAReader.hpp"
+#include "ImageOutput.hpp"
 #include "EndianNeutral.hpp"
+#include "SmartArray.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
 #include <stdlib.h>
+#include <new>
+#include <algorithm>
 using namespace cat;
 
-static int gcif_read(ImageReader &reader, GCIFImage *image) {
-	int err;
+#if defined(CAT_COMPILE_THREADS) && defined(CAT_OS_WINDOWS)
+#include <process.h>
+#endif
 
-	// Fill in image xsize and ysize
-	ImageReader::Header *header = reader.getHeader();
 
+//// GCIFDecoder
+
+// Incremental decoding states
+enum PushStates {
+	PUSH_HEAD,		// Waiting for the file header
+	PUSH_STRIPES,	// Decoding each stripe once it has arrived
+	PUSH_WHOLE,		// Waiting for the end of an image without stripes
+	PUSH_THREAD,	// Reading an image without stripes in the background
+	PUSH_DONE		// Image is finished
+};
+
+#ifdef CAT_COMPILE_THREADS
+
+/*
+ * Background reader for pushed images without stripes
+ *
+ * The image is read on a thread of its own while the data arrives.  Its
+ * ImageReader calls wait() whenever it gets to the end of the data pushed so
+ * far, which sleeps until more is pushed and notes the rows finished by then
+ * for rows_done.
+ *
+ * Between waits the thread loads straight from push_data.  When that fills up
+ * it is swapped out for a larger buffer, and is only reused once the thread
+ * has waited again and moved over to the new one.
+ */
+class PushFeed : public ImageFeed {
+	GCIFDecoder *_decoder;
+
+#if defined(CAT_OS_WINDOWS)
+	HANDLE _thread;
+	CRITICAL_SECTION _lock;
+	HANDLE _more;
+#else
+	pthread_t _thread;
+	pthread_mutex_t _lock;
+	pthread_cond_t _more;
+#endif
+
+	bool _running;			// Thread was started and not joined yet
+
+	// Shared with the thread while locked
+	SmartArray<u8> _retired;	// Old push_data, which the thread may be loading from
+	bool _retired_busy;
+	bool _end;				// All of the data has been pushed
+	bool _quit;				// Stop reading early
+	bool _finished;			// Thread is done reading
+	int _result;			// GCIF_RE_* from the thread once finished
+	int _rows;				// Rows finished at the last wait
+
+	CAT_INLINE void lock() {
+#if defined(CAT_OS_WINDOWS)
+		EnterCriticalSection(&_lock);
+#else
+		pthread_mutex_lock(&_lock);
+#endif
+	}
+
+	CAT_INLINE void unlock() {
+#if defined(CAT_OS_WINDOWS)
+		LeaveCriticalSection(&_lock);
+#else
+		pthread_mutex_unlock(&_lock);
+#endif
+	}
+
+	// Wake the thread if it is waiting, while locked
+	CAT_INLINE void signal() {
+#if defined(CAT_OS_WINDOWS)
+		SetEvent(_more);
+#else
+		pthread_cond_signal(&_more);
+#endif
+	}
+
+	void threadMain();
+
+#if defined(CAT_OS_WINDOWS)
+	static unsigned int __stdcall ThreadWrapper(void *param);
+#else
+	static void *ThreadWrapper(void *param);
+#endif
+
+	void join();
+
+public:
+	PushFeed();
+	virtual ~PushFeed();
+
+	// Start reading the image in the background, or return false on failure.
+	// The decoder output must be set up already
+	bool start(GCIFDecoder *decoder);
+
+	// Append data, waiting for the thread to finish if end is set.  Returns
+	// GCIF_RE_OK until the thread finishes, and then its result
+	int push(const void *data, int bytes, bool end);
+
+	// Stop the thread if it is running, discarding the image
+	void stop();
+
+	virtual const u32 *wait(u32 word_count, u32 &ready, bool &done);
+};
+
+#endif // CAT_COMPILE_THREADS
+
+/*
+ * The decoder context holds every reader used to decode an image.  Each of
+ * them keeps its buffers between images, only growing them as needed.
+ */
+struct _GCIFDecoder {
+	ImageReader reader;
+
+	SmallPaletteReader smallPaletteReader;
+	ImageMaskReader imageMaskReader;
+	ImagePaletteReader imagePaletteReader;
+	ImageRGBAReader imageRGBAReader;
+
+	// RGBA output owned by the context
+	SmartArray<u8> rgba;
+	bool own_output;
+
+	// Where the readers put decoded pixels
+	ImageOutput output;
+
+	// Incremental decoding
+	SmartArray<u8> push_data;	// File data received so far
+	int push_bytes;
+	int push_state;				// PUSH_*
+	int push_err;				// First error, reported from then on
+	int push_stripe;			// Next stripe to decode
+	int push_rows;				// Rows finished so far
+	GCIFImage push_image;
+
+#ifdef CAT_COMPILE_THREADS
+	PushFeed push_feed;
+#endif // CAT_COMPILE_THREADS
+
+#ifdef CAT_COMPILE_MMAP
+	MappedFile file;
+	MappedView fileView;
+#endif // CAT_COMPILE_MMAP
+
+	// Contexts for pool threads.  Stripes run on this context for thread 0,
+	// while batches use workers[0] to leave this context and its pool free
+	_GCIFDecoder *workers[GCIF_MAX_THREADS];
+
+	// Batch items sorted by decreasing size
+	SmartArray<u64> batch_order;
+
+	// Decode statistics to add to, or 0
+	GCIFDecodeStats *stats;
+
+	GCIFRunJobs run_jobs;
+	void *run_jobs_pool;
+
+#ifdef CAT_COMPILE_THREADS
+	ThreadPool *pool;
+#endif // CAT_COMPILE_THREADS
+
+	_GCIFDecoder() {
+		own_output = false;
+		push_bytes = 0;
+		push_state = PUSH_HEAD;
+		push_err = GCIF_RE_OK;
+		for (int ii = 0; ii < GCIF_MAX_THREADS; ++ii) {
+			workers[ii] = 0;
+		}
+		stats = 0;
+		run_jobs = 0;
+		run_jobs_pool = 0;
+#ifdef CAT_COMPILE_THREADS
+		pool = 0;
+#endif // CAT_COMPILE_THREADS
+	}
+
+	~_GCIFDecoder() {
+#ifdef CAT_COMPILE_THREADS
+		// Stop reading before the readers go away
+		push_feed.stop();
+
+		if (pool) {
+			delete pool;
+			pool = 0;
+		}
+#endif // CAT_COMPILE_THREADS
+
+		for (int ii = 0; ii < GCIF_MAX_THREADS; ++ii) {
+			if (workers[ii]) {
+				delete workers[ii];
+				workers[ii] = 0;
+			}
+		}
+	}
+};
+
+static int gcif_setup_output(GCIFDecoder *decoder, GCIFImage *image, int xsize, int ysize) {
 	// Validate input buffer and sizes for direct-to-memory mode
 	if (image->xsize < 0 || image->ysize < 0) {
-		image->xsize = header->xsize;
-		image->ysize = header->ysize;
-	} else if (image->xsize != header->xsize
-			|| image->ysize != header->ysize
+		image->xsize = xsize;
+		image->ysize = ysize;
+	} else if (image->xsize != xsize
+			|| image->ysize != ysize
 			|| image->rgba == 0) {
 		return GCIF_RE_BAD_DIMS;
 	}
 
+	const int bytes = decoder->output.getPixelBytes();
+
 	// If we need to allocate memory for this image,
 	if (!image->rgba) {
-		u64 size = image->xsize * (u64)image->ysize * 4;
+		// If the context owns the output,
+		if (decoder->own_output) {
+			decoder->rgba.resize(xsize * ysize * bytes);
 
-		void *output;
+			image->rgba = decoder->rgba.get();
+		} else {
+			u64 size = image->xsize * (u64)image->ysize * bytes;
+
+			void *output;
 #ifdef posix_memalign
-		posix_memalign(&output, 8, size);
+			posix_memalign(&output, 8, size);
 #elif defined(memalign)
-		output = memalign(8, size);
+			output = memalign(8, size);
 #else
-		output = malloc(size);
+			output = malloc(size);
 #endif
-		image->rgba = (u8 *)output;
+			image->rgba = (u8 *)output;
+		}
+	}
+
+	return GCIF_RE_OK;
+}
+
+// Part of the image to decode, for the region API
+struct GCIFRegion {
+	u8 *rgba;
+	int x, y, w, h;
+};
+
+// Bands of rows to pass to a callback, for the streaming API
+struct GCIFStream {
+	int band_rows;
+	GCIFRowCallback callback;
+	void *context;
+};
+
+// What the caller wants decoded, one of these is set
+struct GCIFTarget {
+	GCIFImage *image;			// Whole image to an image
+	const GCIFSurface *surface;	// Whole image into part of a larger surface
+	const GCIFRegion *region;	// Just a region of the image
+	const GCIFStream *stream;	// Whole image passed to a callback
+
+	CAT_INLINE GCIFTarget() {
+		image = 0;
+		surface = 0;
+		region = 0;
+		stream = 0;
+	}
+};
+
+static int gcif_check_region(const GCIFRegion *region, int xsize, int ysize) {
+	if (region->x < 0 || region->y < 0
+			|| region->w <= 0 || region->h <= 0
+			|| region->x + region->w > xsize
+			|| region->y + region->h > ysize
+			|| region->rgba == 0) {
+		return GCIF_RE_BAD_DIMS;
+	}
+
+	return GCIF_RE_OK;
+}
+
+static int gcif_check_surface(const GCIFSurface *surface, int bytes, int xsize, int ysize) {
+	if (surface->x < 0 || surface->y < 0
+			|| surface->x + xsize > surface->xsize
+			|| surface->y + ysize > surface->ysize
+			|| surface->stride < surface->xsize * bytes
+			|| surface->pixels == 0) {
+		return GCIF_RE_BAD_DIMS;
+	}
+
+	return GCIF_RE_OK;
+}
+
+/*
+ * Validate the target and set up the decoder output for streaming.  For
+ * whole-image targets, out and stride locate the output rows.
+ */
+static int gcif_setup_target(GCIFDecoder *decoder, const GCIFTarget &target, int xsize, int ysize, u8 *&out, int &stride) {
+	int err;
+
+	ImageOutput &output = decoder->output;
+	const int bytes = output.getPixelBytes();
+
+	out = 0;
+	stride = 0;
+
+	if (target.stream) {
+		const GCIFStream *stream = target.stream;
+
+		output.initStream(xsize, ysize, stream->band_rows, stream->callback, stream->context);
+	} else if (target.region) {
+		if ((err = gcif_check_region(target.region, xsize, ysize))) {
+			return err;
+		}
+	} else if (target.surface) {
+		const GCIFSurface *surface = target.surface;
+
+		if ((err = gcif_check_surface(surface, bytes, xsize, ysize))) {
+			return err;
+		}
+
+		out = surface->pixels + surface->y * surface->stride + surface->x * bytes;
+		stride = surface->stride;
+	} else {
+		if ((err = gcif_setup_output(decoder, target.image, xsize, ysize))) {
+			return err;
+		}
+
+		out = target.image->rgba;
+		stride = xsize * bytes;
+	}
+
+	return GCIF_RE_OK;
+}
+
+// Add the pixel counts and table sizes from gcif_read() to the stats
+static void gcif_add_stats(GCIFDecoder *decoder, GCIFDecodeStats *stats) {
+	ImageOutput &output = decoder->output;
+	SmallPaletteReader &smallPaletteReader = decoder->smallPaletteReader;
+	ImageMaskReader &imageMaskReader = decoder->imageMaskReader;
+	ImagePaletteReader &imagePaletteReader = decoder->imagePaletteReader;
+	ImageRGBAReader &imageRGBAReader = decoder->imageRGBAReader;
+
+	long total = 0, masked = 0, lz = 0;
+
+	stats->colors = 0;
+	stats->chaos_levels = 0;
+
+	// If small palette is being used,
+	if (smallPaletteReader.enabled()) {
+		stats->colors = smallPaletteReader.getPaletteSize();
+
+		if (smallPaletteReader.multipleColors()) {
+			stats->mode = GCIF_MODE_SMALL_PALETTE;
+
+			// Counted in packed bytes
+			total = (long)smallPaletteReader.getPackX() * smallPaletteReader.getPackEnd();
+			masked = imageMaskReader.getMaskedCount();
+			lz = smallPaletteReader.getLZCount();
+		} else {
+			stats->mode = GCIF_MODE_SINGLE_COLOR;
+
+			// Every pixel is filled in with the one color, as if masked
+			total = (long)output.getXSize() * output.getRowEnd();
+			masked = total;
+		}
+	} else {
+		total = (long)output.getXSize() * output.getRowEnd();
+		masked = imageMaskReader.getMaskedCount();
+
+		if (imagePaletteReader.enabled()) {
+			stats->mode = GCIF_MODE_PALETTE;
+			stats->colors = imagePaletteReader.getPaletteSize();
+			lz = imagePaletteReader.getLZCount();
+		} else {
+			stats->mode = GCIF_MODE_RGBA;
+			stats->chaos_levels = imageRGBAReader.getChaosLevels();
+			lz = imageRGBAReader.getLZCount();
+		}
+	}
+
+	stats->masked_pixels += masked;
+	stats->lz_pixels += lz;
+	stats->literal_pixels += total - masked - lz;
+	stats->stripes++;
+
+	if (stats->work_bytes < output.getWorkBytes()) {
+		stats->work_bytes = output.getWorkBytes();
+	}
+
+	stats->total_usec = 0;
+	for (int ii = 0; ii < GCIF_SECTION_COUNT; ++ii) {
+		stats->total_usec += stats->usec[ii];
+	}
+}
+
+// Decode the image from the reader into the output set up by the caller
+static int gcif_read(GCIFDecoder *decoder) {
+	int err;
+
+	ImageReader &reader = decoder->reader;
+	ImageOutput &output = decoder->output;
+
+	// Charge each section to the stats from here, if collecting them
+	GCIFDecodeStats *stats = decoder->stats;
+	reader.setStats(stats);
+
+	// Validate image xsize and ysize
+	ImageReader::Header *header = reader.getHeader();
+
+	if (header->xsize != output.getXSize() || header->ysize != output.getYSize()) {
+		return GCIF_RE_BAD_DIMS;
 	}
 
 	// Small Palette
-	SmallPaletteReader smallPaletteReader;
-	if ((err = smallPaletteReader.readHead(reader, image->rgba))) {
+	SmallPaletteReader &smallPaletteReader = decoder->smallPaletteReader;
+	if ((err = smallPaletteReader.readHead(reader, output))) {
 		return err;
 	}
 
+	reader.markSection(GCIF_SECTION_HEAD);
+
+	// Color Mask
+	ImageMaskReader &imageMaskReader = decoder->imageMaskReader;
+
 	// If small palette is being used,
 	if (smallPaletteReader.enabled()) {
 		if (smallPaletteReader.multipleColors()) {
 			const int pack_x = smallPaletteReader.getPackX();
 			const int pack_y = smallPaletteReader.getPackY();
 
-			// Color Mask
-			ImageMaskReader imageMaskReader;
 			if ((err = imageMaskReader.read(reader, 1, pack_x, pack_y))) {
 				return err;
 			}
+			reader.markSection(GCIF_SECTION_MASK);
 			imageMaskReader.dumpStats();
 
 			// Finish reading small paletted image
@@ -93,142 +482,1332 @@ static int gcif_read(ImageReader &reader, GCIFImage *image) {
 			smallPaletteReader.dumpStats();
 		}
 	} else {
-		// Color Mask
-		ImageMaskReader imageMaskReader;
-		if ((err = imageMaskReader.read(reader, 4, image->xsize, image->ysize))) {
+		if ((err = imageMaskReader.read(reader, 4, output.getXSize(), output.getYSize()))) {
 			return err;
 		}
+		reader.markSection(GCIF_SECTION_MASK);
 		imageMaskReader.dumpStats();
 
 		// Global Palette Decompression
-		ImagePaletteReader imagePaletteReader;
-		if ((err = imagePaletteReader.read(reader, imageMaskReader, image))) {
+		ImagePaletteReader &imagePaletteReader = decoder->imagePaletteReader;
+		if ((err = imagePaletteReader.read(reader, imageMaskReader, output))) {
 			return err;
 		}
 		imagePaletteReader.dumpStats();
 
 		if (!imagePaletteReader.enabled()) {
 			// RGBA Decompression
-			ImageRGBAReader imageRGBAReader;
-			if ((err = imageRGBAReader.read(reader, imageMaskReader, image))) {
+			ImageRGBAReader &imageRGBAReader = decoder->imageRGBAReader;
+			if ((err = imageRGBAReader.read(reader, imageMaskReader, output))) {
 				return err;
 			}
 			imageRGBAReader.dumpStats();
 		}
 	}
 
+	if (stats) {
+		gcif_add_stats(decoder, stats);
+	}
+
 	return GCIF_RE_OK;
 }
 
-#ifdef CAT_COMPILE_MMAP
 
-extern "C" int gcif_read_file(const char *input_file_path_in, GCIFImage *image_out) {
-	int err;
+//// Stripes
 
-	// Initialize image data
-	image_out->rgba = 0;
-	image_out->xsize = -1;
-	image_out->ysize = -1;
+struct StripeJob {
+	GCIFDecoder *decoder;
 
-	// Initialize image reader
-	ImageReader reader;
-	if ((err = reader.init(input_file_path_in))) {
-		return err;
+	const u32 *words;
+	const u32 *offsets;
+	int word_count;
+	int stripe_rows, stripe_count;
+
+	u8 *rgba;
+	int stride;
+	int xsize, ysize, format;
+	const GCIFRegion *region;
+	const GCIFStream *stream;
+
+	int errors[ImageReader::MAX_STRIPES];
+};
+
+/*
+ * Get the context for a pool thread, or 0 on failure.
+ *
+ * Only one job at a time runs with each thread index, so the worker contexts
+ * can be created here without any locking.
+ */
+static GCIFDecoder *gcif_get_worker(GCIFDecoder *decoder, int thread_index, int format) {
+	if CAT_UNLIKELY(thread_index < 0 || thread_index >= GCIF_MAX_THREADS) {
+		return 0;
 	}
 
-	if ((err = gcif_read(reader, image_out))) {
-		if (image_out->rgba) {
-			free(image_out->rgba);
-			image_out->rgba = 0;
+	GCIFDecoder *&worker = decoder->workers[thread_index];
+	if (!worker) {
+		worker = new (std::nothrow) GCIFDecoder;
+
+		if (!worker) {
+			return 0;
 		}
-		return err;
 	}
 
-	return GCIF_RE_OK;
+	worker->output.setFormat(format);
+	return worker;
 }
 
-#endif // CAT_COMPILE_MMAP
+static void gcif_read_stripe(void *job_data, int job_index, int thread_index) {
+	StripeJob *job = reinterpret_cast<StripeJob *>( job_data );
 
-extern "C" int gcif_get_size(const void *file_data_in, long file_size_bytes_in, int *xsize, int *ysize) {
-	// Validate length
-	if (file_size_bytes_in < 8) {
-		return GCIF_RE_BAD_HEAD;
+	GCIFDecoder *decoder = job->decoder;
+	if (thread_index > 0) {
+		decoder = gcif_get_worker(decoder, thread_index, job->format);
+
+		if (!decoder) {
+			job->errors[job_index] = GCIF_RE_FILE;
+			return;
+		}
 	}
 
-	// Validate signature
-	const u32 *head_word = reinterpret_cast<const u32 *>( file_data_in );
-	u32 sig = getLE(head_word[0]);
-	if (sig != ImageReader::HEAD_MAGIC) {
-		return GCIF_RE_BAD_HEAD;
+	// Locate stripe data
+	const int start = getLE(job->offsets[job_index]);
+	const int end = job_index + 1 < job->stripe_count ? getLE(job->offsets[job_index + 1]) : job->word_count;
+
+	const int y = job_index * job->stripe_rows;
+	const int ysize = job->ysize - y < job->stripe_rows ? job->ysize - y : job->stripe_rows;
+
+	const int bytes = decoder->output.getPixelBytes();
+
+	const GCIFRegion *region = job->region;
+	if (job->stream) {
+		// Stripes are read in order on the calling thread, so keep the bands going
+		decoder->output.setStripe(y, ysize);
+	} else if (region) {
+		// Clip the region to the stripe rows
+		const int y0 = region->y > y ? region->y : y;
+		const int y1 = region->y + region->h < y + ysize ? region->y + region->h : y + ysize;
+
+		// If the stripe is not needed,
+		if (y0 >= y1) {
+			job->errors[job_index] = GCIF_RE_OK;
+			return;
+		}
+
+		u8 *rgba = region->rgba + (y0 - region->y) * region->w * bytes;
+		decoder->output.initRegion(rgba, job->xsize, ysize, region->x, y0 - y, region->w, y1 - y0);
+	} else {
+		// Decode straight into the stripe rows of the output
+		decoder->output.init(job->rgba + y * job->stride, job->xsize, ysize, job->stride);
 	}
 
-	// Read xsize, ysize
-	u32 word1 = getLE(head_word[1]);
-	*xsize = (u16)((word1 >> (32 - ImageReader::MAX_X_BITS)) & ((1 << ImageReader::MAX_X_BITS) - 1));
-	*ysize = (u16)((word1 >> (32 - ImageReader::MAX_X_BITS - ImageReader::MAX_Y_BITS)) & ((1 << ImageReader::MAX_Y_BITS) - 1));
+	int err;
+	if (!(err = decoder->reader.init(job->words + start, (end - start) * sizeof(u32)))) {
+		err = gcif_read(decoder);
+	}
 
-	return GCIF_RE_OK;
+	job->errors[job_index] = err;
 }
 
-extern "C" int gcif_sig_cmp(const void *file_data_in, long file_size_bytes_in) {
-	// Validate length
-	if (file_size_bytes_in < 8) {
+// Layout from the head of a striped file
+struct StripeHead {
+	int xsize, ysize;
+	int stripe_rows, stripe_count;
+	int head_words;		// Words up to the end of the offset table
+};
+
+static int gcif_read_stripe_head(const u32 *words, int word_count, StripeHead &head) {
+	if (word_count < ImageReader::STRIPE_HEAD_WORDS) {
 		return GCIF_RE_BAD_HEAD;
 	}
 
-	// Validate signature
-	const u32 *head_word = reinterpret_cast<const u32 *>( file_data_in );
-	u32 sig = getLE(head_word[0]);
-	if (sig != ImageReader::HEAD_MAGIC) {
-		return GCIF_RE_BAD_HEAD;
+	// Read header
+	const u32 word1 = getLE(words[1]);
+	head.xsize = (word1 >> (32 - ImageReader::MAX_X_BITS)) & ImageReader::MAX_X;
+	head.ysize = (word1 >> (32 - ImageReader::MAX_X_BITS - ImageReader::MAX_Y_BITS)) & ImageReader::MAX_Y;
+	head.stripe_rows = (int)getLE(words[2]);
+
+	if (head.stripe_rows <= 0 || head.stripe_rows > (int)ImageReader::MAX_Y) {
+		return GCIF_RE_BAD_STRIPES;
+	}
+
+	head.stripe_count = (head.ysize + head.stripe_rows - 1) / head.stripe_rows;
+	head.head_words = ImageReader::STRIPE_HEAD_WORDS + head.stripe_count;
+
+	if (head.stripe_count > ImageReader::MAX_STRIPES || head.head_words > word_count) {
+		return GCIF_RE_BAD_STRIPES;
 	}
 
 	return GCIF_RE_OK;
 }
 
-extern "C" int gcif_read_memory(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out) {
+// Check that stripes are in order and that they all start before word_limit
+static int gcif_check_stripe_offsets(const u32 *offsets, const StripeHead &head, u32 word_limit) {
+	u32 last = head.head_words;
+	for (int ii = 0; ii < head.stripe_count; ++ii) {
+		const u32 offset = getLE(offsets[ii]);
+
+		if (offset < last || offset >= word_limit) {
+			return GCIF_RE_BAD_STRIPES;
+		}
+
+		last = offset + 1;
+	}
+
+	return GCIF_RE_OK;
+}
+
+static int gcif_read_stripes(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, const GCIFTarget &target) {
 	int err;
 
-	// Initialize image data
-	image_out->rgba = 0;
-	image_out->xsize = -1;
-	image_out->ysize = -1;
+	const u32 *words = reinterpret_cast<const u32 *>( file_data_in );
+	const int word_count = (int)(file_size_bytes_in / sizeof(u32));
 
-	// Initialize image reader
-	ImageReader reader;
-	if ((err = reader.init(file_data_in, file_size_bytes_in))) {
+	StripeHead head;
+	if ((err = gcif_read_stripe_head(words, word_count, head))) {
 		return err;
 	}
 
-	if ((err = gcif_read(reader, image_out))) {
-		if (image_out->rgba) {
-			free(image_out->rgba);
-			image_out->rgba = 0;
-		}
+	const int xsize = head.xsize, ysize = head.ysize;
+	const int stripe_rows = head.stripe_rows, stripe_count = head.stripe_count;
+	const u32 *offsets = words + ImageReader::STRIPE_HEAD_WORDS;
+
+	// Validate offset table
+	if ((err = gcif_check_stripe_offsets(offsets, head, word_count))) {
+		return err;
+	}
+
+	u8 *out;
+	int stride;
+	if ((err = gcif_setup_target(decoder, target, xsize, ysize, out, stride))) {
 		return err;
 	}
 
+	StripeJob job;
+	job.decoder = decoder;
+	job.words = words;
+	job.offsets = offsets;
+	job.word_count = word_count;
+	job.stripe_rows = stripe_rows;
+	job.stripe_count = stripe_count;
+	job.rgba = out;
+	job.stride = stride;
+	job.xsize = xsize;
+	job.ysize = ysize;
+	job.format = decoder->output.getFormat();
+	job.region = target.region;
+	job.stream = target.stream;
+
+	// Run stripe jobs
+	if (job.stream) {
+		for (int ii = 0; ii < stripe_count; ++ii) {
+			gcif_read_stripe(&job, ii, 0);
+
+			// Stop at the first error so bands are never skipped
+			if ((err = job.errors[ii])) {
+				return err;
+			}
+		}
+	} else if (decoder->run_jobs) {
+		decoder->run_jobs(decoder->run_jobs_pool, stripe_count, gcif_read_stripe, &job);
+#ifdef CAT_COMPILE_THREADS
+	} else if (decoder->pool) {
+		decoder->pool->run(stripe_count, gcif_read_stripe, &job);
+#endif // CAT_COMPILE_THREADS
+	} else {
+		for (int ii = 0; ii < stripe_count; ++ii) {
+			gcif_read_stripe(&job, ii, 0);
+		}
+	}
+
+	// Report the first error
+	for (int ii = 0; ii < stripe_count; ++ii) {
+		if ((err = job.errors[ii])) {
+			return err;
+		}
+	}
+
 	return GCIF_RE_OK;
 }
 
-extern "C" int gcif_read_memory_to_buffer(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out) {
+static CAT_INLINE bool gcif_is_striped(const void *file_data_in, long file_size_bytes_in) {
+	if (file_size_bytes_in < 4) {
+		return false;
+	}
+
+	const u32 *head_word = reinterpret_cast<const u32 *>( file_data_in );
+	return getLE(head_word[0]) == ImageReader::STRIPE_MAGIC;
+}
+
+#ifdef CAT_COMPILE_THREADS
+
+// Run jobs on the decoder's own threads
+static void gcif_run_pool(void *pool, int job_count, GCIFJobFunction job, void *job_data) {
+	reinterpret_cast<ThreadPool *>( pool )->run(job_count, job, job_data);
+}
+
+#endif // CAT_COMPILE_THREADS
+
+// Read a striped or normal image to the target
+static int gcif_read_any(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, const GCIFTarget &target) {
 	int err;
 
+	if (gcif_is_striped(file_data_in, file_size_bytes_in)) {
+		return gcif_read_stripes(decoder, file_data_in, file_size_bytes_in, target);
+	}
+
 	// Initialize image reader
-	ImageReader reader;
-	if ((err = reader.init(file_data_in, file_size_bytes_in))) {
+	if ((err = decoder->reader.init(file_data_in, file_size_bytes_in))) {
 		return err;
 	}
 
-	// Note: Allowing RGBA pointer to fall through and do not free it on error.
+	// Set up output
+	ImageReader::Header *header = decoder->reader.getHeader();
+	const int xsize = header->xsize, ysize = header->ysize;
 
-	return gcif_read(reader, image_out);
-}
+	u8 *out;
+	int stride;
+	if ((err = gcif_setup_target(decoder, target, xsize, ysize, out, stride))) {
+		return err;
+	}
 
-extern "C" const char *gcif_read_errstr(int err) {
-	switch (err) {
-		case GCIF_RE_OK:			// No problemo
-			return "OK";
+	if (target.region) {
+		const GCIFRegion *region = target.region;
+
+		decoder->output.initRegion(region->rgba, xsize, ysize, region->x, region->y, region->w, region->h);
+	} else if (out) {
+		decoder->output.init(out, xsize, ysize, stride);
+	}
+
+#ifdef CAT_COMPILE_THREADS
+	// With no stripes to spread over the threads, pipeline the RGBA decode
+	// instead.  Bands are passed to stream callbacks on the calling thread
+	ImageRGBAReader &imageRGBAReader = decoder->imageRGBAReader;
+	if (!target.stream) {
+		if (decoder->run_jobs) {
+			// The size of a caller-supplied pool is not known, so use two
+			imageRGBAReader.setPipeline(decoder->run_jobs, decoder->run_jobs_pool, 2);
+		} else if (decoder->pool) {
+			imageRGBAReader.setPipeline(gcif_run_pool, decoder->pool, decoder->pool->getThreadCount());
+		}
+	}
+
+	err = gcif_read(decoder);
+
+	imageRGBAReader.setPipeline(0, 0, 1);
+
+	return err;
+#else
+	return gcif_read(decoder);
+#endif // CAT_COMPILE_THREADS
+}
+
+// Read a striped or normal image to an image
+static CAT_INLINE int gcif_read_any(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFImage *image) {
+	GCIFTarget target;
+	target.image = image;
+
+	return gcif_read_any(decoder, file_data_in, file_size_bytes_in, target);
+}
+
+
+//// Info
+
+// Decode cost per pixel for each mode, relative to RGBA pixels
+static const double INFO_COST_SINGLE_COLOR = 0.005;
+static const double INFO_COST_SMALL_PALETTE = 0.5;	// Per packed pixel
+static const double INFO_COST_PALETTE = 0.4;
+static const double INFO_COST_RGBA = 1.0;
+
+// Read the leading section headers from the reader without decoding pixels
+static int gcif_read_info(GCIFDecoder *decoder, GCIFInfo *info) {
+	int err;
+
+	ImageReader &reader = decoder->reader;
+	const ImageReader::Header *header = reader.getHeader();
+	const int xsize = header->xsize, ysize = header->ysize;
+
+	info->colors = 0;
+	info->mask = 0;
+	info->chaos_levels = 0;
+	info->lz = 0;
+
+	// Small Palette
+	SmallPaletteReader &smallPaletteReader = decoder->smallPaletteReader;
+	if ((err = smallPaletteReader.readInfo(reader))) {
+		return err;
+	}
+
+	// If small palette is being used,
+	if (smallPaletteReader.enabled()) {
+		info->colors = smallPaletteReader.getPaletteSize();
+
+		if (smallPaletteReader.multipleColors()) {
+			info->mode = GCIF_MODE_SMALL_PALETTE;
+			info->cost = INFO_COST_SMALL_PALETTE * smallPaletteReader.getPackX() * smallPaletteReader.getPackY();
+
+			// Color Mask enable bit comes first
+			info->mask = reader.readBit();
+		} else {
+			info->mode = GCIF_MODE_SINGLE_COLOR;
+			info->cost = INFO_COST_SINGLE_COLOR * xsize * ysize;
+		}
+	} else {
+		// The palette header follows the mask, so the mask must be read
+		ImageMaskReader &imageMaskReader = decoder->imageMaskReader;
+		if ((err = imageMaskReader.read(reader, 4, xsize, ysize))) {
+			return err;
+		}
+		info->mask = imageMaskReader.enabled() ? 1 : 0;
+
+		// Global Palette header
+		ImagePaletteReader &imagePaletteReader = decoder->imagePaletteReader;
+		if ((err = imagePaletteReader.readInfo(reader))) {
+			return err;
+		}
+
+		if (imagePaletteReader.enabled()) {
+			info->mode = GCIF_MODE_PALETTE;
+			info->colors = imagePaletteReader.getPaletteSize();
+			info->cost = INFO_COST_PALETTE * xsize * ysize;
+		} else {
+			info->mode = GCIF_MODE_RGBA;
+			info->cost = INFO_COST_RGBA * xsize * ysize;
+
+			// RGBA filter and chaos tables
+			ImageRGBAReader &imageRGBAReader = decoder->imageRGBAReader;
+			if ((err = imageRGBAReader.readInfo(reader, xsize, ysize))) {
+				return err;
+			}
+			info->chaos_levels = imageRGBAReader.getChaosLevels();
+			info->lz = imageRGBAReader.usesLZ() ? 1 : 0;
+		}
+	}
+
+	if CAT_UNLIKELY(reader.eof()) {
+		return GCIF_RE_BAD_DATA;
+	}
+
+	return GCIF_RE_OK;
+}
+
+static int gcif_get_info_any(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFInfo *info) {
+	int err;
+
+	const void *data = file_data_in;
+	long bytes = file_size_bytes_in;
+
+	// If striped, describe the image by its first stripe
+	if (gcif_is_striped(file_data_in, file_size_bytes_in)) {
+		const u32 *words = reinterpret_cast<const u32 *>( file_data_in );
+		const int word_count = (int)(file_size_bytes_in / sizeof(u32));
+
+		StripeHead head;
+		if ((err = gcif_read_stripe_head(words, word_count, head))) {
+			return err;
+		}
+
+		const u32 *offsets = words + ImageReader::STRIPE_HEAD_WORDS;
+		if ((err = gcif_check_stripe_offsets(offsets, head, word_count))) {
+			return err;
+		}
+
+		const int start = getLE(offsets[0]);
+		const int end = head.stripe_count > 1 ? getLE(offsets[1]) : word_count;
+
+		data = words + start;
+		bytes = (end - start) * sizeof(u32);
+
+		info->xsize = head.xsize;
+		info->ysize = head.ysize;
+		info->stripe_rows = head.stripe_rows;
+	} else {
+		info->stripe_rows = 0;
+	}
+
+	if ((err = decoder->reader.init(data, bytes))) {
+		return err;
+	}
+
+	if (!info->stripe_rows) {
+		const ImageReader::Header *header = decoder->reader.getHeader();
+		info->xsize = header->xsize;
+		info->ysize = header->ysize;
+	}
+
+	if ((err = gcif_read_info(decoder, info))) {
+		return err;
+	}
+
+	// Scale the cost of the first stripe up to the whole image
+	if (info->stripe_rows && info->stripe_rows < info->ysize) {
+		info->cost = info->cost * info->ysize / info->stripe_rows;
+	}
+
+	return GCIF_RE_OK;
+}
+
+#ifdef CAT_COMPILE_MMAP
+
+static int gcif_map_file(GCIFDecoder *decoder, const char *path, const u8 *&data, long &bytes) {
+	if CAT_UNLIKELY(!decoder->file.OpenRead(path)) {
+		return GCIF_RE_FILE;
+	}
+
+	if CAT_UNLIKELY(!decoder->fileView.Open(&decoder->file)) {
+		return GCIF_RE_FILE;
+	}
+
+	data = decoder->fileView.MapView();
+	if CAT_UNLIKELY(!data) {
+		return GCIF_RE_FILE;
+	}
+
+	bytes = (long)decoder->fileView.GetLength();
+
+	return GCIF_RE_OK;
+}
+
+extern "C" int gcif_read_file(const char *input_file_path_in, GCIFImage *image_out) {
+	int err;
+
+	// Initialize image data
+	image_out->rgba = 0;
+	image_out->xsize = -1;
+	image_out->ysize = -1;
+
+	// Map the file
+	GCIFDecoder decoder;
+	const u8 *data;
+	long bytes;
+	if ((err = gcif_map_file(&decoder, input_file_path_in, data, bytes))) {
+		return err;
+	}
+
+	if ((err = gcif_read_any(&decoder, data, bytes, image_out))) {
+		if (image_out->rgba) {
+			free(image_out->rgba);
+			image_out->rgba = 0;
+		}
+		return err;
+	}
+
+	return GCIF_RE_OK;
+}
+
+#endif // CAT_COMPILE_MMAP
+
+extern "C" int gcif_get_size(const void *file_data_in, long file_size_bytes_in, int *xsize, int *ysize) {
+	// Validate length
+	if (file_size_bytes_in < 8) {
+		return GCIF_RE_BAD_HEAD;
+	}
+
+	// Validate signature
+	const u32 *head_word = reinterpret_cast<const u32 *>( file_data_in );
+	u32 sig = getLE(head_word[0]);
+	if (sig != ImageReader::HEAD_MAGIC && sig != ImageReader::STRIPE_MAGIC) {
+		return GCIF_RE_BAD_HEAD;
+	}
+
+	// Read xsize, ysize
+	u32 word1 = getLE(head_word[1]);
+	*xsize = (u16)((word1 >> (32 - ImageReader::MAX_X_BITS)) & ((1 << ImageReader::MAX_X_BITS) - 1));
+	*ysize = (u16)((word1 >> (32 - ImageReader::MAX_X_BITS - ImageReader::MAX_Y_BITS)) & ((1 << ImageReader::MAX_Y_BITS) - 1));
+
+	return GCIF_RE_OK;
+}
+
+extern "C" int gcif_get_info(const void *file_data_in, long file_size_bytes_in, GCIFInfo *info) {
+	GCIFDecoder decoder;
+	return gcif_get_info_any(&decoder, file_data_in, file_size_bytes_in, info);
+}
+
+extern "C" int gcif_sig_cmp(const void *file_data_in, long file_size_bytes_in) {
+	// Validate length
+	if (file_size_bytes_in < 8) {
+		return GCIF_RE_BAD_HEAD;
+	}
+
+	// Validate signature
+	const u32 *head_word = reinterpret_cast<const u32 *>( file_data_in );
+	u32 sig = getLE(head_word[0]);
+	if (sig != ImageReader::HEAD_MAGIC && sig != ImageReader::STRIPE_MAGIC) {
+		return GCIF_RE_BAD_HEAD;
+	}
+
+	return GCIF_RE_OK;
+}
+
+extern "C" int gcif_read_memory(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out) {
+	return gcif_read_memory_ex(file_data_in, file_size_bytes_in, image_out, 0);
+}
+
+extern "C" int gcif_read_memory_ex(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out, GCIFDecodeStats *stats) {
+	int err;
+
+	// Initialize image data
+	image_out->rgba = 0;
+	image_out->xsize = -1;
+	image_out->ysize = -1;
+
+	GCIFDecoder decoder;
+
+	// If collecting stats, start from zero
+	if (stats) {
+		CAT_OBJCLR(*stats);
+		decoder.stats = stats;
+	}
+
+	if ((err = gcif_read_any(&decoder, file_data_in, file_size_bytes_in, image_out))) {
+		if (image_out->rgba) {
+			free(image_out->rgba);
+			image_out->rgba = 0;
+		}
+		return err;
+	}
+
+	return GCIF_RE_OK;
+}
+
+extern "C" int gcif_read_memory_to_buffer(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out) {
+	// Note: Allowing RGBA pointer to fall through and do not free it on error.
+
+	GCIFDecoder decoder;
+	return gcif_read_any(&decoder, file_data_in, file_size_bytes_in, image_out);
+}
+
+extern "C" int gcif_read_memory_to_surface(const void *file_data_in, long file_size_bytes_in, const GCIFSurface *surface) {
+	GCIFDecoder decoder;
+	return gcif_decoder_read_memory_to_surface(&decoder, file_data_in, file_size_bytes_in, surface);
+}
+
+extern "C" int gcif_read_region(const void *file_data_in, long file_size_bytes_in, int x, int y, int w, int h, unsigned char *rgba_out) {
+	GCIFDecoder decoder;
+	return gcif_decoder_read_region(&decoder, file_data_in, file_size_bytes_in, x, y, w, h, rgba_out);
+}
+
+extern "C" int gcif_read_stream(const void *file_data_in, long file_size_bytes_in, int band_rows, GCIFRowCallback callback, void *context) {
+	GCIFDecoder decoder;
+	return gcif_decoder_read_stream(&decoder, file_data_in, file_size_bytes_in, band_rows, callback, context);
+}
+
+
+//// GCIFDecoder API
+
+extern "C" GCIFDecoder *gcif_decoder_create() {
+	return new (std::nothrow) GCIFDecoder;
+}
+
+extern "C" void gcif_decoder_destroy(GCIFDecoder *decoder) {
+	if (decoder) {
+		delete decoder;
+	}
+}
+
+extern "C" int gcif_decoder_get_info(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFInfo *info) {
+	return gcif_get_info_any(decoder, file_data_in, file_size_bytes_in, info);
+}
+
+#ifdef CAT_COMPILE_MMAP
+
+extern "C" int gcif_decoder_read_file(GCIFDecoder *decoder, const char *input_file_path_in, GCIFImage *image_out) {
+	int err;
+
+	// Initialize image data
+	image_out->rgba = 0;
+	image_out->xsize = -1;
+	image_out->ysize = -1;
+
+	// Map the file
+	const u8 *data;
+	long bytes;
+	if ((err = gcif_map_file(decoder, input_file_path_in, data, bytes))) {
+		return err;
+	}
+
+	decoder->own_output = true;
+
+	return gcif_read_any(decoder, data, bytes, image_out);
+}
+
+#endif // CAT_COMPILE_MMAP
+
+extern "C" int gcif_decoder_read_memory(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out) {
+	// Initialize image data
+	image_out->rgba = 0;
+	image_out->xsize = -1;
+	image_out->ysize = -1;
+
+	decoder->own_output = true;
+
+	return gcif_read_any(decoder, file_data_in, file_size_bytes_in, image_out);
+}
+
+extern "C" int gcif_decoder_read_memory_to_buffer(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out) {
+	decoder->own_output = false;
+
+	return gcif_read_any(decoder, file_data_in, file_size_bytes_in, image_out);
+}
+
+extern "C" int gcif_decoder_read_memory_to_surface(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, const GCIFSurface *surface) {
+	GCIFTarget target;
+	target.surface = surface;
+
+	return gcif_read_any(decoder, file_data_in, file_size_bytes_in, target);
+}
+
+extern "C" int gcif_decoder_read_region(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, int x, int y, int w, int h, unsigned char *rgba_out) {
+	GCIFRegion region;
+	region.rgba = rgba_out;
+	region.x = x;
+	region.y = y;
+	region.w = w;
+	region.h = h;
+
+	GCIFTarget target;
+	target.region = &region;
+
+	return gcif_read_any(decoder, file_data_in, file_size_bytes_in, target);
+}
+
+extern "C" int gcif_decoder_read_stream(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, int band_rows, GCIFRowCallback callback, void *context) {
+	GCIFStream stream;
+	stream.band_rows = band_rows > 0 ? band_rows : 1;
+	stream.callback = callback;
+	stream.context = context;
+
+	GCIFTarget target;
+	target.stream = &stream;
+
+	return gcif_read_any(decoder, file_data_in, file_size_bytes_in, target);
+}
+
+extern "C" void gcif_decoder_set_format(GCIFDecoder *decoder, int format) {
+	decoder->output.setFormat(format);
+}
+
+extern "C" void gcif_decoder_set_stats(GCIFDecoder *decoder, GCIFDecodeStats *stats) {
+	decoder->stats = stats;
+}
+
+extern "C" int gcif_format_bytes(int format) {
+	return ImageOutput::getFormatBytes(format);
+}
+
+extern "C" void gcif_decoder_set_pool(GCIFDecoder *decoder, GCIFRunJobs run_jobs, void *pool) {
+	decoder->run_jobs = run_jobs;
+	decoder->run_jobs_pool = run_jobs ? pool : 0;
+}
+
+#ifdef CAT_COMPILE_THREADS
+
+extern "C" int gcif_decoder_set_threads(GCIFDecoder *decoder, int thread_count) {
+	// Switch away from any caller-supplied pool
+	gcif_decoder_set_pool(decoder, 0, 0);
+
+	if (thread_count > GCIF_MAX_THREADS) {
+		thread_count = GCIF_MAX_THREADS;
+	}
+
+	if (thread_count <= 1) {
+		if (decoder->pool) {
+			delete decoder->pool;
+			decoder->pool = 0;
+		}
+
+		return GCIF_RE_OK;
+	}
+
+	if (!decoder->pool) {
+		decoder->pool = new (std::nothrow) ThreadPool;
+
+		if (!decoder->pool) {
+			return GCIF_RE_FILE;
+		}
+	}
+
+	if (!decoder->pool->init(thread_count)) {
+		delete decoder->pool;
+		decoder->pool = 0;
+		return GCIF_RE_FILE;
+	}
+
+	return GCIF_RE_OK;
+}
+
+#endif // CAT_COMPILE_THREADS
+
+
+//// Batches
+
+struct BatchJob {
+	GCIFDecoder *decoder;
+	GCIFBatchItem *items;
+	const u64 *order;
+	int format;
+};
+
+static int gcif_read_batch_item(GCIFDecoder *decoder, GCIFBatchItem *item) {
+	int err;
+
+	GCIFImage *image = &item->image;
+	const bool allocate = !image->rgba;
+
+	// If the image is allocated here,
+	if (allocate) {
+		image->xsize = -1;
+		image->ysize = -1;
+	}
+
+	decoder->own_output = false;
+
+	const void *data = item->file_data;
+	long bytes = item->file_size_bytes;
+
+#ifdef CAT_COMPILE_MMAP
+	// If reading from a file,
+	if (!data && item->file_path) {
+		const u8 *file_data;
+		if ((err = gcif_map_file(decoder, item->file_path, file_data, bytes))) {
+			return err;
+		}
+
+		data = file_data;
+	}
+#endif // CAT_COMPILE_MMAP
+
+	if (!data) {
+		return GCIF_RE_FILE;
+	}
+
+	if ((err = gcif_read_any(decoder, data, bytes, image))) {
+		if (allocate && image->rgba) {
+			free(image->rgba);
+			image->rgba = 0;
+		}
+		return err;
+	}
+
+	return GCIF_RE_OK;
+}
+
+static void gcif_read_batch_job(void *job_data, int job_index, int thread_index) {
+	BatchJob *job = reinterpret_cast<BatchJob *>( job_data );
+
+	GCIFBatchItem *item = &job->items[(u32)job->order[job_index]];
+
+	GCIFDecoder *decoder = gcif_get_worker(job->decoder, thread_index, job->format);
+	if (!decoder) {
+		item->err = GCIF_RE_FILE;
+		return;
+	}
+
+	item->err = gcif_read_batch_item(decoder, item);
+}
+
+extern "C" int gcif_decoder_read_batch(GCIFDecoder *decoder, GCIFBatchItem *items, int item_count) {
+	if (item_count <= 0) {
+		return GCIF_RE_OK;
+	}
+
+	// Sort items by decreasing pixel count, keeping them in order otherwise.
+	// Files are not opened yet, so they are put first
+	decoder->batch_order.resize(item_count);
+	u64 *order = decoder->batch_order.get();
+
+	for (int ii = 0; ii < item_count; ++ii) {
+		const GCIFBatchItem *item = &items[ii];
+		u32 pixels = 0;
+
+		if (item->file_data) {
+			int xsize, ysize;
+			if (!gcif_get_size(item->file_data, item->file_size_bytes, &xsize, &ysize)) {
+				pixels = (u32)xsize * (u32)ysize;
+			}
+		} else {
+			pixels = 0xffffffff;
+		}
+
+		order[ii] = ((u64)(0xffffffff - pixels) << 32) | (u32)ii;
+	}
+
+	std::sort(order, order + item_count);
+
+	BatchJob job;
+	job.decoder = decoder;
+	job.items = items;
+	job.order = order;
+	job.format = decoder->output.getFormat();
+
+	// Run image jobs
+	if (decoder->run_jobs) {
+		decoder->run_jobs(decoder->run_jobs_pool, item_count, gcif_read_batch_job, &job);
+#ifdef CAT_COMPILE_THREADS
+	} else if (decoder->pool) {
+		decoder->pool->run(item_count, gcif_read_batch_job, &job);
+#endif // CAT_COMPILE_THREADS
+	} else {
+		for (int ii = 0; ii < item_count; ++ii) {
+			gcif_read_batch_job(&job, ii, 0);
+		}
+	}
+
+	// Report the first error
+	for (int ii = 0; ii < item_count; ++ii) {
+		int err;
+		if ((err = items[ii].err)) {
+			return err;
+		}
+	}
+
+	return GCIF_RE_OK;
+}
+
+extern "C" int gcif_read_batch(GCIFBatchItem *items, int item_count, int thread_count) {
+	GCIFDecoder decoder;
+
+#ifdef CAT_COMPILE_THREADS
+	// Falls back to the calling thread on failure
+	gcif_decoder_set_threads(&decoder, thread_count);
+#else
+	(void)thread_count;
+#endif // CAT_COMPILE_THREADS
+
+	return gcif_decoder_read_batch(&decoder, items, item_count);
+}
+
+
+//// Incremental decoding
+
+#ifdef CAT_COMPILE_THREADS
+
+PushFeed::PushFeed() {
+	_decoder = 0;
+	_running = false;
+	_retired_busy = false;
+	_end = false;
+	_quit = false;
+	_finished = false;
+	_result = GCIF_RE_OK;
+	_rows = 0;
+
+#if defined(CAT_OS_WINDOWS)
+	InitializeCriticalSection(&_lock);
+	_more = CreateEvent(0, FALSE, FALSE, 0);
+#else
+	pthread_mutex_init(&_lock, 0);
+	pthread_cond_init(&_more, 0);
+#endif
+}
+
+PushFeed::~PushFeed() {
+	stop();
+
+#if defined(CAT_OS_WINDOWS)
+	CloseHandle(_more);
+	DeleteCriticalSection(&_lock);
+#else
+	pthread_cond_destroy(&_more);
+	pthread_mutex_destroy(&_lock);
+#endif
+}
+
+bool PushFeed::start(GCIFDecoder *decoder) {
+	stop();
+
+	_decoder = decoder;
+	_retired_busy = false;
+	_end = false;
+	_quit = false;
+	_finished = false;
+	_result = GCIF_RE_OK;
+	_rows = 0;
+
+#if defined(CAT_OS_WINDOWS)
+	_thread = (HANDLE)_beginthreadex(0, 0, &PushFeed::ThreadWrapper, this, 0, 0);
+	if (!_thread) {
+		return false;
+	}
+#else
+	if (pthread_create(&_thread, 0, &PushFeed::ThreadWrapper, this)) {
+		return false;
+	}
+#endif
+
+	_running = true;
+	return true;
+}
+
+#if defined(CAT_OS_WINDOWS)
+
+unsigned int __stdcall PushFeed::ThreadWrapper(void *param) {
+	PushFeed *feed = reinterpret_cast<PushFeed *>( param );
+
+	feed->threadMain();
+
+	_endthreadex(0);
+	return 0;
+}
+
+#else
+
+void *PushFeed::ThreadWrapper(void *param) {
+	PushFeed *feed = reinterpret_cast<PushFeed *>( param );
+
+	feed->threadMain();
+
+	return 0;
+}
+
+#endif
+
+void PushFeed::threadMain() {
+	GCIFDecoder *decoder = _decoder;
+
+	int err;
+	if (!(err = decoder->reader.init(this))) {
+		err = gcif_read(decoder);
+	}
+
+	lock();
+	_rows = decoder->output.getRowsDone();
+	_result = err;
+	_finished = true;
+	unlock();
+}
+
+const u32 *PushFeed::wait(u32 word_count, u32 &ready, bool &done) {
+	GCIFDecoder *decoder = _decoder;
+
+	lock();
+
+	// The thread is done with the data it was given last time
+	_retired_busy = false;
+	_rows = decoder->output.getRowsDone();
+
+	// Wait for enough data, or for the end
+	while (!_end && !_quit && (u32)decoder->push_bytes / sizeof(u32) < word_count) {
+#if defined(CAT_OS_WINDOWS)
+		unlock();
+		WaitForSingleObject(_more, INFINITE);
+		lock();
+#else
+		pthread_cond_wait(&_more, &_lock);
+#endif
+	}
+
+	// If stopping early, run out of data right away
+	const u32 *words = 0;
+	ready = 0;
+	done = true;
+
+	if (!_quit) {
+		words = reinterpret_cast<const u32 *>( decoder->push_data.get() );
+		ready = (u32)decoder->push_bytes / sizeof(u32);
+		done = _end;
+	}
+
+	unlock();
+
+	return words;
+}
+
+int PushFeed::push(const void *data, int bytes, bool end) {
+	GCIFDecoder *decoder = _decoder;
+	SmartArray<u8> &push_data = decoder->push_data;
+
+	lock();
+
+	const int offset = decoder->push_bytes;
+	const int total = offset + bytes;
+
+	// If the buffer the thread may be loading from would have to move,
+	if (total > push_data.capacity() && !_retired_busy) {
+		// Keep it until the thread waits again, and copy the data to a new one
+		_retired.swap(push_data);
+
+		int alloc_size = _retired.capacity() * 2;
+		if (alloc_size < total) {
+			alloc_size = total;
+		}
+
+		push_data.resize(alloc_size);
+		memcpy(push_data.get(), _retired.get(), offset);
+
+		_retired_busy = true;
+	}
+
+	// Append data
+	push_data.resizeKeep(total);
+	if (bytes > 0) {
+		memcpy(push_data.get() + offset, data, bytes);
+	}
+	decoder->push_bytes = total;
+
+	_end = end;
+	signal();
+
+	decoder->push_rows = _rows;
+	const bool finished = _finished;
+
+	unlock();
+
+	// If the thread is still reading,
+	if (!end && !finished) {
+		return GCIF_RE_OK;
+	}
+
+	join();
+
+	if (_result) {
+		return _result;
+	}
+
+	decoder->push_rows = decoder->push_image.ysize;
+	decoder->push_state = PUSH_DONE;
+
+	return GCIF_RE_OK;
+}
+
+void PushFeed::join() {
+	if (!_running) {
+		return;
+	}
+
+#if defined(CAT_OS_WINDOWS)
+	WaitForSingleObject(_thread, INFINITE);
+	CloseHandle(_thread);
+#else
+	pthread_join(_thread, 0);
+#endif
+
+	_running = false;
+}
+
+void PushFeed::stop() {
+	if (!_running) {
+		return;
+	}
+
+	lock();
+	_quit = true;
+	signal();
+	unlock();
+
+	join();
+}
+
+// Start reading an image without stripes in the background
+static int gcif_push_start_thread(GCIFDecoder *decoder) {
+	int err;
+
+	const u32 *words = reinterpret_cast<const u32 *>( decoder->push_data.get() );
+
+	if (getLE(words[0]) != ImageReader::HEAD_MAGIC) {
+		return GCIF_RE_BAD_HEAD;
+	}
+
+	// Same size bits as the stripe head
+	const u32 word1 = getLE(words[1]);
+	const int xsize = (word1 >> (32 - ImageReader::MAX_X_BITS)) & ImageReader::MAX_X;
+	const int ysize = (word1 >> (32 - ImageReader::MAX_X_BITS - ImageReader::MAX_Y_BITS)) & ImageReader::MAX_Y;
+
+	if ((err = gcif_setup_output(decoder, &decoder->push_image, xsize, ysize))) {
+		return err;
+	}
+
+	decoder->output.init(decoder->push_image.rgba, xsize, ysize, xsize * decoder->output.getPixelBytes());
+
+	// If the thread cannot be started, it will be read at the end instead
+	if (decoder->push_feed.start(decoder)) {
+		decoder->push_state = PUSH_THREAD;
+	}
+
+	return GCIF_RE_OK;
+}
+
+#endif // CAT_COMPILE_THREADS
+
+// Decode whatever the data received so far allows
+static int gcif_push_decode(GCIFDecoder *decoder, bool end) {
+	int err;
+
+	const u32 *words = reinterpret_cast<const u32 *>( decoder->push_data.get() );
+	const int bytes = decoder->push_bytes;
+	const int word_count = bytes / (int)sizeof(u32);
+
+	// If the image does not have stripes and is not being read in the
+	// background, it can only be read once it is all here
+	if (decoder->push_state == PUSH_WHOLE) {
+		if (end) {
+			GCIFTarget target;
+			target.image = &decoder->push_image;
+
+			if ((err = gcif_read_any(decoder, words, bytes, target))) {
+				return err;
+			}
+
+			decoder->push_rows = decoder->push_image.ysize;
+			decoder->push_state = PUSH_DONE;
+		}
+
+		return GCIF_RE_OK;
+	}
+
+	// Wait for the stripe header, or enough to know there are no stripes
+	if (word_count < ImageReader::STRIPE_HEAD_WORDS) {
+		return end ? GCIF_RE_BAD_HEAD : GCIF_RE_OK;
+	}
+
+	if (decoder->push_state == PUSH_HEAD && !gcif_is_striped(words, bytes)) {
+		decoder->push_state = PUSH_WHOLE;
+
+#ifdef CAT_COMPILE_THREADS
+		// If more data is coming, start reading it in the background
+		if (!end) {
+			return gcif_push_start_thread(decoder);
+		}
+#endif // CAT_COMPILE_THREADS
+
+		return gcif_push_decode(decoder, end);
+	}
+
+	// Until the end, the last stripe may go on past the data received
+	const u32 word_limit = end ? (u32)word_count : 0xffffffff;
+
+	// Read the head, leaving the offset table to arrive below
+	StripeHead head;
+	if ((err = gcif_read_stripe_head(words, ImageReader::STRIPE_HEAD_WORDS + ImageReader::MAX_STRIPES, head))) {
+		return err;
+	}
+
+	// Wait for the offset table
+	if (word_count < head.head_words) {
+		return end ? GCIF_RE_BAD_STRIPES : GCIF_RE_OK;
+	}
+
+	const u32 *offsets = words + ImageReader::STRIPE_HEAD_WORDS;
+	if ((err = gcif_check_stripe_offsets(offsets, head, word_limit))) {
+		return err;
+	}
+
+	if (decoder->push_state == PUSH_HEAD) {
+		if ((err = gcif_setup_output(decoder, &decoder->push_image, head.xsize, head.ysize))) {
+			return err;
+		}
+
+		decoder->push_state = PUSH_STRIPES;
+	}
+
+	StripeJob job;
+	job.decoder = decoder;
+	job.words = words;
+	job.offsets = offsets;
+	job.word_count = word_count;
+	job.stripe_rows = head.stripe_rows;
+	job.stripe_count = head.stripe_count;
+	job.rgba = decoder->push_image.rgba;
+	job.stride = head.xsize * decoder->output.getPixelBytes();
+	job.xsize = head.xsize;
+	job.ysize = head.ysize;
+	job.format = decoder->output.getFormat();
+	job.region = 0;
+	job.stream = 0;
+
+	// Decode each stripe that has arrived, in order
+	while (decoder->push_stripe < head.stripe_count) {
+		const int stripe = decoder->push_stripe;
+
+		// If the stripe is not all here yet,
+		if (stripe + 1 < head.stripe_count ? getLE(offsets[stripe + 1]) > (u32)word_count : !end) {
+			break;
+		}
+
+		gcif_read_stripe(&job, stripe, 0);
+
+		if ((err = job.errors[stripe])) {
+			return err;
+		}
+
+		const int rows = (stripe + 1) * head.stripe_rows;
+
+		decoder->push_stripe = stripe + 1;
+		decoder->push_rows = rows < head.ysize ? rows : head.ysize;
+	}
+
+	if (decoder->push_stripe >= head.stripe_count) {
+		decoder->push_state = PUSH_DONE;
+	}
+
+	return GCIF_RE_OK;
+}
+
+static int gcif_push(GCIFDecoder *decoder, const void *data, long bytes, bool end, GCIFImage *image_out, int *rows_done) {
+	// If still decoding,
+	if (!decoder->push_err && decoder->push_state != PUSH_DONE) {
+		if (bytes > 0x7fffffff - decoder->push_bytes) {
+			decoder->push_err = GCIF_RE_FILE;
+		} else {
+			decoder->own_output = true;
+
+#ifdef CAT_COMPILE_THREADS
+			// If the image is being read in the background, hand the data over
+			if (decoder->push_state == PUSH_THREAD) {
+				decoder->push_err = decoder->push_feed.push(data, (int)bytes, end);
+			} else
+#endif // CAT_COMPILE_THREADS
+			{
+				// Append data
+				const int offset = decoder->push_bytes;
+
+				decoder->push_bytes += (int)bytes;
+				decoder->push_data.resizeKeep(decoder->push_bytes);
+
+				if (bytes > 0) {
+					memcpy(decoder->push_data.get() + offset, data, bytes);
+				}
+
+				decoder->push_err = gcif_push_decode(decoder, end);
+			}
+		}
+	}
+
+	*image_out = decoder->push_image;
+	if (rows_done) {
+		*rows_done = decoder->push_rows;
+	}
+
+	return decoder->push_err;
+}
+
+extern "C" void gcif_decoder_push_start(GCIFDecoder *decoder) {
+#ifdef CAT_COMPILE_THREADS
+	// Drop any image still being read
+	decoder->push_feed.stop();
+#endif // CAT_COMPILE_THREADS
+
+	decoder->push_bytes = 0;
+	decoder->push_state = PUSH_HEAD;
+	decoder->push_err = GCIF_RE_OK;
+	decoder->push_stripe = 0;
+	decoder->push_rows = 0;
+	decoder->push_image.rgba = 0;
+	decoder->push_image.xsize = -1;
+	decoder->push_image.ysize = -1;
+}
+
+extern "C" int gcif_decoder_push(GCIFDecoder *decoder, const void *data, long bytes, GCIFImage *image_out, int *rows_done) {
+	return gcif_push(decoder, data, bytes, false, image_out, rows_done);
+}
+
+extern "C" int gcif_decoder_push_end(GCIFDecoder *decoder, GCIFImage *image_out) {
+	return gcif_push(decoder, 0, 0, true, image_out, 0);
+}
+
+extern "C" const char *gcif_read_errstr(int err) {
+	switch (err) {
+		case GCIF_RE_OK:			// No problemo
+			return "OK";
 
 		case GCIF_RE_FILE:		// File access error
 			return "File access error:GCIF_RE_FILE";
@@ -260,6 +1839,9 @@ extern "C" const char *gcif_read_errstr(int err) {
 		case GCIF_RE_BAD_RGBA:		// Bad data in RGBA section
 			return "Corrupted:GCIF_RE_BAD_RGBA";
 
+		case GCIF_RE_BAD_STRIPES:	// Bad stripe offset table
+			return "Corrupted:GCIF_RE_BAD_STRIPES";
+
 		default:
 			break;
 	}
@@ -55,12 +55,30 @@ enum GCIFReaderErrors {
 	GCIF_RE_BAD_MONO,	// Bad data in Monochrome section
 
 	GCIF_RE_BAD_RGBA,	// Bad data in RGBA section
+
+	GCIF_RE_BAD_STRIPES,	// Bad stripe offset table
 };
 
 // Returns a string representation of the above error codes
 const char *gcif_read_errstr(int err);
 
 
+// Output pixel formats, see gcif_decoder_set_format()
+enum GCIFFormats {
+	GCIF_FORMAT_RGBA,			// Bytes in R, G, B, A order (default)
+	GCIF_FORMAT_BGRA,			// Bytes in B, G, R, A order
+	GCIF_FORMAT_RGBA_PREMUL,	// RGBA with color premultiplied by alpha
+	GCIF_FORMAT_BGRA_PREMUL,	// BGRA with color premultiplied by alpha
+	GCIF_FORMAT_RGBA4444,		// 16-bit words with R in the high bits
+	GCIF_FORMAT_RGB565,			// 16-bit words with R in the high bits, no alpha
+
+	GCIF_FORMAT_COUNT
+};
+
+// Returns bytes per pixel for a format above, or 0 if it is unknown
+int gcif_format_bytes(int format);
+
+
 // Return data
 typedef struct _GCIFImage {
 	unsigned char *rgba;	// RGBA pixels.  Free with free(i.rgba); when done.
@@ -104,6 +122,58 @@ int gcif_read_file(const char *input_file_path_in, GCIFImage *image_out);
  */
 int gcif_read_memory(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out);
 
+// Sections of a file, for GCIFDecodeStats
+enum GCIFSections {
+	GCIF_SECTION_HEAD,		// File header and small palette colors
+	GCIF_SECTION_MASK,		// Dominant color mask
+	GCIF_SECTION_TABLES,	// Palette, filter, chaos and LZ tables
+	GCIF_SECTION_PIXELS,	// Pixel data
+
+	GCIF_SECTION_COUNT
+};
+
+// Breakdown of where a decode spent its time and bits
+typedef struct _GCIFDecodeStats {
+	double usec[GCIF_SECTION_COUNT];	// Microseconds spent in each section
+	long bits[GCIF_SECTION_COUNT];		// Bits read in each section
+	double total_usec;					// Sum of the sections
+
+	/*
+	 * Pixels by how they were decoded.  For small palette images these count
+	 * the packed bytes, which each hold 2 to 8 pixels.  Otherwise they add up
+	 * to the pixels in the rows decoded.
+	 */
+	long masked_pixels;		// Filled in by the dominant color mask, or the only color
+	long lz_pixels;			// Copied by LZ matches
+	long literal_pixels;	// Decoded one at a time
+
+	int huffman_tables;		// Huffman tables read
+	int shared_tables;		// Of those, copied from an identical earlier table
+	int chaos_levels;		// RGBA chaos levels, or 0
+	int colors;				// Palette size, or 0 for RGBA
+	int mode;				// GCIF_MODE_*, see gcif_get_info()
+	int stripes;			// Stripes decoded, or 1 for images without stripes
+
+	/*
+	 * Most bytes of working memory held at once for decoded rows, which is 0
+	 * when the whole image is decoded in place.  This is the window of rows
+	 * that later rows can still read from, and does not depend on the image
+	 * height.
+	 */
+	long work_bytes;
+} GCIFDecodeStats;
+
+/*
+ * gcif_read_memory_ex()
+ *
+ * Same as gcif_read_memory(), and if stats is not 0 it is filled in with a
+ * breakdown of the decode.  Striped images add up the times and counts of
+ * each stripe, and the mode, colors and chaos levels are from the last one.
+ * The stats do not need a special build, and cost next to nothing when stats
+ * is 0, so they can be collected for a sample of images in production.
+ */
+int gcif_read_memory_ex(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out, GCIFDecodeStats *stats);
+
 /*
  * gcif_read_memory_to_buffer()
  *
@@ -119,6 +189,343 @@ int gcif_read_memory(const void *file_data_in, long file_size_bytes_in, GCIFImag
  */
 int gcif_read_memory_to_buffer(const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out);
 
+// Output buffer with rows further apart than the image width
+typedef struct _GCIFSurface {
+	unsigned char *pixels;	// First row of the surface
+	int stride;				// Bytes from one row of the surface to the next
+	int xsize, ysize;		// Surface size in pixels
+	int x, y;				// Where the top-left pixel of the image goes
+} GCIFSurface;
+
+/*
+ * gcif_read_memory_to_surface()
+ *
+ * Read the image from the given memory buffer into part of a larger surface,
+ * such as mapped GPU staging memory or a texture atlas.  Row y of the image is
+ * written starting at pixels + (surface.y + y) * stride + surface.x * 4.
+ * Nothing outside the image rectangle is touched.  When the rows cannot be
+ * decoded in place, each one is copied out of a small window of working rows,
+ * so the extra memory does not grow with the image height.
+ *
+ * If the image does not fit inside the surface at (x, y), or the stride is
+ * too small for the surface width, the function fails with GCIF_RE_BAD_DIMS.
+ * The image size can be found up front with gcif_get_size().
+ *
+ * On success it returns GCIF_RE_OK.  Otherwise it returns a failure code from
+ * the table above.
+ */
+int gcif_read_memory_to_surface(const void *file_data_in, long file_size_bytes_in, const GCIFSurface *surface);
+
+/*
+ * gcif_read_region()
+ *
+ * Read just the rectangle of w by h pixels at (x, y) from the given memory
+ * buffer into rgba_out, which must hold w * h * 4 bytes.
+ *
+ * Decoding stops after the last row of the rectangle, so the rows below it
+ * cost nothing.  The rows above it still have to be decoded.
+ *
+ * If the rectangle does not fit inside the image, the function fails with
+ * GCIF_RE_BAD_DIMS.
+ *
+ * On success it returns GCIF_RE_OK.  Otherwise it returns a failure code from
+ * the table above.
+ */
+int gcif_read_region(const void *file_data_in, long file_size_bytes_in, int x, int y, int w, int h, unsigned char *rgba_out);
+
+/*
+ * Streaming callback
+ *
+ * Receives rows [y, y + rows) of the image as tightly packed RGBA pixels,
+ * xsize * rows * 4 bytes, or in the format chosen with
+ * gcif_decoder_set_format().  The rows are final.  The pointer is only valid
+ * until the callback returns.
+ */
+typedef void (*GCIFRowCallback)(void *context, const unsigned char *rgba, int y, int rows, int xsize);
+
+/*
+ * gcif_read_stream()
+ *
+ * Read the image from the given memory buffer, passing it to the callback in
+ * bands of band_rows rows from top to bottom as soon as each band is decoded.
+ * The last band may be shorter.  No output buffer for the whole image is
+ * needed, so this is a good fit for uploading a texture while decoding.
+ *
+ * Images with a palette only hold one band of pixels at a time.  Other images
+ * also keep a window of the last rows decoded, as far back as later rows can
+ * read from, which is set by the longest LZ distance the file can encode.
+ *
+ * Striped images are decoded one stripe at a time on the calling thread so
+ * that the bands arrive in order.
+ *
+ * On success it returns GCIF_RE_OK.  Otherwise it returns a failure code from
+ * the table above, and the callback may already have been called for some of
+ * the rows.
+ */
+int gcif_read_stream(const void *file_data_in, long file_size_bytes_in, int band_rows, GCIFRowCallback callback, void *context);
+
+
+// Reusable decoder context
+typedef struct _GCIFDecoder GCIFDecoder;
+
+/*
+ * gcif_decoder_create()
+ *
+ * Create a decoder context that can be used to read many images in a row.
+ *
+ * The functions above set up and tear down all of the decoder state for each
+ * image, which means a number of heap allocations per call.  A decoder context
+ * keeps all of its internal buffers between calls and only grows them when a
+ * larger or more complex image comes along, so decoding a steady stream of
+ * images performs no heap allocations after the first few.
+ *
+ * A context may only be used by one thread at a time.  To decode from several
+ * threads at once, create one context per thread.
+ *
+ * Returns 0 if out of memory.
+ */
+GCIFDecoder *gcif_decoder_create();
+
+/*
+ * gcif_decoder_destroy()
+ *
+ * Free a decoder context and any images it owns.  Null is ignored.
+ */
+void gcif_decoder_destroy(GCIFDecoder *decoder);
+
+#ifdef CAT_COMPILE_MMAP
+
+/*
+ * gcif_decoder_read_file()
+ *
+ * Same as gcif_decoder_read_memory() but reads from the given file path.
+ */
+int gcif_decoder_read_file(GCIFDecoder *decoder, const char *input_file_path_in, GCIFImage *image_out);
+
+#endif // CAT_COMPILE_MMAP
+
+/*
+ * gcif_decoder_read_memory()
+ *
+ * Read the image from the given memory buffer using the decoder context.
+ *
+ * The rgba pointer is owned by the decoder context and stays valid until the
+ * next decode on the same context or until it is destroyed.  Do not free it.
+ *
+ * On success it returns GCIF_RE_OK.  Otherwise it returns a failure code from
+ * the table above.
+ */
+int gcif_decoder_read_memory(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out);
+
+/*
+ * gcif_decoder_read_memory_to_buffer()
+ *
+ * Same as gcif_read_memory_to_buffer() but using the decoder context.
+ *
+ * If xsize, ysize do not match actual image dimensions, the function fails.
+ */
+int gcif_decoder_read_memory_to_buffer(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFImage *image_out);
+
+/*
+ * gcif_decoder_read_memory_to_surface()
+ *
+ * Same as gcif_read_memory_to_surface() but using the decoder context.  With
+ * gcif_decoder_set_format() the pixel size is gcif_format_bytes(format) in
+ * place of 4 above.
+ */
+int gcif_decoder_read_memory_to_surface(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, const GCIFSurface *surface);
+
+/*
+ * gcif_decoder_set_format()
+ *
+ * Choose the pixel format for images read with this decoder context from now
+ * on.  Everything the decoder context outputs is then in this format instead
+ * of RGBA, including regions and streamed bands, and buffers hold
+ * gcif_format_bytes(format) bytes per pixel.
+ *
+ * The conversion happens while each row is being decoded, so it is much
+ * cheaper than converting the image afterwards.  Images with a palette convert
+ * just the palette for 32-bit formats.
+ *
+ * Unknown formats are treated as GCIF_FORMAT_RGBA.
+ */
+void gcif_decoder_set_format(GCIFDecoder *decoder, int format);
+
+/*
+ * gcif_decoder_set_stats()
+ *
+ * Add a breakdown of every image read with this decoder context from now on
+ * to stats, as for gcif_read_memory_ex(), until it is called again with 0.
+ * Clear stats with memset() to start over.  Stripes decoded on other threads
+ * are not counted.
+ */
+void gcif_decoder_set_stats(GCIFDecoder *decoder, GCIFDecodeStats *stats);
+
+/*
+ * gcif_decoder_read_region()
+ *
+ * Same as gcif_read_region() but using the decoder context.
+ */
+int gcif_decoder_read_region(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, int x, int y, int w, int h, unsigned char *rgba_out);
+
+/*
+ * gcif_decoder_read_stream()
+ *
+ * Same as gcif_read_stream() but using the decoder context.
+ */
+int gcif_decoder_read_stream(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, int band_rows, GCIFRowCallback callback, void *context);
+
+
+/*
+ * Incremental decoding
+ *
+ * Decode an image while its file data is still arriving, for example from a
+ * download.  Start with gcif_decoder_push_start(), pass each chunk of data to
+ * gcif_decoder_push() as it comes in, and call gcif_decoder_push_end() once
+ * the whole file has been passed in.
+ *
+ * Images written with stripes (see GCIFKnobs::stripe_rows) are decoded one
+ * stripe at a time as soon as all of the data for each stripe has arrived, so
+ * most of the decoding overlaps the transfer.  Other images are read on a
+ * thread of their own as the data arrives, which waits whenever it gets to
+ * the end of the data passed in so far.  Without CAT_COMPILE_THREADS they are
+ * decoded by gcif_decoder_push_end() instead.  Either way the context should
+ * not be used for anything else until then.
+ *
+ * The GCIFImage output is filled in as soon as the image size is known, and
+ * the rgba pointer is owned by the decoder context as for
+ * gcif_decoder_read_memory().  rows_done is set to the number of rows at the
+ * top of the image that are finished, and may be 0 if not needed.
+ *
+ * On success it returns GCIF_RE_OK, which does not mean the image is finished
+ * until gcif_decoder_push_end() is called.  Otherwise it returns a failure code
+ * from the table above, and will keep returning it until the next start.
+ */
+void gcif_decoder_push_start(GCIFDecoder *decoder);
+int gcif_decoder_push(GCIFDecoder *decoder, const void *data, long bytes, GCIFImage *image_out, int *rows_done);
+int gcif_decoder_push_end(GCIFDecoder *decoder, GCIFImage *image_out);
+
+
+/*
+ * Multi-threaded decoding
+ *
+ * Images written with stripes (see GCIFKnobs::stripe_rows) are made of
+ * independent horizontal stripes that can be decoded at the same time.  By
+ * default a decoder context decodes them one after the other.
+ *
+ * Large full-color images without stripes use the threads differently: one
+ * reads the pixel data while the others reverse the filters a few rows behind.
+ * The file format is the same either way.  Streamed images are always decoded on
+ * the calling thread, unless they have stripes.
+ *
+ * Up to GCIF_MAX_THREADS threads may be used, including the calling thread.
+ */
+enum {
+	GCIF_MAX_THREADS = 64
+};
+
+/*
+ * Job callback passed to a caller-supplied thread pool.
+ *
+ * job_index is in [0, job_count).  thread_index identifies the thread running
+ * the job, 0 for the thread that called run_jobs() and 1..GCIF_MAX_THREADS-1
+ * for the others.  No two jobs may run at the same time with the same
+ * thread_index.
+ */
+typedef void (*GCIFJobFunction)(void *job_data, int job_index, int thread_index);
+
+/*
+ * Caller-supplied thread pool entrypoint.
+ *
+ * Must call job(job_data, ii, thread_index) once for each ii in [0, job_count)
+ * and only return once they have all completed.
+ */
+typedef void (*GCIFRunJobs)(void *pool, int job_count, GCIFJobFunction job, void *job_data);
+
+/*
+ * gcif_decoder_set_pool()
+ *
+ * Decode stripes using a thread pool you already have.  The pool pointer is
+ * passed back to run_jobs().  Pass run_jobs = 0 to go back to decoding on the
+ * calling thread.
+ */
+void gcif_decoder_set_pool(GCIFDecoder *decoder, GCIFRunJobs run_jobs, void *pool);
+
+// Compiled optionally
+#ifdef CAT_COMPILE_THREADS
+
+/*
+ * gcif_decoder_set_threads()
+ *
+ * Decode stripes using threads owned by the decoder context.  thread_count
+ * includes the calling thread, so 1 turns this off.  The threads are started
+ * here and then sleep between images.
+ *
+ * Returns GCIF_RE_OK on success, or GCIF_RE_FILE if threads could not be
+ * started, in which case the context falls back to a single thread.
+ */
+int gcif_decoder_set_threads(GCIFDecoder *decoder, int thread_count);
+
+#endif // CAT_COMPILE_THREADS
+
+
+/*
+ * Batch decoding
+ *
+ * Decode many images at once, spreading whole images across the threads set
+ * up with gcif_decoder_set_threads() or gcif_decoder_set_pool().  Each thread
+ * keeps its own decoder state between images and batches, so once warmed up
+ * no allocations are made per image when the caller provides the buffers.
+ *
+ * Images are started largest first, by the dimensions in their headers, and
+ * threads that run out of work take it from the others.  This keeps one big
+ * image from being left to run by itself at the end of the batch.
+ */
+
+// One image in a batch
+typedef struct _GCIFBatchItem {
+	// Input: file data, or if file_data is 0 the file at file_path
+	const void *file_data;
+	long file_size_bytes;
+	const char *file_path;	// Only supported with CAT_COMPILE_MMAP
+
+	/*
+	 * Output: If image.rgba is 0 it is allocated and you are responsible for
+	 * freeing it with free(image.rgba).  Otherwise it must hold image.xsize by
+	 * image.ysize pixels as for gcif_read_memory_to_buffer(), and the decode
+	 * fails if they do not match the image.
+	 */
+	GCIFImage image;
+
+	int err;				// GCIF_RE_OK or a failure code for this image
+} GCIFBatchItem;
+
+/*
+ * gcif_decoder_read_batch()
+ *
+ * Read the item_count images in items using the decoder context.  Images are
+ * output in the format chosen with gcif_decoder_set_format().  Striped images
+ * are decoded one stripe at a time on the thread that picks them up.
+ *
+ * Files are only opened once a thread picks them up, so their dimensions are
+ * not known up front and they are all started before the in-memory images.
+ *
+ * Returns GCIF_RE_OK if every image was read.  Otherwise it returns the failure
+ * code of the first item that failed, and the err field of each item tells
+ * which ones did.  Allocated images are freed when they fail.
+ */
+int gcif_decoder_read_batch(GCIFDecoder *decoder, GCIFBatchItem *items, int item_count);
+
+/*
+ * gcif_read_batch()
+ *
+ * Same as gcif_decoder_read_batch() but with a temporary decoder context
+ * running thread_count threads, including the calling thread.  Threads are
+ * only used when compiled with CAT_COMPILE_THREADS.
+ */
+int gcif_read_batch(GCIFBatchItem *items, int item_count, int thread_count);
+
+
 /*
  * gcif_get_size()
  *
@@ -129,6 +536,50 @@ int gcif_read_memory_to_buffer(const void *file_data_in, long file_size_bytes_in
  */
 int gcif_get_size(const void *file_data_in, long file_size_bytes_in, int *xsize, int *ysize);
 
+// Image compression modes, see gcif_get_info()
+enum GCIFModes {
+	GCIF_MODE_SINGLE_COLOR,		// Whole image is one color
+	GCIF_MODE_SMALL_PALETTE,	// Up to 16 colors packed into bytes
+	GCIF_MODE_PALETTE,			// Up to 256 colors
+	GCIF_MODE_RGBA				// Full color
+};
+
+// Image summary
+typedef struct _GCIFInfo {
+	int xsize, ysize;		// Dimensions in pixels
+	int stripe_rows;		// Rows per stripe, or 0 if not striped
+	int mode;				// GCIF_MODE_*
+	int colors;				// Palette size, or 0 for RGBA
+	int mask;				// Dominant color mask is used
+	int chaos_levels;		// Chaos levels for RGBA, else 0
+	int lz;					// RGBA data can contain LZ matches
+	double cost;			// Estimated decode time, relative to pixel count
+} GCIFInfo;
+
+/*
+ * gcif_get_info()
+ *
+ * Describe the image without decoding any pixels, for deciding how to
+ * schedule decoding.  Only the leading section headers are read, though this
+ * includes the dominant color mask when it comes before the palette header,
+ * and the filter and chaos tables of RGBA images.
+ *
+ * Striped images are described by their first stripe.
+ *
+ * The cost is an estimate of decode time, where a full RGBA image costs about
+ * one unit per pixel.  It can be used to balance images across threads.
+ *
+ * Returns GCIF_RE_OK on success, or a failure code from the table above.
+ */
+int gcif_get_info(const void *file_data_in, long file_size_bytes_in, GCIFInfo *info);
+
+/*
+ * gcif_decoder_get_info()
+ *
+ * Same as gcif_get_info() but using the decoder context.
+ */
+int gcif_decoder_get_info(GCIFDecoder *decoder, const void *file_data_in, long file_size_bytes_in, GCIFInfo *info);
+
 /*
  * gcif_sig_cmp()
  *
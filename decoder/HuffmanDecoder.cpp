@@ -35,6 +35,13 @@ using namespace cat;
 
 //// HuffmanDecoder
 
+// Fill a run of lookup table entries that all decode to the same short code
+static CAT_INLINE void fillLookup(u32 * CAT_RESTRICT dest, u32 count, u32 value) {
+	for (u32 ii = 0; ii < count; ++ii) {
+		dest[ii] = value;
+	}
+}
+
 bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table_bits) {
 	u32 min_codes[MAX_CODE_SIZE];
 
@@ -44,6 +51,13 @@ bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table
 	}
 
 	_num_syms = count;
+	_multi_bits = 0;
+	_init_table_bits = table_bits;
+
+	// If the codelens were not read by readCodelens(), do not share them
+	if (codelens != _codelens.get()) {
+		_codelens_count = 0;
+	}
 
 	// Codelen histogram
 	u32 num_codes[MAX_CODE_SIZE + 1] = { 0 };
@@ -52,6 +66,7 @@ bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table
 	}
 
 	u32 sorted_positions[MAX_CODE_SIZE + 1];
+	u32 next_codes[MAX_CODE_SIZE + 1];
 
 	u32 next_code = 0;
 	u32 total_used_syms = 0;
@@ -61,14 +76,16 @@ bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table
 	for (u32 ii = 1; ii <= MAX_CODE_SIZE; ++ii) {
 		const u32 n = num_codes[ii];
 
+		min_codes[ii - 1] = next_code;
+		next_codes[ii] = next_code;
+
 		if (!n) {
 			_max_codes[ii - 1] = 0;
+			_val_ptrs[ii - 1] = 0;
 		} else {
 			min_code_size = min_code_size < ii ? min_code_size : ii;
 			max_code_size = max_code_size > ii ? max_code_size : ii;
 
-			min_codes[ii - 1] = next_code;
-
 			_max_codes[ii - 1] = next_code + n - 1;
 			_max_codes[ii - 1] = 1 + ((_max_codes[ii - 1] << (16 - ii)) | ((1 << (16 - ii)) - 1));
 
@@ -78,6 +95,12 @@ bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table
 
 			next_code += n;
 			total_used_syms += n;
+
+			// If the codes do not fit in this many bits,
+			if CAT_UNLIKELY(next_code > (1U << ii)) {
+				CAT_DEBUG_EXCEPTION();
+				return false;
+			}
 		}
 
 		next_code <<= 1;
@@ -120,56 +143,58 @@ bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table
 	_min_code_size = static_cast<u8>( min_code_size );
 	_max_code_size = static_cast<u8>( max_code_size );
 
-	for (u16 sym = 0; sym < count; ++sym) {
-		int len = codelens[sym];
-		if (len > 0) {
-			int spos = sorted_positions[len]++;
-			_sorted_symbol_order[ spos ] = sym;
-		}
-	}
-
 	if (table_bits <= _min_code_size) {
 		table_bits = 0;
 	}
 
 	_table_bits = table_bits;
 
+	u32 * CAT_RESTRICT sorted_symbol_order = _sorted_symbol_order.get();
+
 	if (table_bits > 0) {
-		s32 table_size = 1 << table_bits;
-		if (_lookup.size() < table_size) {
+		const u32 table_size = 1 << table_bits;
+		if (_lookup.size() < (int)table_size) {
 			_lookup.resize(table_size);
 		}
 
-		_lookup.fill_ff();
+		u32 * CAT_RESTRICT lookup = _lookup.get();
 
-		for (u32 codesize = 1; codesize <= table_bits; ++codesize) {
-			if (!num_codes[codesize]) {
-				continue;
-			}
+		// Sort the symbols and fill the table for short codes in one pass,
+		// handing out canonical codes in symbol order for each code length
+		for (u16 sym = 0; sym < count; ++sym) {
+			const u32 len = codelens[sym];
+
+			if (len > 0) {
+				sorted_symbol_order[ sorted_positions[len]++ ] = sym;
 
-			const u32 fillsize = table_bits - codesize;
-			const u32 fillnum = 1 << fillsize;
+				if (len <= table_bits) {
+					const u32 fillsize = table_bits - len;
+					const u32 code = next_codes[len]++;
 
-			const u32 min_code = min_codes[codesize - 1];
-			u32 max_code = _max_codes[codesize - 1];
-			if (!max_code) {
-				max_code = 0xffffffff;
-			} else {
-				max_code = (max_code - 1) >> (16 - codesize);
+					fillLookup(lookup + (code << fillsize), 1 << fillsize, sym | (len << 16));
+				}
 			}
-			const u32 val_ptr = _val_ptrs[codesize - 1];
+		}
 
-			for (u32 code = min_code; code <= max_code; code++) {
-				const u32 sym_index = _sorted_symbol_order[ val_ptr + code - min_code ];
+		// Short codes fill the front of the table, so mark the rest unused
+		u32 table_used = 0;
+		for (u32 ii = table_bits; ii >= 1; --ii) {
+			if (num_codes[ii]) {
+				table_used = next_codes[ii] << (table_bits - ii);
+				break;
+			}
+		}
 
-				for (u32 jj = 0; jj < fillnum; ++jj) {
-					const u32 tt = jj + (code << fillsize);
+		memset(lookup + table_used, 0xff, (table_size - table_used) * sizeof(u32));
+	} else {
+		for (u16 sym = 0; sym < count; ++sym) {
+			const u32 len = codelens[sym];
 
-					_lookup[tt] = sym_index | (codesize << 16U);
-				}
+			if (len > 0) {
+				sorted_symbol_order[ sorted_positions[len]++ ] = sym;
 			}
 		}
-	}         
+	}
 
 	for (u32 ii = 0; ii < MAX_CODE_SIZE; ++ii) {
 		_val_ptrs[ii] -= min_codes[ii];
@@ -208,25 +233,20 @@ bool HuffmanDecoder::init(int count, const u8 * CAT_RESTRICT codelens, u32 table
 	return true;
 }
 
-static const u8 ONE_CODELEN[1] = {1};
-
-bool HuffmanDecoder::init(int num_syms_orig, ImageReader & CAT_RESTRICT reader, u32 table_bits) {
+bool HuffmanDecoder::readCodelens(int num_syms_orig, ImageReader & CAT_RESTRICT reader) {
 	static const int HUFF_SYMS = MAX_CODE_SIZE + 1;
 
+	reader.countTable();
+
+	_codelens_count = 0;
+	_codelens.resize(num_syms_orig);
+	u8 * CAT_RESTRICT codelens = _codelens.get();
+
 	// If number of symbols is degenerate,
 	if (num_syms_orig == 1) {
-		return init(1, ONE_CODELEN, 0);
-	}
-
-	// Allocate codelens array on stack if possible, else the heap
-	static const int STACK_SYMS = 512;
-	SmartArray<u8> heap_codelens;
-	u8 *codelens;
-	if (num_syms_orig > STACK_SYMS) {
-		heap_codelens.resize(num_syms_orig);
-		codelens = heap_codelens.get();
-	} else {
-		codelens = static_cast<u8 *>( alloca(num_syms_orig) );
+		codelens[0] = 1;
+		_codelens_count = 1;
+		return true;
 	}
 
 	CAT_DEBUG_ENFORCE(HUFF_SYMS == 17);
@@ -256,33 +276,45 @@ bool HuffmanDecoder::init(int num_syms_orig, ImageReader & CAT_RESTRICT reader,
 			codelens[ii] = reader.read17();
 		}
 
-		return init(num_syms, codelens, table_bits);
+		_codelens_count = num_syms;
+		return true;
 	}
 
 	// Initialize the table decoder
-	HuffmanTableDecoder table_decoder;
+	HuffmanTableDecoder &table_decoder = *reader.getTableDecoder();
 	if (!table_decoder.init(reader)) {
 		CAT_DEBUG_EXCEPTION();
 		return false;
 	}
 
-	// Read the method chosen
-	switch (reader.readBits(2)) {
-	default:
-	case 0:
-		{
-			for (int ii = 0; ii < num_syms; ++ii) {
-				u32 len = table_decoder.next(reader);
+	// Read all of the table symbols, several at a time while they fit
+	const int multi_end = num_syms - MULTI_MAX_SYMS;
+	const u32 method = reader.readBits(2);
+	int read_count = 0;
 
-				codelens[ii] = len;
-			}
+	while (read_count <= multi_end) {
+		u16 syms[MULTI_MAX_SYMS];
+		const int count = table_decoder.nextMulti(reader, syms);
+
+		for (int jj = 0; jj < count; ++jj) {
+			codelens[read_count++] = static_cast<u8>( syms[jj] );
 		}
+	}
+
+	while (read_count < num_syms) {
+		codelens[read_count++] = table_decoder.next(reader);
+	}
+
+	// Undo the prediction chosen
+	switch (method) {
+	default:
+	case 0:
 		break;
 	case 1:
 		{
 			u32 lag0 = 1, lag1 = 1;
 			for (int ii = 0; ii < num_syms; ++ii) {
-				u32 sym = table_decoder.next(reader);
+				u32 sym = codelens[ii];
 
 				u32 pred = (lag0 + lag1 + 1) >> 1;
 
@@ -302,7 +334,7 @@ bool HuffmanDecoder::init(int num_syms_orig, ImageReader & CAT_RESTRICT reader,
 		{
 			u32 lag0 = 1, lag1 = 1;
 			for (int ii = 0; ii < num_syms; ++ii) {
-				u32 sym = table_decoder.next(reader);
+				u32 sym = codelens[ii];
 
 				u32 pred = (lag0 + lag1 + 1) >> 1;
 
@@ -318,7 +350,7 @@ bool HuffmanDecoder::init(int num_syms_orig, ImageReader & CAT_RESTRICT reader,
 		{
 			u32 lag0 = 1, lag1 = 1;
 			for (int ii = 0; ii < num_syms; ++ii) {
-				u32 sym = table_decoder.next(reader);
+				u32 sym = codelens[ii];
 
 				u32 pred = (lag0 + lag1) >> 1;
 
@@ -332,7 +364,188 @@ bool HuffmanDecoder::init(int num_syms_orig, ImageReader & CAT_RESTRICT reader,
 		break;
 	}
 
-	return init(num_syms_orig, codelens, table_bits);
+	_codelens_count = num_syms_orig;
+	return true;
+}
+
+bool HuffmanDecoder::init(int num_syms, ImageReader & CAT_RESTRICT reader, u32 table_bits) {
+	if (!readCodelens(num_syms, reader)) {
+		return false;
+	}
+
+	return init(_codelens_count, _codelens.get(), table_bits);
+}
+
+bool HuffmanDecoder::initShared(int num_syms, ImageReader & CAT_RESTRICT reader, u32 table_bits, HuffmanDecoder * const * CAT_RESTRICT others, int others_count) {
+	if (!readCodelens(num_syms, reader)) {
+		return false;
+	}
+
+	const int count = _codelens_count;
+
+	// If an earlier table has the same codelens, copy it instead of building
+	for (int ii = 0; ii < others_count; ++ii) {
+		HuffmanDecoder * CAT_RESTRICT other = others[ii];
+
+		if (other->_codelens_count == count && other->_init_table_bits == table_bits &&
+			!memcmp(other->_codelens.get(), _codelens.get(), count)) {
+			copyTables(*other);
+			reader.countSharedTable();
+			return true;
+		}
+	}
+
+	return init(count, _codelens.get(), table_bits);
+}
+
+void HuffmanDecoder::copyTables(HuffmanDecoder & CAT_RESTRICT other) {
+	_num_syms = other._num_syms;
+	_one_sym = other._one_sym;
+	_init_table_bits = other._init_table_bits;
+	_multi_bits = 0;
+
+	// If only one symbol, nothing else was set up
+	if (_one_sym) {
+		return;
+	}
+
+	memcpy(_max_codes, other._max_codes, sizeof(_max_codes));
+	memcpy(_val_ptrs, other._val_ptrs, sizeof(_val_ptrs));
+	_total_used_syms = other._total_used_syms;
+
+	_cur_sorted_symbol_order_size = other._cur_sorted_symbol_order_size;
+	_sorted_symbol_order.resize(_cur_sorted_symbol_order_size);
+	memcpy(_sorted_symbol_order.get(), other._sorted_symbol_order.get(), _total_used_syms * sizeof(u32));
+
+	_min_code_size = other._min_code_size;
+	_max_code_size = other._max_code_size;
+	_table_bits = other._table_bits;
+
+	if (_table_bits > 0) {
+		const int table_size = 1 << _table_bits;
+		if (_lookup.size() < table_size) {
+			_lookup.resize(table_size);
+		}
+
+		memcpy(_lookup.get(), other._lookup.get(), table_size * sizeof(u32));
+	}
+
+	_table_max_code = other._table_max_code;
+	_decode_start_code_size = other._decode_start_code_size;
+	_table_shift = other._table_shift;
+}
+
+u32 HuffmanDecoder::peekSymbol(u32 code, u32 &len) {
+	u32 k = static_cast<u32>((code >> 16) + 1);
+
+	if (k <= _table_max_code) {
+		u32 t = _lookup[code >> (32 - _table_bits)];
+
+		len = static_cast<u16>( t >> 16 );
+		return static_cast<u16>( t );
+	}
+
+	u32 bits = _decode_start_code_size;
+
+	while (k > _max_codes[bits - 1]) {
+		bits++;
+	}
+
+	len = bits;
+
+	int val_ptr = _val_ptrs[bits - 1] + static_cast<int>((code >> (32 - bits)));
+
+	if ((u32)val_ptr >= _num_syms) {
+		len = MAX_CODE_SIZE + 1;
+		return 0;
+	}
+
+	return _sorted_symbol_order[val_ptr];
+}
+
+void HuffmanDecoder::initMulti(u32 multi_bits, u32 plain_min, u32 plain_max) {
+	_multi_bits = 0;
+
+	// If symbols do not take any bits, next() is already as fast as it gets
+	if (_one_sym || multi_bits > MAX_MULTI_BITS || multi_bits <= _min_code_size) {
+		return;
+	}
+
+	const u32 table_size = 1 << multi_bits;
+	if ((u32)_multi.size() < table_size) {
+		_multi.resize(table_size);
+	}
+
+	for (u32 ii = 0; ii < table_size; ++ii) {
+		// Bits after the window are zero, which cannot complete a code that
+		// did not already fit in the window since the codes are prefix-free
+		const u32 window = ii << (32 - multi_bits);
+		u32 used = 0, count = 0, syms = 0;
+
+		do {
+			u32 len;
+			const u32 sym = peekSymbol(window << used, len);
+
+			if (used + len > multi_bits || sym >= 256) {
+				break;
+			}
+
+			syms |= sym << (count * 8);
+			used += len;
+			++count;
+
+			// Stop after symbols that may be followed by extra bits
+			if (sym < plain_min || sym >= plain_max) {
+				break;
+			}
+		} while (count < MULTI_MAX_SYMS && used < multi_bits);
+
+		_multi[ii] = syms | (used << 24) | (count << 29);
+	}
+
+	_multi_bits = multi_bits;
+}
+
+bool HuffmanDecoder::hasSymbolIn(u32 first, u32 end) {
+	// If only one symbol is used,
+	if (_one_sym) {
+		const u32 sym = _one_sym - 1;
+		return sym >= first && sym < end;
+	}
+
+	for (u32 ii = 0; ii < _total_used_syms; ++ii) {
+		const u32 sym = _sorted_symbol_order[ii];
+
+		if (sym >= first && sym < end) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool HuffmanDecoder::getLastSymbol(u32 &sym) {
+	// If only one symbol is used,
+	if (_one_sym) {
+		sym = _one_sym - 1;
+		return true;
+	}
+
+	if (_total_used_syms == 0) {
+		return false;
+	}
+
+	u32 last = 0;
+	for (u32 ii = 0; ii < _total_used_syms; ++ii) {
+		const u32 s = _sorted_symbol_order[ii];
+
+		if (s > last) {
+			last = s;
+		}
+	}
+
+	sym = last;
+	return true;
 }
 
 u32 HuffmanDecoder::next(ImageReader & CAT_RESTRICT reader) {
@@ -409,7 +622,13 @@ bool HuffmanTableDecoder::init(ImageReader & CAT_RESTRICT reader) {
 	_zeroRun = 0;
 	_lastZero = false;
 
-	return _decoder.init(NUM_SYMS, table_codelens, 8);
+	if (!_decoder.init(NUM_SYMS, table_codelens, 8)) {
+		return false;
+	}
+
+	// Zeroes may be followed by a run length so they end multi-symbol lookups
+	_decoder.initMulti(MULTI_LUT_BITS, 1, NUM_SYMS);
+	return true;
 }
 
 u8 HuffmanTableDecoder::next(ImageReader & CAT_RESTRICT reader) {
@@ -433,3 +652,26 @@ u8 HuffmanTableDecoder::next(ImageReader & CAT_RESTRICT reader) {
 	}
 }
 
+int HuffmanTableDecoder::nextMulti(ImageReader & CAT_RESTRICT reader, u16 * CAT_RESTRICT syms) {
+	if (_zeroRun > 0) {
+		--_zeroRun;
+		syms[0] = 0;
+		return 1;
+	}
+
+	// Zeroes are never followed by another symbol in the same lookup
+	const int count = _decoder.nextMulti(reader, syms);
+
+	if (syms[count - 1] == 0) {
+		if (_lastZero && count == 1) {
+			_zeroRun = reader.read335();
+		}
+
+		_lastZero = true;
+	} else {
+		_lastZero = false;
+	}
+
+	return count;
+}
+
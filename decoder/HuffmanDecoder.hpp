@@ -45,6 +45,8 @@ public:
 	static const u32 MAX_CODE_SIZE = 16; // Max bits per Huffman code (16 is upper limit)
 	static const u32 MAX_TABLE_BITS = 11; // Time-memory tradeoff LUT optimization limit
 	static const int TABLE_THRESH = 20; // Number of symbols before table is compressed
+	static const u32 MAX_MULTI_BITS = 12; // Multi-symbol LUT size limit
+	static const int MULTI_MAX_SYMS = 3; // Max symbols returned by one multi-symbol lookup
 
 protected:
 	u32 _num_syms;
@@ -68,17 +70,99 @@ protected:
 
 	u32 _one_sym;
 
+	/*
+	 * Multi-symbol lookup table
+	 *
+	 * Each entry decodes up to MULTI_MAX_SYMS short codes from one peek:
+	 *
+	 * Bits  0..23: Symbols, 8 bits each, first symbol in the low byte
+	 * Bits 24..28: Total code length in bits
+	 * Bits 29..30: Symbol count, or 0 to fall back to next()
+	 */
+	u32 _multi_bits;
+	SmartArray<u32> _multi;
+
+	// Codelens from the last readCodelens(), kept to find identical tables
+	SmartArray<u8> _codelens;
+	int _codelens_count;
+	u32 _init_table_bits;
+
+	// Decode one symbol from the high bits of code without consuming it
+	u32 peekSymbol(u32 code, u32 &len);
+
+	// Read codelens from the bitstream into _codelens
+	bool readCodelens(int num_syms, ImageReader & CAT_RESTRICT reader);
+
+	// Copy the decoding tables built by another decoder
+	void copyTables(HuffmanDecoder & CAT_RESTRICT other);
+
 public:
+	CAT_INLINE HuffmanDecoder() {
+		_multi_bits = 0;
+		_codelens_count = 0;
+	}
+
 	bool init(int num_syms, const u8 * CAT_RESTRICT codelens, u32 table_bits);
 	bool init(int num_syms, ImageReader & CAT_RESTRICT reader, u32 table_bits);
 
+	// Same as init() from the bitstream, but if the codelens match those of
+	// one of the other decoders then its tables are copied instead of built
+	bool initShared(int num_syms, ImageReader & CAT_RESTRICT reader, u32 table_bits, HuffmanDecoder * const * CAT_RESTRICT others, int others_count);
+
+	/*
+	 * Build the multi-symbol lookup table after init().
+	 *
+	 * Symbols in [plain_min, plain_max) can be followed by another symbol in
+	 * the same lookup.  Any other symbol under 256 ends the lookup, so that
+	 * the caller can read extra bits that follow it.  Larger symbols are
+	 * always decoded one at a time.
+	 */
+	void initMulti(u32 multi_bits, u32 plain_min, u32 plain_max);
+
 	u32 next(ImageReader &reader);
+
+	// Returns true if any symbol in [first, end) has a code
+	bool hasSymbolIn(u32 first, u32 end);
+
+	// Returns false if no symbol has a code, or else the largest one in sym
+	bool getLastSymbol(u32 &sym);
+
+	// Returns true if next() always returns sym without reading any bits
+	CAT_INLINE bool getOneSymbol(u32 &sym) {
+		if (_one_sym) {
+			sym = _one_sym - 1;
+			return true;
+		}
+		return false;
+	}
+
+	// Decode 1..MULTI_MAX_SYMS symbols into syms, returning the count
+	CAT_INLINE int nextMulti(ImageReader & CAT_RESTRICT reader, u16 * CAT_RESTRICT syms) {
+		const u32 multi_bits = _multi_bits;
+
+		if (multi_bits) {
+			const u32 t = _multi[reader.peek(multi_bits) >> (32 - multi_bits)];
+			const int count = t >> 29;
+
+			if (count) {
+				syms[0] = static_cast<u8>( t );
+				syms[1] = static_cast<u8>( t >> 8 );
+				syms[2] = static_cast<u8>( t >> 16 );
+				reader.eat((t >> 24) & 31);
+				return count;
+			}
+		}
+
+		syms[0] = static_cast<u16>( next(reader) );
+		return 1;
+	}
 };
 
 
 // Decoder for Huffman tables
 class HuffmanTableDecoder {
 	static const int NUM_SYMS = HuffmanDecoder::MAX_CODE_SIZE + 1;
+	static const int MULTI_LUT_BITS = 8;
 
 	HuffmanDecoder _decoder;
 	int _zeroRun;
@@ -88,6 +172,9 @@ public:
 	bool init(ImageReader &reader);
 
 	u8 next(ImageReader &reader);
+
+	// Decode 1..HuffmanDecoder::MULTI_MAX_SYMS symbols, returning the count
+	int nextMulti(ImageReader &reader, u16 *syms);
 };
 
 
@@ -61,14 +61,28 @@ int ImageMaskReader::decodeLZ(ImageReader & CAT_RESTRICT reader) {
 	if (reader.readBit()) {
 		static const int NUM_SYMS = 256;
 
-		HuffmanDecoder decoder;
-		if (!decoder.init(NUM_SYMS, reader, 8)) {
+		if (!_lz_decoder.init(NUM_SYMS, reader, 8)) {
 			CAT_DEBUG_EXCEPTION();
 			return GCIF_RE_MASK_DECI;
 		}
 
-		for (int ii = 0; ii < lzSize; ++ii) {
-			_lz[ii] = decoder.next(reader);
+		_lz_decoder.initMulti(MULTI_LUT_BITS, 0, NUM_SYMS);
+
+		// Decode several bytes per lookup while they fit
+		const int multi_end = lzSize - HuffmanDecoder::MULTI_MAX_SYMS;
+		int ii = 0;
+
+		while (ii <= multi_end) {
+			u16 syms[HuffmanDecoder::MULTI_MAX_SYMS];
+			const int count = _lz_decoder.nextMulti(reader, syms);
+
+			for (int jj = 0; jj < count; ++jj) {
+				_lz[ii++] = static_cast<u8>( syms[jj] );
+			}
+		}
+
+		for (; ii < lzSize; ++ii) {
+			_lz[ii] = _lz_decoder.next(reader);
 		}
 	} else {
 		for (int ii = 0; ii < lzSize; ++ii) {
@@ -106,12 +120,16 @@ int ImageMaskReader::init(int xsize, int ysize) {
 	const int maskHeight = ysize;
 
 	_color = 0;
+	_masked_count = 0;
 	_stride = (maskWidth + 31) >> 5;
 	_xsize = maskWidth;
 	_ysize = maskHeight;
 
 	_mask.resize(_stride);
 
+	// Runs are separated by at least one pixel, plus the end marker
+	_runs.resize((maskWidth + 1) / 2 + 1);
+
 	return GCIF_RE_OK;
 }
 
@@ -370,6 +388,68 @@ const u32 *ImageMaskReader::nextScanline() {
 	return _mask.get();
 }
 
+const ImageMaskReader::Run *ImageMaskReader::nextScanlineRuns() {
+	Run * CAT_RESTRICT run = _runs.get();
+
+	// If disabled, there is never anything to skip
+	if (!_enabled) {
+		run->x = static_cast<u16>( _xsize );
+		run->len = 0;
+		return _runs.get();
+	}
+
+	const u32 * CAT_RESTRICT row = nextScanline();
+	const int stride = _stride;
+
+	// Bits past the end of the last word are not part of the image
+	const int tail_bits = _xsize & 31;
+	const u32 tail_mask = tail_bits ? ~(0xffffffff >> tail_bits) : 0xffffffff;
+
+	u32 prev = 0;
+	bool masked = false;
+
+	// For each word of the scanline,
+	for (int ii = 0; ii < stride; ++ii) {
+		u32 word = row[ii];
+		if (ii == stride - 1) {
+			word &= tail_mask;
+		}
+
+		// Set bits where the masked state changes from the pixel before it
+		u32 edges = word ^ ((word >> 1) | (prev << 31));
+		prev = word;
+
+		// For each change in this word,
+		while (edges) {
+			const int bit = BSR32(edges);
+			const u16 x = static_cast<u16>( (ii << 5) + 31 - bit );
+			edges ^= (u32)1 << bit;
+
+			if (masked) {
+				run->len = x - run->x;
+				_masked_count += run->len;
+				++run;
+			} else {
+				run->x = x;
+			}
+			masked = !masked;
+		}
+	}
+
+	// If the last run reaches the end of the scanline,
+	if (masked) {
+		run->len = static_cast<u16>( _xsize - run->x );
+		_masked_count += run->len;
+		++run;
+	}
+
+	// End marker
+	run->x = static_cast<u16>( _xsize );
+	run->len = 0;
+
+	return _runs.get();
+}
+
 
 #ifdef CAT_COLLECT_STATS
 
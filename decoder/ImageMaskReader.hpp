@@ -33,6 +33,7 @@
 #include "ImageReader.hpp"
 #include "Filters.hpp"
 #include "SmartArray.hpp"
+#include "HuffmanDecoder.hpp"
 
 /*
  * Game Closure Dominant Color Mask Decompression
@@ -44,16 +45,28 @@ namespace cat {
 //// ImageMaskReader
 
 class ImageMaskReader {
+public:
+	// Run of masked pixels [x, x + len) on a scanline
+	struct Run {
+		u16 x, len;
+	};
+
+protected:
+	static const int MULTI_LUT_BITS = 10; // Multi-symbol LUT bits for LZ bytes
+
 	SmartArray<u32> _mask;
+	SmartArray<Run> _runs;
 
 	int _xsize, _ysize, _stride;
 
 	bool _enabled;
 
 	SmartArray<u8> _lz, _rle;
+	HuffmanDecoder _lz_decoder;
 	int _rle_remaining;
 	const u8 *_rle_next;
 	int _scanline_y;
+	int _masked_count;	// Masked pixels returned by nextScanlineRuns()
 
 	u32 _color;
 
@@ -76,6 +89,13 @@ public:
 	// Returns bitmask for scanline, MSB = first pixel
 	const u32 *nextScanline();
 
+	/*
+	 * Returns the masked runs for the next scanline in order, instead of
+	 * the bitmask.  The list ends with a run at x = xsize with zero length,
+	 * so callers can decode up to the next run without checking the count.
+	 */
+	const Run *nextScanlineRuns();
+
 	CAT_INLINE bool enabled() {
 		return _enabled;
 	}
@@ -84,6 +104,10 @@ public:
 		return _color;
 	}
 
+	CAT_INLINE int getMaskedCount() {
+		return _masked_count;
+	}
+
 #ifdef CAT_COLLECT_STATS
 	bool dumpStats();
 #else
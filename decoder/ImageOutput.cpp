@@ -0,0 +1,318 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ImageOutput.hpp"
+#include "Enforcer.hpp"
+using namespace cat;
+
+
+//// Pixel format conversion
+
+// Returns round(c * a / 255)
+static CAT_INLINE u8 premultiply(u8 c, u8 a) {
+	const u32 t = (u32)c * a + 128;
+	return (u8)((t + (t >> 8)) >> 8);
+}
+
+static void convertRGBA(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count) {
+	memcpy(out, rgba, count * 4);
+}
+
+static void convertBGRA(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count) {
+	for (int ii = 0; ii < count; ++ii, rgba += 4, out += 4) {
+		const u8 r = rgba[0], g = rgba[1], b = rgba[2], a = rgba[3];
+
+		out[0] = b;
+		out[1] = g;
+		out[2] = r;
+		out[3] = a;
+	}
+}
+
+static void convertRGBAPremul(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count) {
+	for (int ii = 0; ii < count; ++ii, rgba += 4, out += 4) {
+		const u8 r = rgba[0], g = rgba[1], b = rgba[2], a = rgba[3];
+
+		out[0] = premultiply(r, a);
+		out[1] = premultiply(g, a);
+		out[2] = premultiply(b, a);
+		out[3] = a;
+	}
+}
+
+static void convertBGRAPremul(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count) {
+	for (int ii = 0; ii < count; ++ii, rgba += 4, out += 4) {
+		const u8 r = rgba[0], g = rgba[1], b = rgba[2], a = rgba[3];
+
+		out[0] = premultiply(b, a);
+		out[1] = premultiply(g, a);
+		out[2] = premultiply(r, a);
+		out[3] = a;
+	}
+}
+
+static void convertRGBA4444(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count) {
+	u16 * CAT_RESTRICT words = reinterpret_cast<u16 *>( out );
+
+	for (int ii = 0; ii < count; ++ii, rgba += 4) {
+		words[ii] = (u16)(((rgba[0] >> 4) << 12) | ((rgba[1] >> 4) << 8) | ((rgba[2] >> 4) << 4) | (rgba[3] >> 4));
+	}
+}
+
+static void convertRGB565(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count) {
+	u16 * CAT_RESTRICT words = reinterpret_cast<u16 *>( out );
+
+	for (int ii = 0; ii < count; ++ii, rgba += 4) {
+		words[ii] = (u16)(((rgba[0] >> 3) << 11) | ((rgba[1] >> 2) << 5) | (rgba[2] >> 3));
+	}
+}
+
+static const ImageOutput::ConvertFunction CONVERT_FUNCTIONS[GCIF_FORMAT_COUNT] = {
+	convertRGBA,
+	convertBGRA,
+	convertRGBAPremul,
+	convertBGRAPremul,
+	convertRGBA4444,
+	convertRGB565
+};
+
+static const int FORMAT_BYTES[GCIF_FORMAT_COUNT] = {
+	4, 4, 4, 4, 2, 2
+};
+
+
+//// ImageOutput
+
+ImageOutput::ImageOutput() {
+	_out = 0;
+	_whole = true;
+	_direct = true;
+	_callback = 0;
+	_rows_done = 0;
+	_work_bytes = 0;
+
+	setFormat(GCIF_FORMAT_RGBA);
+}
+
+int ImageOutput::getFormatBytes(int format) {
+	if (format < 0 || format >= GCIF_FORMAT_COUNT) {
+		return 0;
+	}
+
+	return FORMAT_BYTES[format];
+}
+
+void ImageOutput::setFormat(int format) {
+	// If format is unknown, use RGBA
+	if (format < 0 || format >= GCIF_FORMAT_COUNT) {
+		format = GCIF_FORMAT_RGBA;
+	}
+
+	_format = format;
+	_bytes = FORMAT_BYTES[format];
+	_convert = CONVERT_FUNCTIONS[format];
+}
+
+void ImageOutput::init(u8 *out, u16 xsize, u16 ysize, int stride) {
+	CAT_DEBUG_ENFORCE(stride >= xsize * _bytes);
+
+	_xsize = xsize;
+	_ysize = ysize;
+	_x = 0;
+	_y = 0;
+	_w = xsize;
+	_h = ysize;
+	_out = out;
+	_stride = stride;
+	_whole = true;
+	_converted = false;
+	_callback = 0;
+	_rows_done = 0;
+	_work_bytes = 0;
+
+	// If rows can be written as RGBA words in place,
+	_direct = (_format == GCIF_FORMAT_RGBA) && (stride & 3) == 0;
+}
+
+void ImageOutput::initRegion(u8 *out, u16 xsize, u16 ysize, u16 x, u16 y, u16 w, u16 h) {
+	CAT_DEBUG_ENFORCE(x + w <= xsize && y + h <= ysize);
+
+	_xsize = xsize;
+	_ysize = ysize;
+	_x = x;
+	_y = y;
+	_w = w;
+	_h = h;
+	_out = out;
+	_stride = w * _bytes;
+
+	// If the region is the whole image, write it directly
+	_whole = (w == xsize && h == ysize);
+	_converted = false;
+	_direct = _whole && (_format == GCIF_FORMAT_RGBA);
+	_callback = 0;
+	_rows_done = 0;
+	_work_bytes = 0;
+}
+
+void ImageOutput::initStream(u16 xsize, u16 ysize, int band_rows, GCIFRowCallback callback, void *context) {
+	CAT_DEBUG_ENFORCE(band_rows > 0 && callback != 0);
+
+	_xsize = xsize;
+	_ysize = ysize;
+	_x = 0;
+	_y = 0;
+	_w = xsize;
+	_h = ysize;
+	_out = 0;
+	_stride = xsize * _bytes;
+	_whole = false;
+	_converted = false;
+	_direct = false;
+	_rows_done = 0;
+	_work_bytes = 0;
+
+	_callback = callback;
+	_context = context;
+	_band_rows = band_rows < ysize ? band_rows : ysize;
+	_band_y = 0;
+	_band_count = 0;
+	_image_ysize = ysize;
+	_stripe_y = 0;
+
+	_band.resize(_xsize * _band_rows * _bytes);
+}
+
+void ImageOutput::setStripe(u16 y, u16 ysize) {
+	CAT_DEBUG_ENFORCE(_callback != 0);
+	CAT_DEBUG_ENFORCE(y == _band_y + _band_count);
+
+	_ysize = ysize;
+	_h = ysize;
+	_stripe_y = y;
+	_converted = false;
+}
+
+bool ImageOutput::usePalette() {
+	// If output pixels are not 32-bit,
+	if (_bytes != 4) {
+		return false;
+	}
+
+	// Rows will already be in the output format
+	_converted = true;
+	_direct = _whole && (_stride & 3) == 0;
+
+	return true;
+}
+
+void ImageOutput::convertColors(u32 *colors, int count) {
+	CAT_DEBUG_ENFORCE(_bytes == 4);
+
+	if (_format != GCIF_FORMAT_RGBA) {
+		u8 *bytes = reinterpret_cast<u8 *>( colors );
+
+		// Converting one pixel at a time is safe in place
+		for (int ii = 0; ii < count; ++ii, bytes += 4) {
+			u8 color[4];
+			_convert(bytes, color, 1);
+			memcpy(bytes, color, 4);
+		}
+	}
+}
+
+u8 *ImageOutput::getWork(int bytes) {
+	if (_work_bytes < bytes) {
+		_work_bytes = bytes;
+	}
+
+	_work.resize(bytes);
+	return _work.get();
+}
+
+u8 *ImageOutput::getWindow(int &rows) {
+	const int yend = getRowEnd();
+
+	// If output rows are packed, the image can be read back in place
+	if (_direct && _stride == _xsize * 4) {
+		rows = yend;
+		return _out;
+	}
+
+	if (rows > yend) {
+		rows = yend;
+	}
+
+	_direct = false;
+	return getWork(_xsize * rows * 4);
+}
+
+u8 *ImageOutput::getRows(u16 y, int count) {
+	if (_direct) {
+		return _out + y * _stride;
+	}
+
+	return getWork(_xsize * count * 4);
+}
+
+void ImageOutput::emitPixels(const u8 * CAT_RESTRICT row, u8 * CAT_RESTRICT out, int count) {
+	// If the reader already wrote the output format,
+	if (_converted) {
+		memcpy(out, row, count * 4);
+	} else {
+		_convert(row, out, count);
+	}
+}
+
+void ImageOutput::copyRow(u16 y, const u8 * CAT_RESTRICT row) {
+	// If the row is outside the region,
+	if (y < _y || y >= getRowEnd()) {
+		return;
+	}
+
+	u8 * CAT_RESTRICT dst = _out + (y - _y) * _stride;
+
+	emitPixels(row + _x * 4, dst, _w);
+}
+
+void ImageOutput::streamRow(u16 y, const u8 * CAT_RESTRICT row) {
+	CAT_DEBUG_ENFORCE(_stripe_y + y == _band_y + _band_count);
+
+	const int row_bytes = _xsize * _bytes;
+
+	emitPixels(row, _band.get() + _band_count * row_bytes, _xsize);
+
+	// If the band is full or this is the last row of the image,
+	if (++_band_count >= _band_rows || _band_y + _band_count >= _image_ysize) {
+		_callback(_context, _band.get(), _band_y, _band_count, _xsize);
+
+		_band_y += _band_count;
+		_band_count = 0;
+	}
+}
+
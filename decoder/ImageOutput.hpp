@@ -0,0 +1,205 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef IMAGE_OUTPUT_HPP
+#define IMAGE_OUTPUT_HPP
+
+#include "Platform.hpp"
+#include "SmartArray.hpp"
+#include "GCIFReader.h"
+
+/*
+ * Game Closure Image Output
+ *
+ * Decides where the readers put decoded pixels.
+ *
+ * In the usual case the whole image is wanted as RGBA, so the readers write
+ * straight into the output and nothing else happens here.
+ *
+ * Otherwise the readers decode into a few rows of working memory from this
+ * object and hand over each scanline as soon as it is finished, which copies
+ * out the part of the row that is wanted.  Rows past the last one that is
+ * needed are never decoded.
+ *
+ * When streaming, finished rows are gathered into bands that are passed to a
+ * callback, so the caller never needs to hold the whole image.
+ *
+ * Rows are converted to the output pixel format as they are copied out, while
+ * they are still in cache.  Readers that write colors from a palette can
+ * convert the palette instead and write the output format directly.
+ */
+
+namespace cat {
+
+
+//// ImageOutput
+
+class ImageOutput {
+public:
+	typedef void (*ConvertFunction)(const u8 * CAT_RESTRICT rgba, u8 * CAT_RESTRICT out, int count);
+
+protected:
+	u16 _xsize, _ysize;		// Full image size
+	u16 _x, _y, _w, _h;		// Region of the image to output
+	u8 *_out;				// Output pixels for the region
+	int _stride;			// Bytes from one output row to the next
+	bool _whole;			// Output is the whole image?
+	bool _direct;			// Readers write straight to the output?
+
+	// Pixel format
+	int _format;			// GCIF_FORMAT_*
+	int _bytes;				// Bytes per output pixel
+	ConvertFunction _convert;	// From RGBA to output format
+	bool _converted;		// Rows from the readers are in the output format?
+
+	SmartArray<u8> _work;	// Working pixels when not direct
+	int _work_bytes;		// Most bytes of working pixels used for this image
+
+	// Streaming
+	GCIFRowCallback _callback;	// Called with each band, or 0 if not streaming
+	void *_context;
+	int _band_rows;			// Rows per band
+	int _band_y, _band_count;	// First image row in band, rows so far
+	u16 _image_ysize;		// Image height, when _ysize is just a stripe
+	u16 _stripe_y;			// First image row of the stripe being read
+	SmartArray<u8> _band;	// Band pixels
+
+	int _rows_done;			// Rows handed over so far
+
+	u8 *getWork(int bytes);
+	void emitPixels(const u8 * CAT_RESTRICT row, u8 * CAT_RESTRICT out, int count);
+	void copyRow(u16 y, const u8 * CAT_RESTRICT row);
+	void streamRow(u16 y, const u8 * CAT_RESTRICT row);
+
+public:
+	ImageOutput();
+
+	// Returns bytes per pixel for a GCIF_FORMAT_*, or 0 if it is unknown
+	static int getFormatBytes(int format);
+
+	// Pixel format for the outputs set up from now on
+	void setFormat(int format);
+
+	CAT_INLINE int getFormat() {
+		return _format;
+	}
+
+	CAT_INLINE int getPixelBytes() {
+		return _bytes;
+	}
+
+	// Output the whole image to out, with rows stride bytes apart
+	void init(u8 *out, u16 xsize, u16 ysize, int stride);
+
+	// Output just a region of the image to out (w * h pixels)
+	void initRegion(u8 *out, u16 xsize, u16 ysize, u16 x, u16 y, u16 w, u16 h);
+
+	// Pass the whole image to the callback in bands of band_rows rows
+	void initStream(u16 xsize, u16 ysize, int band_rows, GCIFRowCallback callback, void *context);
+
+	// When streaming, the readers will next produce rows [y, y + ysize)
+	void setStripe(u16 y, u16 ysize);
+
+	CAT_INLINE u16 getXSize() {
+		return _xsize;
+	}
+
+	CAT_INLINE u16 getYSize() {
+		return _ysize;
+	}
+
+	// Readers can stop after this many rows
+	CAT_INLINE u16 getRowEnd() {
+		return _y + _h;
+	}
+
+	CAT_INLINE bool isDirect() {
+		return _direct;
+	}
+
+	/*
+	 * Called by readers that write colors from a palette before any rows.
+	 *
+	 * Returns true if the output format has 32-bit pixels, in which case the
+	 * reader should pass its colors through convertColors() and the rows it
+	 * writes are taken to be in the output format already.  Otherwise the
+	 * reader writes RGBA as usual and rows are converted when finished.
+	 */
+	bool usePalette();
+
+	// Convert RGBA colors to a 32-bit output format in place
+	void convertColors(u32 *colors, int count);
+
+	/*
+	 * Returns RGBA memory for readers that look back at rows they already
+	 * wrote, with room for rows rows that the reader slides down the image.
+	 * If the whole image can be written in place, that is returned instead and
+	 * rows is set to getRowEnd(), so the window never has to slide.
+	 */
+	u8 *getWindow(int &rows);
+
+	/*
+	 * Returns RGBA memory for count rows starting at row y, for readers that
+	 * never look back at rows they already wrote.  The memory may be reused
+	 * for the next rows.
+	 */
+	u8 *getRows(u16 y, int count);
+
+	// Bytes from one row to the next in memory from getRows()
+	CAT_INLINE int getRowPitch() {
+		return _direct ? _stride : _xsize * 4;
+	}
+
+	// Called by the readers when row y is finished, with its RGBA pixels
+	CAT_INLINE void writeRow(u16 y, const u8 * CAT_RESTRICT row) {
+		if (!_direct) {
+			if (_callback) {
+				streamRow(y, row);
+			} else {
+				copyRow(y, row);
+			}
+		}
+
+		_rows_done = y + 1;
+	}
+
+	// Most bytes of working memory the readers have used at once for this image
+	CAT_INLINE int getWorkBytes() {
+		return _work_bytes;
+	}
+
+	// Rows at the top of the image that are finished, when read in order
+	CAT_INLINE int getRowsDone() {
+		return _rows_done;
+	}
+};
+
+
+} // namespace cat
+
+#endif // IMAGE_OUTPUT_HPP
@@ -33,6 +33,13 @@
 #include "Filters.hpp"
 using namespace cat;
 
+#if defined(CAT_HAS_SIMD_DISPATCH)
+#include <immintrin.h>
+#if defined(CAT_COMPILER_MSVC)
+#include <intrin.h>
+#endif
+#endif
+
 #ifdef CAT_COLLECT_STATS
 #include "../encoder/Log.hpp"
 #include "../encoder/Clock.hpp"
@@ -77,19 +84,39 @@ int ImagePaletteReader::readPalette(ImageReader & CAT_RESTRICT reader) {
 		YUV2RGBFilterFunction filter = YUV2RGB_FILTERS[cf];
 
 		// Initialize the decoder
-		EntropyDecoder decoder;
-		if (!decoder.init(PALETTE_MAX, ENCODER_ZRLE_SYMS, HUFF_LUT_BITS, reader)) {
+		if (!_palette_decoder.init(PALETTE_MAX, ENCODER_ZRLE_SYMS, HUFF_LUT_BITS, reader)) {
 			return GCIF_RE_BAD_PAL;
 		}
 
+		_palette_decoder.initMulti(MULTI_LUT_BITS);
+
+		// Decode all the YUVA values up front, several per lookup
+		u8 values[PALETTE_MAX * 4];
+		const int value_count = _palette_size * 4;
+		const int multi_end = value_count - HuffmanDecoder::MULTI_MAX_SYMS;
+		int read_count = 0;
+
+		while (read_count <= multi_end) {
+			u16 syms[HuffmanDecoder::MULTI_MAX_SYMS];
+			const int count = _palette_decoder.nextMulti(reader, syms);
+
+			for (int jj = 0; jj < count; ++jj) {
+				values[read_count++] = static_cast<u8>( syms[jj] );
+			}
+		}
+
+		while (read_count < value_count) {
+			values[read_count++] = static_cast<u8>( _palette_decoder.next(reader) );
+		}
+
 		// For each palette color,
-		for (int ii = 0, iiend = _palette_size; ii < iiend; ++ii) {
-			// Decode
+		const u8 *value = values;
+		for (int ii = 0, iiend = _palette_size; ii < iiend; ++ii, value += 4) {
 			u8 yuv[3];
-			yuv[0] = static_cast<u8>( decoder.next(reader) );
-			yuv[1] = static_cast<u8>( decoder.next(reader) );
-			yuv[2] = static_cast<u8>( decoder.next(reader) );
-			u8 a = 255 - static_cast<u8>( decoder.next(reader) );
+			yuv[0] = value[0];
+			yuv[1] = value[1];
+			yuv[2] = value[2];
+			u8 a = 255 - value[3];
 
 			// Unfilter
 			u8 rgb[3];
@@ -145,183 +172,274 @@ int ImagePaletteReader::readTables(ImageReader & CAT_RESTRICT reader) {
 	return err;
 }
 
-int ImagePaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
-	const u32 MASK_COLOR = _mask->getColor();
-	const u8 MASK_PAL = _mask_palette;
+void ImagePaletteReader::maskRun(u32 * CAT_RESTRICT rgba, int x, int len) {
+	const u32 MASK_COLOR = _mask_color;
 
-	u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( _rgba );
+	for (int ii = 0; ii < len; ++ii) {
+		rgba[ii] = MASK_COLOR;
+	}
 
-	// Set up read delegates
-	MonoReader::ReadDelegate read_safe = _mono_decoder.getReadDelegate(true);
+	memset(_mono_decoder.currentRow() + x, _mask_palette, len);
+	_mono_decoder.zeroRegion(x, len);
+	_mono_decoder.uncountLZ(x, len);
+}
 
-#ifdef CAT_UNROLL_READER
-	MonoReader::ReadDelegate read_unsafe = _mono_decoder.getReadDelegate(false);
+#if defined(CAT_HAS_SIMD_DISPATCH)
 
-	// Unroll y = 0 scanline
-	{
-		const int y = 0;
+// Check CPUID for the instruction sets the lookup kernels are built for
+static bool cpuHasSSSE3() {
+#if defined(CAT_COMPILER_MSVC)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3") != 0;
+#endif
+}
 
-		_mono_decoder.readRowHeader(y, reader);
+static bool cpuHasAVX2() {
+#if defined(CAT_COMPILER_MSVC)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
 
-		const u32 *mask_next = _mask->nextScanline();
-		int mask_left = 0;
-		u32 mask;
+	// Needs the OS to save the YMM registers too
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
 
-		for (int x = 0, xend = _xsize; x < xend; ++x) {
-			DESYNC(x, y);
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
 
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
-			}
+// Look up each byte of 16 colors at a time and interleave them, returning the number of pixels done
+CAT_TARGET_SSSE3 static int lookupPlanes(u32 * CAT_RESTRICT rgba, const u8 * CAT_RESTRICT indices, int len, const u8 planes[4][16]) {
+	const __m128i plane0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>( planes[0] ));
+	const __m128i plane1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>( planes[1] ));
+	const __m128i plane2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>( planes[2] ));
+	const __m128i plane3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>( planes[3] ));
+
+	int done = 0;
+	for (; done + 16 <= len; done += 16) {
+		const __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i *>( indices + done ));
+
+		const __m128i b0 = _mm_shuffle_epi8(plane0, index);
+		const __m128i b1 = _mm_shuffle_epi8(plane1, index);
+		const __m128i b2 = _mm_shuffle_epi8(plane2, index);
+		const __m128i b3 = _mm_shuffle_epi8(plane3, index);
+
+		const __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+		const __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+		const __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+		const __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+
+		__m128i *out = reinterpret_cast<__m128i *>( rgba + done );
+		_mm_storeu_si128(out, _mm_unpacklo_epi16(lo01, lo23));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+		_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+		_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+	}
 
-			if ((s32)mask < 0) {
-				*rgba = MASK_COLOR;
-				u8 *p = _mono_decoder.currentRow() + x;
-				*p = MASK_PAL;
-				_mono_decoder.zero(x);
-			} else {
-				u8 index = read_safe(x, reader);
+	return done;
+}
+
+// Gather 8 colors at a time, returning the number of pixels done
+CAT_TARGET_AVX2 static int lookupGather(u32 * CAT_RESTRICT rgba, const u8 * CAT_RESTRICT indices, int len, const u32 * CAT_RESTRICT palette) {
+	int done = 0;
+	for (; done + 8 <= len; done += 8) {
+		const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>( indices + done )));
+		const __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int *>( palette ), index, 4);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>( rgba + done ), colors);
+	}
+
+	return done;
+}
+
+#endif // CAT_HAS_SIMD_DISPATCH
+
+void ImagePaletteReader::initLookup() {
+	_use_planes = false;
+	_use_gather = false;
 
-				CAT_DEBUG_ENFORCE(index < _palette_size);
+#if defined(CAT_HAS_SIMD_DISPATCH)
+	// If the palette fits in one shuffle,
+	if (_palette_size <= 16) {
+		if (cpuHasSSSE3()) {
+			CAT_OBJCLR(_palette_planes);
 
-				*rgba = _palette[index];
+			for (int ii = 0; ii < _palette_size; ++ii) {
+				const u8 *color = reinterpret_cast<const u8 *>( &_palette[ii] );
+
+				_palette_planes[0][ii] = color[0];
+				_palette_planes[1][ii] = color[1];
+				_palette_planes[2][ii] = color[2];
+				_palette_planes[3][ii] = color[3];
 			}
 
-			++rgba;
-			mask <<= 1;
+			_use_planes = true;
 		}
+	} else {
+		_use_gather = cpuHasAVX2();
 	}
+#endif
+}
 
-	// For each remaining scanline,
-	for (int y = 1, yend = _ysize; y < yend; ++y) {
-		_mono_decoder.readRowHeader(y, reader);
+void ImagePaletteReader::lookupSpan(u32 * CAT_RESTRICT rgba, const u8 * CAT_RESTRICT indices, int len) {
+	const u32 * CAT_RESTRICT palette = _palette;
 
-		const u32 *mask_next = _mask->nextScanline();
-		int mask_left;
-		u32 mask;
+#if defined(CAT_HAS_SIMD_DISPATCH)
+	int done = 0;
+	if (_use_planes) {
+		done = lookupPlanes(rgba, indices, len, _palette_planes);
+	} else if (_use_gather) {
+		done = lookupGather(rgba, indices, len, palette);
+	}
 
-		// Unroll x = 0
-		{
-			const int x = 0;
+	rgba += done;
+	indices += done;
+	len -= done;
+#endif
 
-			DESYNC(x, y);
+	for (int ii = 0; ii < len; ++ii) {
+		CAT_DEBUG_ENFORCE(indices[ii] < _palette_size);
+
+		rgba[ii] = palette[indices[ii]];
+	}
+}
+
+int ImagePaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
+	const int xend = _xsize;
 
-			// Next mask word
-			mask = *mask_next++;
-			mask_left = 31;
+	// Set up read delegates
+	MonoReader::ReadDelegate read_safe = _mono_decoder.getReadDelegate(true);
 
-			if ((s32)mask < 0) {
-				*rgba = MASK_COLOR;
-				u8 *p = _mono_decoder.currentRow() + x;
-				*p = MASK_PAL;
-				_mono_decoder.zero(x);
-			} else {
-				u8 index = read_safe(x, reader);
+#ifdef CAT_UNROLL_READER
+	MonoReader::ReadDelegate read_unsafe = _mono_decoder.getReadDelegate(false);
 
-				CAT_DEBUG_ENFORCE(index < _palette_size);
+	// Unroll y = 0 scanline
+	{
+		const int y = 0;
 
-				*rgba = _palette[index];
-			}
+		_mono_decoder.readRowHeader(y, reader);
 
-			++rgba;
-			mask <<= 1;
-		}
+		u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( _output->getRows(y, 1) );
+		const u8 * CAT_RESTRICT indices = _mono_decoder.currentRow();
+		const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		//// THIS IS THE INNER LOOP ////
+		for (int x = 0;; ++run) {
+			const int xstart = x;
 
-		for (int x = 1, xend = (int)_xsize - 1; x < xend; ++x) {
-			DESYNC(x, y);
+			// Read up to the next masked run
+			for (const int xmask = run->x; x < xmask; ++x) {
+				DESYNC(x, y);
 
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
+				read_safe(x, reader);
 			}
 
-			if ((s32)mask < 0) {
-				*rgba = MASK_COLOR;
-				u8 *p = _mono_decoder.currentRow() + x;
-				*p = MASK_PAL;
-				_mono_decoder.zero(x);
-			} else {
-				u8 index = read_unsafe(x, reader);
-
-				CAT_DEBUG_ENFORCE(index < _palette_size);
+			lookupSpan(rgba + xstart, indices + xstart, x - xstart);
 
-				*rgba = _palette[index];
+			if (x >= xend) {
+				break;
 			}
 
-			++rgba;
-			mask <<= 1;
+			maskRun(rgba + x, x, run->len);
+			x += run->len;
 		}
 
-		//// THIS IS THE INNER LOOP ////
+		_output->writeRow(y, reinterpret_cast<const u8 *>( rgba ));
+	}
+
+	// For each remaining scanline,
+	for (int y = 1, yend = _output->getRowEnd(); y < yend; ++y) {
+		_mono_decoder.readRowHeader(y, reader);
+
+		u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( _output->getRows(y, 1) );
+		const u8 * CAT_RESTRICT indices = _mono_decoder.currentRow();
+		const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		// Unroll x = _xsize - 1
-		{
-			const int x = _xsize - 1;
+		for (int x = 0;; ++run) {
+			const int xmask = run->x;
+			const int xstart = x;
 
-			DESYNC(x, y);
+			// Unroll x = 0
+			if (x == 0 && xmask > 0) {
+				DESYNC(x, y);
 
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
+				read_safe(x, reader);
+				++x;
 			}
 
-			if ((s32)mask < 0) {
-				*rgba = MASK_COLOR;
-				u8 *p = _mono_decoder.currentRow() + x;
-				*p = MASK_PAL;
-				_mono_decoder.zero(x);
-			} else {
-				u8 index = read_safe(x, reader);
+			//// THIS IS THE INNER LOOP ////
 
-				CAT_DEBUG_ENFORCE(index < _palette_size);
+			for (const int xunsafe = xmask < xend - 1 ? xmask : xend - 1; x < xunsafe; ++x) {
+				DESYNC(x, y);
 
-				*rgba = _palette[index];
+				read_unsafe(x, reader);
 			}
 
-			++rgba;
+			//// THIS IS THE INNER LOOP ////
+
+			// Unroll x = _xsize - 1
+			if (x < xmask) {
+				DESYNC(x, y);
+
+				read_safe(x, reader);
+				++x;
+			}
+
+			// Look up colors for the span just read
+			lookupSpan(rgba + xstart, indices + xstart, x - xstart);
+
+			if (x >= xend) {
+				break;
+			}
+
+			maskRun(rgba + x, x, run->len);
+			x += run->len;
 		}
+
+		_output->writeRow(y, reinterpret_cast<const u8 *>( rgba ));
 	}
 
 #else
 
-	for (int y = 0, yend = _ysize; y < yend; ++y) {
+	for (int y = 0, yend = _output->getRowEnd(); y < yend; ++y) {
 		_mono_decoder.readRowHeader(y, reader);
 
-		const u32 *mask_next = _mask->nextScanline();
-		int mask_left = 0;
-		u32 mask;
+		u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( _output->getRows(y, 1) );
+		const u8 * CAT_RESTRICT indices = _mono_decoder.currentRow();
+		const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		for (int x = 0, xend = _xsize; x < xend; ++x) {
-			DESYNC(x, y);
+		for (int x = 0;; ++run) {
+			const int xstart = x;
 
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
-			}
+			// Read up to the next masked run
+			for (const int xmask = run->x; x < xmask; ++x) {
+				DESYNC(x, y);
 
-			if ((s32)mask < 0) {
-				*rgba = MASK_COLOR;
-				u8 *p = _mono_decoder.currentRow() + x;
-				*p = MASK_PAL;
-				_mono_decoder.zero(x);
-			} else {
-				u8 index = read_safe(x, reader);
+				read_safe(x, reader);
+			}
 
-				CAT_DEBUG_ENFORCE(index < _palette_size);
+			lookupSpan(rgba + xstart, indices + xstart, x - xstart);
 
-				*rgba = _palette[index];
+			if (x >= xend) {
+				break;
 			}
 
-			++rgba;
-			mask <<= 1;
+			maskRun(rgba + x, x, run->len);
+			x += run->len;
 		}
+
+		_output->writeRow(y, reinterpret_cast<const u8 *>( rgba ));
 	}
 
 #endif
@@ -329,7 +447,7 @@ int ImagePaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 	return GCIF_RE_OK;
 }
 
-int ImagePaletteReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT mask, GCIFImage * CAT_RESTRICT image) {
+int ImagePaletteReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT mask, ImageOutput & CAT_RESTRICT output) {
 #ifdef CAT_COLLECT_STATS
 	m_clock = Clock::ref();
 
@@ -350,15 +468,26 @@ int ImagePaletteReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader
 	double t1 = m_clock->usec();
 #endif // CAT_COLLECT_STATS
 
-	_rgba = image->rgba;
-	_xsize = image->xsize;
-	_ysize = image->ysize;
+	_output = &output;
+	_xsize = output.getXSize();
+	_ysize = output.getYSize();
 	_mask = &mask;
+	_mask_color = mask.getColor();
+
+	// If the output format can be written from the palette, convert it once
+	if (output.usePalette()) {
+		output.convertColors(_palette, _palette_size);
+		output.convertColors(&_mask_color, 1);
+	}
+
+	initLookup();
 
 	if ((err = readTables(reader))) {
 		return err;
 	}
 
+	reader.markSection(GCIF_SECTION_TABLES);
+
 #ifdef CAT_COLLECT_STATS
 	double t2 = m_clock->usec();
 #endif // CAT_COLLECT_STATS
@@ -367,6 +496,8 @@ int ImagePaletteReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader
 		return err;
 	}
 
+	reader.markSection(GCIF_SECTION_PIXELS);
+
 #ifdef CAT_COLLECT_STATS
 	double t3 = m_clock->usec();
 
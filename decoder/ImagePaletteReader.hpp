@@ -32,8 +32,10 @@
 #include "ImageReader.hpp"
 #include "Enforcer.hpp"
 #include "MonoReader.hpp"
+#include "EntropyDecoder.hpp"
 #include "ImageMaskReader.hpp"
 #include "SmartArray.hpp"
+#include "ImageOutput.hpp"
 
 /*
  * Game Closure Global Palette Decompression
@@ -49,23 +51,40 @@ public:
 	static const int PALETTE_MAX = 256;
 	static const int ENCODER_ZRLE_SYMS = 16;
 	static const int HUFF_LUT_BITS = 7;
+	static const int MULTI_LUT_BITS = 10;
 
 protected:
 	u32 _palette[PALETTE_MAX];
 	int _palette_size;
 	u8 _mask_palette;	// Masked palette index
+	u32 _mask_color;	// Masked color in output format
+
+	// Palette split into byte planes for shuffle lookups, if 16 colors or less
+	u8 _palette_planes[4][16];
+	bool _use_planes;	// SSSE3 shuffle lookups
+	bool _use_gather;	// AVX2 gather lookups for larger palettes
 
 	ImageMaskReader * CAT_RESTRICT _mask;
 
-	u8 * CAT_RESTRICT _rgba;
+	ImageOutput * CAT_RESTRICT _output;
 	u16 _xsize, _ysize;
 
 	SmartArray<u8> _image;
 
+	EntropyDecoder _palette_decoder;
 	MonoReader _mono_decoder;
 
 	int readPalette(ImageReader & CAT_RESTRICT reader);
 	int readTables(ImageReader & CAT_RESTRICT reader);
+	// Fill a run of masked pixels
+	void maskRun(u32 * CAT_RESTRICT rgba, int x, int len);
+
+	// Set up palette lookups once the palette is in the output format
+	void initLookup();
+
+	// Look up the colors for a span of palette indices
+	void lookupSpan(u32 * CAT_RESTRICT rgba, const u8 * CAT_RESTRICT indices, int len);
+
 	int readPixels(ImageReader & CAT_RESTRICT reader);
 
 #ifdef CAT_COLLECT_STATS
@@ -84,7 +103,21 @@ public:
 		return _palette_size > 0;
 	}
 
-	int read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT mask, GCIFImage * CAT_RESTRICT image);
+	CAT_INLINE int getPaletteSize() {
+		return _palette_size;
+	}
+
+	// Pixels copied by LZ matches
+	CAT_INLINE int getLZCount() {
+		return _mono_decoder.getLZCount();
+	}
+
+	// Read just the palette header without decoding any pixels
+	CAT_INLINE int readInfo(ImageReader & CAT_RESTRICT reader) {
+		return readPalette(reader);
+	}
+
+	int read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT mask, ImageOutput & CAT_RESTRICT output);
 
 #ifdef CAT_COLLECT_STATS
 	bool dumpStats();
@@ -52,6 +52,16 @@ static cat::Clock *m_clock = 0;
 
 //// ImageRGBAReader
 
+ImageRGBAReader::ImageRGBAReader() {
+#ifdef CAT_COMPILE_THREADS
+	_pipe_jobs = 0;
+	_pipe_pool = 0;
+	_pipe_threads = 1;
+	_pipelined = false;
+	_wavefront = false;
+#endif // CAT_COMPILE_THREADS
+}
+
 int ImageRGBAReader::readFilterTables(ImageReader & CAT_RESTRICT reader) {
 	int err;
 
@@ -87,6 +97,7 @@ int ImageRGBAReader::readFilterTables(ImageReader & CAT_RESTRICT reader) {
 		}
 
 		_sf[ii] = RGBA_FILTERS[sf];
+		_sf_row[ii] = RGBA_ROW_FILTERS[sf];
 	}
 
 	DESYNC_TABLE();
@@ -143,11 +154,8 @@ int ImageRGBAReader::readRGBATables(ImageReader & CAT_RESTRICT reader) {
 
 	// Read alpha decoder
 	{
-		const int pixel_count = _xsize * _ysize;
-		_a_tiles.resize(pixel_count);
-
 		MonoReader::Parameters params;
-		params.data = _a_tiles.get();
+		params.data = 0; // Set by initAlphaWindow()
 		params.xsize = _xsize;
 		params.ysize = _ysize;
 		params.num_syms = 256;
@@ -174,20 +182,20 @@ int ImageRGBAReader::readRGBATables(ImageReader & CAT_RESTRICT reader) {
 
 	// For each chaos level,
 	for (int jj = 0; jj < chaos_levels; ++jj) {
-		// Read the decoder tables
-		if CAT_UNLIKELY(!_y_decoder[jj].init(NUM_Y_SYMS, NUM_ZRLE_SYMS, HUFF_LUT_BITS, reader)) {
+		// Read the decoder tables, sharing any repeated from lower levels
+		if CAT_UNLIKELY(!_y_decoder[jj].init(NUM_Y_SYMS, NUM_ZRLE_SYMS, HUFF_LUT_BITS, reader, _y_decoder, jj)) {
 			CAT_DEBUG_EXCEPTION();
 			return GCIF_RE_BAD_RGBA;
 		}
 		DESYNC_TABLE();
 
-		if CAT_UNLIKELY(!_u_decoder[jj].init(NUM_U_SYMS, NUM_ZRLE_SYMS, HUFF_LUT_BITS, reader)) {
+		if CAT_UNLIKELY(!_u_decoder[jj].init(NUM_U_SYMS, NUM_ZRLE_SYMS, HUFF_LUT_BITS, reader, _u_decoder, jj)) {
 			CAT_DEBUG_EXCEPTION();
 			return GCIF_RE_BAD_RGBA;
 		}
 		DESYNC_TABLE();
 
-		if CAT_UNLIKELY(!_v_decoder[jj].init(NUM_V_SYMS, NUM_ZRLE_SYMS, HUFF_LUT_BITS, reader)) {
+		if CAT_UNLIKELY(!_v_decoder[jj].init(NUM_V_SYMS, NUM_ZRLE_SYMS, HUFF_LUT_BITS, reader, _v_decoder, jj)) {
 			CAT_DEBUG_EXCEPTION();
 			return GCIF_RE_BAD_RGBA;
 		}
@@ -204,191 +212,419 @@ int ImageRGBAReader::readRGBATables(ImageReader & CAT_RESTRICT reader) {
 	return GCIF_RE_OK;
 }
 
-CAT_INLINE void ImageRGBAReader::readSafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader, u32 &mask, const u32 * CAT_RESTRICT &mask_next, int &mask_left, const u32 MASK_COLOR, const u8 MASK_ALPHA) {
+template<bool CONST_ALPHA>
+CAT_INLINE void ImageRGBAReader::readSafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader) {
 	DESYNC(x, y);
 
-#ifndef CAT_DISABLE_MASK
-	// Next mask word
-	if (mask_left <= 0) {
-		mask = *mask_next++;
-		mask_left = 32;
-	}
+	// Calculate YUV chaos
+	u8 cy, cu, cv;
+	_chaos.get(x, cy, cu, cv);
 
-	if ((s32)mask < 0) {
-		*reinterpret_cast<u32 *>( p ) = MASK_COLOR;
-		u8 * CAT_RESTRICT Ap = _a_decoder.currentRow() + x;
-		*Ap = MASK_ALPHA;
-		_chaos.zero(x);
-		_a_decoder.zero(x);
+	u16 pixel_code = _y_decoder[cy].next(reader); 
+
+	// If it is an LZ escape code,
+	if (pixel_code >= 256) {
+		int len = readLZMatch(pixel_code, reader, x, p);
+		CAT_DEBUG_ENFORCE(len >= 2);
+		DESYNC(x, y);
+
+		// Move pointers ahead
+		p += len << 2;
+		x += len;
 	} else {
-#endif
-		// Calculate YUV chaos
-		u8 cy, cu, cv;
-		_chaos.get(x, cy, cu, cv);
+		// Read YUV
+		u8 YUV[3];
+		YUV[0] = (u8)pixel_code;
+		YUV[1] = (u8)_u_decoder[cu].next(reader);
+		YUV[2] = (u8)_v_decoder[cv].next(reader);
+
+		// Read alpha pixel
+		if (CONST_ALPHA) {
+			p[3] = _a_value;
+		} else {
+			p[3] = (u8)~_a_decoder_read_safe(x, reader);
+		}
 
-		u16 pixel_code = _y_decoder[cy].next(reader); 
+		DESYNC(x, y);
 
-		// If it is an LZ escape code,
-		if (pixel_code >= 256) {
-			int len = readLZMatch(pixel_code, reader, x, p);
-			CAT_DEBUG_ENFORCE(len >= 2);
-			DESYNC(x, y);
+		// Read filter for the tile if needed
+		readFilter(x, y, reader);
 
-			// Move pointers ahead
-			p += len << 2;
-			x += len;
+		// Filters are reversed for the whole row at once later
+		p[0] = YUV[0];
+		p[1] = YUV[1];
+		p[2] = YUV[2];
+		addFilteredPixel(x);
 
-#ifndef CAT_DISABLE_MASK
-			// Move mask ahead
-			if (len >= mask_left) {
-				len -= mask_left;
+		_chaos.store(x, YUV);
 
-				// Remove mask multiples
-				mask_next += len >> 5;
-				len &= 31;
+		p += 4;
+		++x;
+	}
+}
 
-				mask = *mask_next++;
-				mask_left = 32;
-			}
-			mask <<= len;
-			mask_left -= len;
-#endif
+template<bool CONST_ALPHA>
+CAT_INLINE void ImageRGBAReader::readUnsafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader) {
+	DESYNC(x, y);
+
+	// Calculate YUV chaos
+	u8 cy, cu, cv;
+	_chaos.get(x, cy, cu, cv);
+
+	u16 pixel_code = _y_decoder[cy].next(reader); 
+
+	// If it is an LZ escape code,
+	if (pixel_code >= 256) {
+		int len = readLZMatch(pixel_code, reader, x, p);
+		CAT_DEBUG_ENFORCE(len >= 2);
+		DESYNC(x, y);
 
-			return;
+		// Move pointers ahead
+		p += len << 2;
+		x += len;
+	} else {
+		// Read YUV
+		u8 YUV[3];
+		YUV[0] = (u8)pixel_code;
+		YUV[1] = (u8)_u_decoder[cu].next(reader);
+		YUV[2] = (u8)_v_decoder[cv].next(reader);
+
+		// Read alpha pixel
+		if (CONST_ALPHA) {
+			p[3] = _a_value;
 		} else {
-			// Read YUV
-			u8 YUV[3];
-			YUV[0] = (u8)pixel_code;
-			YUV[1] = (u8)_u_decoder[cu].next(reader);
-			YUV[2] = (u8)_v_decoder[cv].next(reader);
+			p[3] = (u8)~_a_decoder_read_unsafe(x, reader);
+		}
 
-			// Read alpha pixel
-			p[3] = (u8)~_a_decoder_read_safe(x, reader);
+		DESYNC(x, y);
 
-			DESYNC(x, y);
+		// Read filter for the tile if needed
+		readFilter(x, y, reader);
 
-			FilterSelection *filter = readFilter(x, y, reader);
+		// Filters are reversed for the whole row at once later
+		p[0] = YUV[0];
+		p[1] = YUV[1];
+		p[2] = YUV[2];
+		addFilteredPixel(x);
 
-			// Reverse color filter
-			filter->cf(YUV, p);
+		_chaos.store(x, YUV);
 
-			// Reverse spatial filter
-			u8 FPT[3];
-			const u8 * CAT_RESTRICT pred = filter->sf.safe(p, FPT, x, y, _xsize);
-			p[0] += pred[0];
-			p[1] += pred[1];
-			p[2] += pred[2];
+		p += 4;
+		++x;
+	}
+}
 
-			_chaos.store(x, YUV);
-		}
-#ifndef CAT_DISABLE_MASK
+CAT_INLINE void ImageRGBAReader::maskRun(u16 x, u16 len, u8 * CAT_RESTRICT p, const u32 MASK_COLOR, const u8 MASK_ALPHA) {
+	u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( p );
+
+	for (int ii = 0; ii < len; ++ii) {
+		rgba[ii] = MASK_COLOR;
 	}
 
-	--mask_left;
-	mask <<= 1;
-#endif
-	p += 4;
-	++x;
+	memset(_a_decoder.currentRow() + x, MASK_ALPHA, len);
+
+	_chaos.zeroRegion(x, len);
+	_a_decoder.zeroRegion(x, len);
 }
 
-CAT_INLINE void ImageRGBAReader::readUnsafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader, u32 &mask, const u32 * CAT_RESTRICT &mask_next, int &mask_left, const u32 MASK_COLOR, const u8 MASK_ALPHA) {
-	DESYNC(x, y);
+CAT_INLINE void ImageRGBAReader::finishRow(const u16 y) {
+#ifdef CAT_COMPILE_THREADS
+	// If another thread is reconstructing rows,
+	if (_pipelined) {
+		pushRow(y);
+		return;
+	}
+#endif // CAT_COMPILE_THREADS
 
-#ifndef CAT_DISABLE_MASK
-	// Next mask word
-	if (mask_left <= 0) {
-		mask = *mask_next++;
-		mask_left = 32;
+	reconstructRow<false>(y, _row_spans, _span_count, _filters.get());
+}
+
+template<bool CONST_ALPHA, bool SAFE>
+void ImageRGBAReader::readScanline(const u16 y, ImageReader & CAT_RESTRICT reader, const u32 MASK_COLOR, const u8 MASK_ALPHA) {
+	const u16 xsize = _xsize;
+
+	// If the row is past the end of the window, slide it down
+	if CAT_UNLIKELY(y - _window_y >= _window_rows) {
+		slideWindow(y);
 	}
 
-	if ((s32)mask < 0) {
-		*reinterpret_cast<u32 *>( p ) = MASK_COLOR;
-		u8 * CAT_RESTRICT Ap = _a_decoder.currentRow() + x;
-		*Ap = MASK_ALPHA;
-		_chaos.zero(x);
-		_a_decoder.zero(x);
-	} else {
-#endif
-		// Calculate YUV chaos
-		u8 cy, cu, cv;
-		_chaos.get(x, cy, cu, cv);
+	u8 * CAT_RESTRICT p = getRow(y);
+	u16 x = 0;
 
-		u16 pixel_code = _y_decoder[cy].next(reader); 
+	// Read mask scanline
+	const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		// If it is an LZ escape code,
-		if (pixel_code >= 256) {
-			int len = readLZMatch(pixel_code, reader, x, p);
-			CAT_DEBUG_ENFORCE(len >= 2);
-			DESYNC(x, y);
+	_span_count = 0;
 
-			// Move pointers ahead
-			p += len << 2;
-			x += len;
+	while (x < xsize) {
+		const u16 xmask = run->x;
 
-			// Move mask ahead
-			if (len >= mask_left) {
-				len -= mask_left;
+		// If there are pixels to read before the next masked run,
+		if (x < xmask) {
+			if (SAFE) {
+				do {
+					readSafe<CONST_ALPHA>(x, y, p, reader);
+				} while (x < xmask);
+			} else {
+				// Unroll x = 0 pixel
+				if (x == 0) {
+					readSafe<CONST_ALPHA>(x, y, p, reader);
+				}
 
-				// Remove mask multiples
-				mask_next += len >> 5;
-				len &= 31;
+				// For each pixel away from the edges,
+				const u16 xunsafe = xmask < xsize - 1 ? xmask : xsize - 1;
+				while (x < xunsafe) {
+					readUnsafe<CONST_ALPHA>(x, y, p, reader);
+				}
 
-				mask = *mask_next++;
-				mask_left = 32;
+				// For right image edge,
+				if (x < xmask) {
+					readSafe<CONST_ALPHA>(x, y, p, reader);
+				}
 			}
-			mask <<= len;
-			mask_left -= len;
 
-			return;
-		} else {
-			// Read YUV
-			u8 YUV[3];
-			YUV[0] = (u8)pixel_code;
-			YUV[1] = (u8)_u_decoder[cu].next(reader);
-			YUV[2] = (u8)_v_decoder[cv].next(reader);
+			// LZ matches may have run into or past the masked run
+			continue;
+		}
 
-			// Read alpha pixel
-			p[3] = (u8)~_a_decoder_read_unsafe(x, reader);
+		const u16 xrun_end = xmask + run->len;
+
+		// Masked pixels that LZ ran over are counted as masked
+		if CAT_UNLIKELY(x > xmask) {
+			_lz_count -= (x < xrun_end ? x : xrun_end) - xmask;
+		}
+
+		// Fill the part of the masked run that LZ did not already cover
+		if (x < xrun_end) {
+			const u16 len = xrun_end - x;
 
-			DESYNC(x, y);
+			maskRun(x, len, p, MASK_COLOR, MASK_ALPHA);
 
-			FilterSelection *filter = readFilter(x, y, reader);
+			p += len << 2;
+			x = xrun_end;
+		}
 
-			// Reverse color filter
-			filter->cf(YUV, p);
+		++run;
+	}
+
+	// Masked runs left over were all run over by LZ to the end of the row
+	for (; run->x < xsize; ++run) {
+		_lz_count -= run->len;
+	}
+
+	finishRow(y);
+}
+
+template<bool WAVE>
+void ImageRGBAReader::reconstructRun(u16 x, u16 len, const u16 y, const FilterSelection * CAT_RESTRICT filters, u32 &above) {
+	const int xsize = _xsize;
+	u8 * CAT_RESTRICT p = getRow(y) + x * 4;
+
+	// For each tile the run touches,
+	while (len > 0) {
+		const FilterSelection * CAT_RESTRICT filter = &filters[x >> _tile_bits_x];
+		const u16 tile_end = (x | _tile_mask_x) + 1;
+		const u16 count = tile_end - x < len ? tile_end - x : len;
+		const u16 xend = x + count;
+
+#ifdef CAT_COMPILE_THREADS
+		if (WAVE) {
+			waitAbove(y, xend, above);
+		}
+#endif // CAT_COMPILE_THREADS
+
+		// Reverse color filter
+		filter->cf(p, count);
+
+		// Reverse spatial filter
+		u16 xi = x;
+
+		// If not on the first row,
+		if (y > 0) {
+			// Left edge
+			if (xi == 0) {
+				u8 FPT[3];
+				const u8 * CAT_RESTRICT pred = filter->sf.safe(p, FPT, xi, y, xsize);
+				p[0] += pred[0];
+				p[1] += pred[1];
+				p[2] += pred[2];
+				p += 4;
+				++xi;
+			}
 
-			// Reverse spatial filter
+			// Interior: One call for the span
+			const u16 xinner = xend < xsize ? xend : xsize - 1;
+			if (xi < xinner) {
+				const int inner = xinner - xi;
+
+				filter->sf_row(p, inner, xi, y, xsize);
+				p += inner * 4;
+				xi = xinner;
+			}
+		}
+
+		// First row and right edge
+		for (; xi < xend; ++xi, p += 4) {
 			u8 FPT[3];
-			const u8 * CAT_RESTRICT pred = filter->sf.unsafe(p, FPT, x, y, _xsize);
+			const u8 * CAT_RESTRICT pred = filter->sf.safe(p, FPT, xi, y, xsize);
 			p[0] += pred[0];
 			p[1] += pred[1];
 			p[2] += pred[2];
+		}
 
-			_chaos.store(x, YUV);
+#ifdef CAT_COMPILE_THREADS
+		if (WAVE) {
+			RowPipeline::storeProgress(_row_progress.get() + y, xend);
 		}
-#ifndef CAT_DISABLE_MASK
+#endif // CAT_COMPILE_THREADS
+
+		x = xend;
+		len -= count;
 	}
+}
 
-	--mask_left;
-	mask <<= 1;
-#endif
-	p += 4;
-	++x;
+template<bool WAVE>
+void ImageRGBAReader::reconstructRow(const u16 y, const RowSpan * CAT_RESTRICT span, int span_count, const FilterSelection * CAT_RESTRICT filters) {
+	u32 * CAT_RESTRICT row = reinterpret_cast<u32 *>( getRow(y) );
+	u32 above = 0;
+
+	// For each span in order,
+	for (int ii = 0; ii < span_count; ++ii, ++span) {
+		const u32 dist = span->dist;
+
+		if (dist == 0) {
+			reconstructRun<WAVE>(span->x, span->len, y, filters, above);
+		} else {
+#ifdef CAT_COMPILE_THREADS
+			if (WAVE) {
+				waitAbove(y, span->x + span->len, above);
+				waitCopySource(y, span->x, dist, span->len);
+			}
+#endif // CAT_COMPILE_THREADS
+
+			LZReader::copyPixels(row + span->x, dist, span->len);
+
+#ifdef CAT_COMPILE_THREADS
+			if (WAVE) {
+				RowPipeline::storeProgress(_row_progress.get() + y, span->x + span->len);
+			}
+#endif // CAT_COMPILE_THREADS
+		}
+	}
+
+#ifdef CAT_COMPILE_THREADS
+	// Masked pixels after the last span were written by the reader
+	if (WAVE) {
+		waitAbove(y, _xsize, above);
+		RowPipeline::storeProgress(_row_progress.get() + y, _xsize);
+	}
+#endif // CAT_COMPILE_THREADS
+
+	// Hand the finished row to the output
+	_output->writeRow(y, reinterpret_cast<const u8 *>( row ));
+}
+
+void ImageRGBAReader::findConstants() {
+	u8 value;
+	bool predicted;
+
+	// Nothing is written to the filter planes outside of the reads
+	_sf_const = _sf_decoder.isConstant(_sf_value, predicted);
+	_cf_const = _cf_decoder.isConstant(_cf_value, predicted);
+
+	// Masked pixels write their alpha into the plane, so a predicted
+	// constant only holds if it matches the mask alpha
+	const u8 MASK_ALPHA = (u8)~(getLE(_mask->getColor()) >> 24);
+
+	_a_const = _a_decoder.isConstant(value, predicted) &&
+		(!predicted || !_mask->enabled() || value == MASK_ALPHA);
+	_a_value = (u8)~value;
 }
 
+int ImageRGBAReader::getLZRows() {
+	if (!usesLZ()) {
+		return 0;
+	}
+
+	bool use_short = false, use_long = false;
+	for (int ii = 0, iiend = _chaos.getBinCount(); ii < iiend; ++ii) {
+		use_short |= _y_decoder[ii].hasSymbolIn(NUM_LIT_SYMS + LZReader::ESC_DIST_SHORT_2, NUM_LIT_SYMS + LZReader::ESC_DIST_LONG_2);
+		use_long |= _y_decoder[ii].hasSymbolIn(NUM_LIT_SYMS + LZReader::ESC_DIST_LONG_2, NUM_Y_SYMS);
+	}
+
+	// Rows above the current one that an LZ source can start in
+	const u32 dist = _lz.getMaxDist(use_short, use_long);
+	return (dist + _xsize - 1) / _xsize;
+}
+
+void ImageRGBAReader::initAlphaWindow() {
+	const int yend = _output->getRowEnd();
+
+	int history = _a_decoder.getHistoryRows();
+
+	// If RGBA LZ matches are used, they also copy alpha from their source
+	const int lz_rows = getLZRows();
+	if (history < lz_rows) {
+		history = lz_rows;
+	}
+
+	// Decode at least ALPHA_SLIDE_ROWS rows between moving the history down
+	int rows = history + (history > ALPHA_SLIDE_ROWS ? history : ALPHA_SLIDE_ROWS);
+
+	// If the window would not save anything, use the full plane
+	if (rows >= yend) {
+		rows = yend;
+	}
+
+	_a_tiles.resize(_xsize * rows);
+	_a_decoder.setWindow(_a_tiles.get(), rows, history);
+}
+
+void ImageRGBAReader::initWindow(int slide_rows) {
+	int history = RGBA_FILTER_ROWS;
+
+	const int lz_rows = getLZRows();
+	if (history < lz_rows) {
+		history = lz_rows;
+	}
+
+	// Decode at least slide_rows rows between moving the history down
+	int rows = history + (history > slide_rows ? history : slide_rows);
+
+	_rgba = _output->getWindow(rows);
+	_window_rows = rows;
+	_window_history = history;
+	_window_y = 0;
+}
+
+void ImageRGBAReader::slideWindow(const u16 y) {
+#ifdef CAT_COMPILE_THREADS
+	// Rows handed to other threads are reconstructed in the window
+	if (_pipelined) {
+		_pipe.drain();
+	}
+#endif // CAT_COMPILE_THREADS
+
+	const int history = _window_history;
+
+	memmove(_rgba, getRow(y - history), history * _xsize * 4);
+
+	_window_y = y - history;
+}
+
+template<bool CONST_ALPHA>
 int ImageRGBAReader::readPixels(ImageReader & CAT_RESTRICT reader) {
-	const int xsize = _xsize;
+	const u16 yend = _output->getRowEnd();
 	const u32 MASK_COLOR = _mask->getColor();
 	const u8 MASK_ALPHA = (u8)~(getLE(MASK_COLOR) >> 24);
 
 	_chaos.start();
 
+	_row_spans = _spans.get();
+
 	_cf_decoder.setupUnordered();
 	_sf_decoder.setupUnordered();
 
-	// Start from upper-left of image
-	u8 * CAT_RESTRICT p = _rgba;
-
 #ifdef CAT_UNROLL_READER
 
 	// Unroll y = 0 scanline
@@ -404,20 +640,12 @@ int ImageRGBAReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 
 		_a_decoder.readRowHeader(y, reader);
 
-		// Read mask scanline
-		const u32 * CAT_RESTRICT mask_next = _mask->nextScanline();
-		int mask_left = 32;
-		u32 mask = *mask_next++;
-
-		// For each pixel,
-		for (u16 x = 0; x < xsize;) {
-			readSafe(x, y, p, reader, mask, mask_next, mask_left, MASK_COLOR, MASK_ALPHA);
-		}
+		readScanline<CONST_ALPHA, true>(y, reader, MASK_COLOR, MASK_ALPHA);
 	}
 
 
-	// For each scanline,
-	for (u16 y = 1; y < _ysize; ++y) {
+	// For each scanline up to the last one needed,
+	for (u16 y = 1; y < yend; ++y) {
 		// If it is time to clear the filters data,
 		if ((y & _tile_mask_y) == 0) {
 			// Zero filter holes
@@ -440,30 +668,13 @@ int ImageRGBAReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 
 		_a_decoder.readRowHeader(y, reader);
 
-		// Read mask scanline
-		const u32 * CAT_RESTRICT mask_next = _mask->nextScanline();
-		int mask_left = 32;
-		u32 mask = *mask_next++;
-
-		// Unroll x = 0 pixel
-		u16 x = 0;
-		readSafe(x, y, p, reader, mask, mask_next, mask_left, MASK_COLOR, MASK_ALPHA);
-
-		// For each pixel,
-		for (u16 xend = xsize - 1; x < xend;) {
-			readUnsafe(x, y, p, reader, mask, mask_next, mask_left, MASK_COLOR, MASK_ALPHA);
-		}
-
-		// For right image edge,
-		if (x < xsize) {
-			readSafe(x, y, p, reader, mask, mask_next, mask_left, MASK_COLOR, MASK_ALPHA);
-		}
+		readScanline<CONST_ALPHA, false>(y, reader, MASK_COLOR, MASK_ALPHA);
 	}
 
 #else
 
-	// For each row,
-	for (u16 y = 0; y < _ysize; ++y) {
+	// For each row up to the last one needed,
+	for (u16 y = 0; y < yend; ++y) {
 		// If it is time to clear the filters data,
 		if ((y & _tile_mask_y) == 0) {
 			if (y > 0) {
@@ -488,15 +699,7 @@ int ImageRGBAReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 
 		_a_decoder.readRowHeader(y, reader);
 
-		// Read mask scanline
-		const u32 * CAT_RESTRICT mask_next = _mask->nextScanline();
-		int mask_left = 32;
-		u32 mask = *mask_next++;
-
-		// For each pixel,
-		for (u16 x = 0; x < xsize;) {
-			readSafe(x, y, p, reader, mask, mask_next, mask_left, MASK_COLOR, MASK_ALPHA);
-		}
+		readScanline<CONST_ALPHA, true>(y, reader, MASK_COLOR, MASK_ALPHA);
 	}
 
 #endif
@@ -504,6 +707,110 @@ int ImageRGBAReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 	return GCIF_RE_OK;
 }
 
+int ImageRGBAReader::readRows(ImageReader & CAT_RESTRICT reader) {
+	if (_a_const) {
+		return readPixels<true>(reader);
+	} else {
+		return readPixels<false>(reader);
+	}
+}
+
+#ifdef CAT_COMPILE_THREADS
+
+void ImageRGBAReader::waitCopySource(const u16 y, const u16 x, const u32 dist, const u16 len) {
+	const u32 xsize = _xsize;
+	const u32 dest = y * xsize + x;
+	const u32 start = dest - dist;
+
+	// Source pixels from the destination on are written by the copy itself
+	const u32 last = (dist < len ? dest : start + len) - 1;
+	const u32 sy = start / xsize, ly = last / xsize;
+
+	const volatile u32 *progress = _row_progress.get();
+
+	// If the source runs across rows, all but its last row must be finished
+	if (sy < ly) {
+		RowPipeline::waitProgress(progress + ly - 1, xsize);
+	}
+
+	// If the source ends in a row above, wait for that row to get past it
+	if (ly < y) {
+		RowPipeline::waitProgress(progress + ly, last - ly * xsize + 1);
+	}
+}
+
+void ImageRGBAReader::pushRow(const u16 y) {
+	const int slot = _pipe.getSlot(y);
+
+	// Keep the filters for the row, which may change under the next tile row
+	_pipe_span_counts[slot] = _span_count;
+	memcpy(_pipe_filters.get() + slot * _tiles_x, _filters.get(), _tiles_x * sizeof(FilterSelection));
+
+	// Hand it over, waiting for the next slot to be free
+	_pipe.push();
+
+	_row_spans = _spans.get() + _pipe.getSlot(y + 1) * _xsize;
+}
+
+void ImageRGBAReader::PipeProduce(void *data) {
+	ImageRGBAReader *rgba = reinterpret_cast<ImageRGBAReader *>( data );
+
+	rgba->_pipe_err = rgba->readRows(*rgba->_pipe_reader);
+}
+
+void ImageRGBAReader::PipeConsume(void *data, int row) {
+	ImageRGBAReader *rgba = reinterpret_cast<ImageRGBAReader *>( data );
+	const int slot = rgba->_pipe.getSlot(row);
+
+	const RowSpan * CAT_RESTRICT spans = rgba->_spans.get() + slot * rgba->_xsize;
+	const int span_count = rgba->_pipe_span_counts[slot];
+	const FilterSelection * CAT_RESTRICT filters = rgba->_pipe_filters.get() + slot * rgba->_tiles_x;
+
+	if (rgba->_wavefront) {
+		rgba->reconstructRow<true>((u16)row, spans, span_count, filters);
+	} else {
+		rgba->reconstructRow<false>((u16)row, spans, span_count, filters);
+	}
+}
+
+void ImageRGBAReader::PipeJob(void *data, int job_index, int thread_index) {
+	ImageRGBAReader *rgba = reinterpret_cast<ImageRGBAReader *>( data );
+
+	rgba->_pipe.run();
+}
+
+int ImageRGBAReader::readPipelined(ImageReader & CAT_RESTRICT reader) {
+	// With more than one thread reconstructing, run them as a wavefront
+	_wavefront = _pipe_threads > 2;
+
+	// Leave the wavefront a few rows for each thread
+	const int slots = _pipe_threads * 4 > PIPE_ROWS ? _pipe_threads * 4 : PIPE_ROWS;
+
+	// Every slide waits for the ring to empty, so leave room for a few rings
+	initWindow(slots * 4);
+
+	_spans.resize(_xsize * slots);
+	_pipe_span_counts.resize(slots);
+	_pipe_filters.resize(_tiles_x * slots);
+
+	if (_wavefront) {
+		_row_progress.resize(_output->getRowEnd());
+		_row_progress.fill_00();
+	}
+
+	_pipe_reader = &reader;
+	_pipe_err = GCIF_RE_OK;
+	_pipe.start(slots, PipeProduce, PipeConsume, this, _wavefront);
+
+	_pipelined = true;
+	_pipe_jobs(_pipe_pool, _pipe_threads, PipeJob, this);
+	_pipelined = false;
+
+	return _pipe_err;
+}
+
+#endif // CAT_COMPILE_THREADS
+
 int ImageRGBAReader::readLZMatch(u16 pixel_code, ImageReader & CAT_RESTRICT reader, int x, u8 * CAT_RESTRICT p) {
 	// Decode LZ bitstream
 	u32 dist, len;
@@ -515,66 +822,54 @@ int ImageRGBAReader::readLZMatch(u16 pixel_code, ImageReader & CAT_RESTRICT read
 	// Calculate source address of copy
 	const u32 * CAT_RESTRICT src = reinterpret_cast<const u32 * CAT_RESTRICT>( p );
 
-	// If LZ copy source is invalid,
+	// If LZ copy source is invalid or has already left the window,
 	if CAT_UNLIKELY(src < reinterpret_cast<const u32 * CAT_RESTRICT>( _rgba ) + dist) {
 		// Unfortunately need to add dist twice to avoid pointer wrap around near 0
 		CAT_DEBUG_EXCEPTION();
 		return GCIF_RE_LZ_BAD;
 	}
 
-	src -= dist;
-
-	u32 * CAT_RESTRICT dst = reinterpret_cast<u32 * CAT_RESTRICT>( p );
-	CAT_DEBUG_ENFORCE(src < dst);
-
 	// If LZ destination is invalid,
 	if CAT_UNLIKELY(x + len > _xsize) {
 		CAT_DEBUG_EXCEPTION();
 		return GCIF_RE_LZ_BAD;
 	}
 
-	// Calculate destination address for alpha
-	u8 * CAT_RESTRICT Ap_dst = _a_decoder.currentRow() + x;
-	const u8 * CAT_RESTRICT Ap_src = Ap_dst - dist;
-
-	// Copy blocks at a time
-	int copy = len;
-	while (copy >= 4) {
-		dst[0] = src[0];
-		dst[1] = src[1];
-		dst[2] = src[2];
-		dst[3] = src[3];
-		dst += 4;
-		src += 4;
-		Ap_dst[0] = Ap_src[0];
-		Ap_dst[1] = Ap_src[1];
-		Ap_dst[2] = Ap_src[2];
-		Ap_dst[3] = Ap_src[3];
-		Ap_dst += 4;
-		Ap_src += 4;
-		copy -= 4;
-	}
-
-	// Copy words at a time
-	while (copy > 0) {
-		dst[0] = src[0];
-		++dst;
-		++src;
-		Ap_dst[0] = Ap_src[0];
-		++Ap_dst;
-		++Ap_src;
-		--copy;
+	// Start loading the RGBA source, which is copied at the end of the row
+	LZReader::prefetch(p - dist * 4, len * 4);
+
+	u8 * CAT_RESTRICT a = _a_decoder.currentRow() + x;
+
+	// If the alpha source has already left the window,
+	if CAT_UNLIKELY(a < _a_tiles.get() + dist) {
+		CAT_DEBUG_EXCEPTION();
+		return GCIF_RE_LZ_BAD;
+	}
+
+	// Copy alpha now since the alpha decoder predicts from it
+	LZReader::copyBytes(a, dist, len);
+
+	// Copy RGBA once the pixels before it in the row are reconstructed.
+	// A zero distance from an unset recent distance copies nothing, and must
+	// not be recorded since it would look like a run of filtered pixels
+	if CAT_LIKELY(dist != 0) {
+		RowSpan * CAT_RESTRICT span = _row_spans + _span_count++;
+		span->x = x;
+		span->len = len;
+		span->dist = dist;
 	}
 
 	// Execute remaining chaos zeroing
 	_chaos.zeroRegion(x, len);
 	_a_decoder.zeroRegion(x, len);
 
+	_lz_count += len;
+
 	// Return match length
 	return len;
 }
 
-int ImageRGBAReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT maskReader, GCIFImage * CAT_RESTRICT image) {
+int ImageRGBAReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT maskReader, ImageOutput & CAT_RESTRICT output) {
 #ifdef CAT_COLLECT_STATS
 	m_clock = Clock::ref();
 
@@ -584,10 +879,12 @@ int ImageRGBAReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & C
 	int err;
 
 	_mask = &maskReader;
+	_output = &output;
+
+	_xsize = output.getXSize();
+	_ysize = output.getYSize();
 
-	_rgba = image->rgba;
-	_xsize = image->xsize;
-	_ysize = image->ysize;
+	_spans.resize(_xsize);
 
 	// Read filter selection tables
 	if ((err = readFilterTables(reader))) {
@@ -607,11 +904,32 @@ int ImageRGBAReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & C
 	double t2 = m_clock->usec();
 #endif	
 
+	// Skip reading planes that only hold one value
+	findConstants();
+
+	// Keep only as many alpha rows as the decoder can look back at
+	initAlphaWindow();
+
+	reader.markSection(GCIF_SECTION_TABLES);
+
+	_lz_count = 0;
+
 	// Read RGB data and decompress it
-	if ((err = readPixels(reader))) {
+#ifdef CAT_COMPILE_THREADS
+	if (_pipe_jobs && (u32)_xsize * output.getRowEnd() >= (u32)PIPE_MIN_PIXELS) {
+		err = readPipelined(reader);
+	} else
+#endif // CAT_COMPILE_THREADS
+	{
+		initWindow(RGBA_SLIDE_ROWS);
+		err = readRows(reader);
+	}
+	if (err) {
 		return err;
 	}
 
+	reader.markSection(GCIF_SECTION_PIXELS);
+
 	// Pass image data reference back to caller
 	_rgba = 0;
 
@@ -627,6 +945,29 @@ int ImageRGBAReader::read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & C
 	return GCIF_RE_OK;
 }
 
+int ImageRGBAReader::readInfo(ImageReader & CAT_RESTRICT reader, int xsize, int ysize) {
+	int err;
+
+	_xsize = xsize;
+	_ysize = ysize;
+
+	if ((err = readFilterTables(reader))) {
+		return err;
+	}
+
+	return readRGBATables(reader);
+}
+
+bool ImageRGBAReader::usesLZ() {
+	for (int ii = 0, iiend = _chaos.getBinCount(); ii < iiend; ++ii) {
+		if (_y_decoder[ii].hasSymbolIn(NUM_LIT_SYMS, NUM_Y_SYMS)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 #ifdef CAT_COLLECT_STATS
 
 bool ImageRGBAReader::dumpStats() {
@@ -37,6 +37,8 @@
 #include "MonoReader.hpp"
 #include "SmartArray.hpp"
 #include "LZReader.hpp"
+#include "ImageOutput.hpp"
+#include "RowPipeline.hpp"
 
 /*
  * Game Closure RGBA Decompression
@@ -78,11 +80,29 @@ public:
 
 protected:
 	ImageMaskReader * CAT_RESTRICT _mask;
+	ImageOutput * CAT_RESTRICT _output;
 
 	// RGBA output data
 	u8 * CAT_RESTRICT _rgba;
 	u16 _xsize, _ysize;
 
+	/*
+	 * Unless the output can be written in place, rows are decoded into a
+	 * window of rows that slides down the image, since the reads only look
+	 * back as far as the spatial filters and the longest LZ distance in use.
+	 * When the window is full, the rows that can still be read from are
+	 * moved to the top of it.
+	 */
+	static const int RGBA_SLIDE_ROWS = 32; // Least rows decoded between window slides
+
+	int _window_rows;		// Rows that fit in the window
+	int _window_history;	// Rows kept when it slides
+	int _window_y;			// Image row at the top of the window
+
+	CAT_INLINE u8 *getRow(const u16 y) {
+		return _rgba + (y - _window_y) * _xsize * 4;
+	}
+
 	// Tiles
 	u16 _tile_bits_x, _tile_bits_y;
 	u16 _tile_xsize, _tile_ysize;
@@ -90,8 +110,9 @@ protected:
 	u16 _tiles_x, _tiles_y;
 
 	struct FilterSelection {
-		YUV2RGBFilterFunction cf;
+		YUV2RGBRowFunction cf;
 		RGBAFilterFuncs sf;
+		RGBAFilterRowFunc sf_row;
 
 		CAT_INLINE bool ready() {
 			return cf != 0;
@@ -100,9 +121,106 @@ protected:
 
 	// Filter functions
 	RGBAFilterFuncs _sf[MAX_FILTERS];
+	RGBAFilterRowFunc _sf_row[MAX_FILTERS];
 	int _sf_count;
 	SmartArray<FilterSelection> _filters;
 
+	/*
+	 * Each scanline is read in two passes.  The first pass decodes the YUV
+	 * residuals into the output and notes runs of pixels to reconstruct and
+	 * LZ copies to perform.  The second pass walks those spans in order and
+	 * reverses the filters a run at a time, where the batched filters can
+	 * work on many pixels with one call.
+	 */
+	struct RowSpan {
+		u16 x, len;
+		u32 dist;	// LZ copy distance in pixels, or 0 for filtered pixels
+	};
+
+	SmartArray<RowSpan> _spans;
+	RowSpan * CAT_RESTRICT _row_spans;	// Spans for the row being read
+	int _span_count;
+
+	CAT_INLINE void addFilteredPixel(u16 x) {
+		RowSpan * CAT_RESTRICT span = _row_spans + _span_count;
+
+		// If this pixel continues the last run of filtered pixels,
+		if (_span_count > 0) {
+			--span;
+			if (span->dist == 0 && span->x + span->len == x) {
+				span->len++;
+				return;
+			}
+			++span;
+		}
+
+		span->x = x;
+		span->len = 1;
+		span->dist = 0;
+		++_span_count;
+	}
+
+	/*
+	 * The alpha plane is decoded into a window of rows in the same way.
+	 */
+	static const int ALPHA_SLIDE_ROWS = 32; // Least rows decoded between window slides
+
+#ifdef CAT_COMPILE_THREADS
+	/*
+	 * The chaos contexts only look at decoded residuals, so reading a row
+	 * does not need the rows above it to be reconstructed.  Given a second
+	 * thread, one thread reads rows into a ring of span lists while the
+	 * other reconstructs them a few rows behind.  Each slot keeps a copy of
+	 * the filters for its row, since the reading thread moves on to the
+	 * next tile row without waiting.
+	 *
+	 * With more threads, rows are reconstructed on all of them at once as a
+	 * wavefront, where each row publishes how far along it is.  The spatial
+	 * filters reach up to two rows up and two pixels to the right: ED_GRAD
+	 * reads (x + 2, y - 2).  waitAbove() only waits on the row just above,
+	 * for it to be one pixel past the end of the run, so pixels up to xend
+	 * need row y - 1 done through xend + 1.  That row waited the same way,
+	 * so row y - 2 is then done through xend + 2, which covers ED_GRAD.  The
+	 * one pixel lag per row compounds over the two rows, so it must not be
+	 * cut to zero, or ED_GRAD would read row y - 2 before it is written.
+	 *
+	 * LZ copies wait for the row their source ends in, and every row before
+	 * it if the source runs across rows.  Since a row never gets ahead of the
+	 * one above it, a finished row means all the rows above it are finished
+	 * too.
+	 */
+	static const int PIPE_ROWS = 16;			// Rows in the ring, at least
+	static const int PIPE_MIN_PIXELS = 65536;	// Not worth waking a thread below this
+
+	GCIFRunJobs _pipe_jobs;
+	void *_pipe_pool;
+	int _pipe_threads;
+	RowPipeline _pipe;
+	bool _pipelined, _wavefront;
+	SmartArray<int> _pipe_span_counts;
+	SmartArray<FilterSelection> _pipe_filters;
+	SmartArray<u32> _row_progress;	// Pixels reconstructed in each row
+	ImageReader * CAT_RESTRICT _pipe_reader;
+	int _pipe_err;
+
+	// Wait for the row above to be reconstructed past the pixels up to xend
+	CAT_INLINE void waitAbove(const u16 y, const u16 xend, u32 &above) {
+		const u32 need = xend < _xsize ? xend + 1 : _xsize;
+
+		if (y > 0 && above < need) {
+			above = RowPipeline::waitProgress(_row_progress.get() + y - 1, need);
+		}
+	}
+
+	void waitCopySource(const u16 y, const u16 x, const u32 dist, const u16 len);
+	void pushRow(const u16 y);
+	int readPipelined(ImageReader & CAT_RESTRICT reader);
+
+	static void PipeProduce(void *data);
+	static void PipeConsume(void *data, int row);
+	static void PipeJob(void *data, int job_index, int thread_index);
+#endif // CAT_COMPILE_THREADS
+
 	// Filter/Alpha decoders
 	SmartArray<u8> _sf_tiles, _cf_tiles, _a_tiles;
 	MonoReader _sf_decoder, _cf_decoder, _a_decoder;
@@ -113,6 +231,10 @@ protected:
 	MonoReader::ReadDelegate _a_decoder_read_safe;
 	MonoReader::ReadDelegate _a_decoder_read_unsafe;
 
+	// Constant planes, which are not read at all
+	bool _sf_const, _cf_const, _a_const;
+	u8 _sf_value, _cf_value, _a_value;
+
 	// RGB decoders
 	RGBChaos _chaos;
 	EntropyDecoder _y_decoder[MAX_CHAOS_LEVELS];
@@ -121,26 +243,41 @@ protected:
 
 	// LZ decoder
 	LZReader _lz;
+	int _lz_count;	// Pixels copied by LZ matches
 
 	CAT_INLINE FilterSelection *readFilter(u16 x, u16 y, ImageReader & CAT_RESTRICT reader) {
 		const u16 tx = x >> _tile_bits_x;
 		FilterSelection * CAT_RESTRICT filter = &_filters[tx];
 
 		if (!filter->ready()) {
-			filter->cf = YUV2RGB_FILTERS[_cf_decoder_read(tx, reader)];
-			filter->sf = _sf[_sf_decoder_read(tx, reader)];
+			const u8 cf = _cf_const ? _cf_value : _cf_decoder_read(tx, reader);
+			filter->cf = YUV2RGB_ROW_FILTERS[cf];
+			const u8 sf = _sf_const ? _sf_value : _sf_decoder_read(tx, reader);
+			filter->sf = _sf[sf];
+			filter->sf_row = _sf_row[sf];
 		}
 
 		return filter;
 	}
 
-	CAT_INLINE void readSafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader, u32 &mask, const u32 * CAT_RESTRICT &mask_next, int &mask_left, const u32 MASK_COLOR, const u8 MASK_ALPHA);
-	CAT_INLINE void readUnsafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader, u32 &mask, const u32 * CAT_RESTRICT &mask_next, int &mask_left, const u32 MASK_COLOR, const u8 MASK_ALPHA);
+	template<bool CONST_ALPHA> CAT_INLINE void readSafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader);
+	template<bool CONST_ALPHA> CAT_INLINE void readUnsafe(u16 &x, const u16 y, u8 * CAT_RESTRICT &p, ImageReader & CAT_RESTRICT reader);
+	CAT_INLINE void maskRun(u16 x, u16 len, u8 * CAT_RESTRICT p, const u32 MASK_COLOR, const u8 MASK_ALPHA);
+	template<bool CONST_ALPHA, bool SAFE> void readScanline(const u16 y, ImageReader & CAT_RESTRICT reader, const u32 MASK_COLOR, const u8 MASK_ALPHA);
 
 	int readLZMatch(u16 pixel_code, ImageReader & CAT_RESTRICT reader, int x, u8 * CAT_RESTRICT p);
+	template<bool WAVE> void reconstructRun(u16 x, u16 len, const u16 y, const FilterSelection * CAT_RESTRICT filters, u32 &above);
+	template<bool WAVE> void reconstructRow(const u16 y, const RowSpan * CAT_RESTRICT span, int span_count, const FilterSelection * CAT_RESTRICT filters);
+	CAT_INLINE void finishRow(const u16 y);
+	int readRows(ImageReader & CAT_RESTRICT reader);
 	int readFilterTables(ImageReader & CAT_RESTRICT reader);
 	int readRGBATables(ImageReader & CAT_RESTRICT reader);
-	int readPixels(ImageReader & CAT_RESTRICT reader);
+	void findConstants();
+	int getLZRows();
+	void initAlphaWindow();
+	void initWindow(int slide_rows);
+	void slideWindow(const u16 y);
+	template<bool CONST_ALPHA> int readPixels(ImageReader & CAT_RESTRICT reader);
 
 #ifdef CAT_COLLECT_STATS
 public:
@@ -151,7 +288,37 @@ public:
 #endif
 
 public:
-	int read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT maskReader, GCIFImage * CAT_RESTRICT image);
+	ImageRGBAReader();
+
+	int read(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT maskReader, ImageOutput & CAT_RESTRICT output);
+
+#ifdef CAT_COMPILE_THREADS
+	/*
+	 * Reconstruct rows on the other threads from the pool while reading, for
+	 * images large enough to be worth it.  thread_count jobs are run, which
+	 * the pool may run all at once or one after the other.  Pass run_jobs = 0
+	 * or thread_count < 2 to turn it off.
+	 */
+	CAT_INLINE void setPipeline(GCIFRunJobs run_jobs, void *pool, int thread_count) {
+		_pipe_jobs = thread_count >= 2 ? run_jobs : 0;
+		_pipe_pool = pool;
+		_pipe_threads = thread_count;
+	}
+#endif // CAT_COMPILE_THREADS
+
+	// Read just the filter and chaos tables without decoding any pixels
+	int readInfo(ImageReader & CAT_RESTRICT reader, int xsize, int ysize);
+
+	CAT_INLINE int getChaosLevels() {
+		return _chaos.getBinCount();
+	}
+
+	// Returns true if any chaos level can emit an LZ escape code
+	bool usesLZ();
+
+	CAT_INLINE int getLZCount() {
+		return _lz_count;
+	}
 
 #ifdef CAT_COLLECT_STATS
 	bool dumpStats();
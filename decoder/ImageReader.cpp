@@ -27,40 +27,136 @@
 */
 
 #include "ImageReader.hpp"
+#include "HuffmanDecoder.hpp"
 #include "EndianNeutral.hpp"
 #include "GCIFReader.h"
 using namespace cat;
 
+#if defined(CAT_OS_WINDOWS)
+#include "WindowsInclude.hpp"
+#else
+#include <time.h>
+#endif
+
+
+// Timestamp in microseconds for the decode statistics
+static double get_usec() {
+#if defined(CAT_OS_WINDOWS)
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return now.QuadPart * 1000000.0 / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec * 0.001;
+#endif
+}
+
 
 //// ImageReader
 
+ImageReader::~ImageReader() {
+	if (_table_decoder) {
+		delete _table_decoder;
+		_table_decoder = 0;
+	}
+}
+
 void ImageReader::clear() {
 	_words = 0;
+	_feed = 0;
 }
 
-u32 ImageReader::refill() {
-	u64 bits = _bits;
-	int bitsLeft = _bitsLeft;
+HuffmanTableDecoder *ImageReader::getTableDecoder() {
+	// Create on first use and keep it around for the next image
+	if (!_table_decoder) {
+		_table_decoder = new HuffmanTableDecoder;
+	}
+
+	return _table_decoder;
+}
 
-	CAT_DEBUG_ENFORCE(bitsLeft < 32);
+void ImageReader::setData(const u32 * CAT_RESTRICT words, u32 wordCount, bool done) {
+	_words = words;
+	_wordCount = wordCount;
 
-	if (_wordsLeft > 0) {
-		--_wordsLeft;
+	if (!done) {
+		// Load in place up to the last few words, then wait for more
+		_fastWords = wordCount > TAIL_WORDS ? wordCount - TAIL_WORDS : 0;
+		return;
+	}
 
-		u32 nextWord = getLE(*_words++);
+	// Copy the last few words to the padded tail
+	const u32 tailDataWords = wordCount < TAIL_WORDS ? wordCount : TAIL_WORDS;
+	const u32 fastWords = wordCount - tailDataWords;
 
-		bits |= (u64)nextWord << (32 - bitsLeft);
-		bitsLeft += 32;
+	CAT_OBJCLR(_tail);
+	for (u32 ii = 0; ii < tailDataWords; ++ii) {
+		_tail[ii] = words[fastWords + ii];
+	}
+	_fastWords = fastWords;
 
-		_bits = bits;
-		_bitsLeft = bitsLeft;
-	} else {
-		if (bitsLeft <= 0) {
-			_eof = true;
+	_feed = 0;
+}
+
+const u32 *ImageReader::tailWords(u32 index) {
+	// If the data is still arriving, wait for the words to load
+	if CAT_UNLIKELY(_feed) {
+		u32 ready;
+		bool done;
+		const u32 * CAT_RESTRICT words = _feed->wait(index + TAIL_WORDS + 1, ready, done);
+
+		setData(words, ready, done);
+
+		if (index < _fastWords) {
+			return _words + index;
 		}
 	}
 
-	return bits >> 32;
+	u32 offset = index - _fastWords;
+
+	// Past the end, stay on the last zero words
+	if (offset > TAIL_WORDS + PAD_WORDS - LOAD_WORDS) {
+		offset = TAIL_WORDS + PAD_WORDS - LOAD_WORDS;
+	}
+
+	return _tail + offset;
+}
+
+u64 ImageReader::getBitsRead() {
+	const u64 bits = _pos + (64 - _bitsLeft);
+
+	// Reading past the end returns zero bits, so cap it
+	const u64 max_bits = (u64)_wordCount * 32;
+	return bits < max_bits ? bits : max_bits;
+}
+
+void ImageReader::setStats(GCIFDecodeStats *stats) {
+	_stats = stats;
+
+	if (stats) {
+		_mark_usec = get_usec();
+		_mark_bits = getBitsRead();
+	}
+}
+
+void ImageReader::chargeSection(int section) {
+	CAT_DEBUG_ENFORCE(section >= 0 && section < GCIF_SECTION_COUNT);
+
+	const double usec = get_usec();
+	const u64 bits = getBitsRead();
+
+	_stats->usec[section] += usec - _mark_usec;
+	_stats->bits[section] += (long)(bits - _mark_bits);
+
+	_mark_usec = usec;
+	_mark_bits = bits;
+}
+
+bool ImageReader::eof() {
+	// If any bits past the end of the data were consumed,
+	return _pos + (64 - _bitsLeft) > (u64)_wordCount * 32;
 }
 
 #ifdef CAT_COMPILE_MMAP
@@ -90,8 +186,6 @@ int ImageReader::init(const char * CAT_RESTRICT path) {
 #endif // CAT_COMPILE_MMAP
 
 int ImageReader::init(const void * CAT_RESTRICT buffer, long fileSize) {
-	const int MIN_FILE_WORDS = 2; // Enough for header
-
 	clear();
 
 	const u32 * CAT_RESTRICT words = reinterpret_cast<const u32 *>( buffer );
@@ -103,14 +197,36 @@ int ImageReader::init(const void * CAT_RESTRICT buffer, long fileSize) {
 	}
 
 	// Setup bit reader
-	_words = words;
-	_wordsLeft = fileWords;
-	_wordCount = _wordsLeft;
+	setData(words, fileWords, true);
 
-	_eof = false;
+	return readHead();
+}
+
+int ImageReader::init(ImageFeed *feed) {
+	clear();
+
+	// Wait for the header
+	u32 ready;
+	bool done;
+	const u32 * CAT_RESTRICT words = feed->wait(MIN_FILE_WORDS, ready, done);
+
+	// Validate file length
+	if CAT_UNLIKELY(ready < MIN_FILE_WORDS) {
+		return GCIF_RE_BAD_HEAD;
+	}
+
+	// Setup bit reader
+	_feed = feed;
+	setData(words, ready, done);
+
+	return readHead();
+}
 
-	_bits = 0;
-	_bitsLeft = 0;
+int ImageReader::readHead() {
+	// Load the first bits
+	_pos = 0;
+	_bitsLeft = 64;
+	refill();
 
 	// Validate magic
 	u32 magic = readWord();
@@ -32,10 +32,37 @@
 #include "Platform.hpp"
 #include "MappedFile.hpp"
 #include "Enforcer.hpp"
+#include "EndianNeutral.hpp"
+#include "GCIFReader.h"
 
 namespace cat {
 
 
+class HuffmanTableDecoder;
+
+
+//// ImageFeed
+
+/*
+ * Source for file data that is still arriving
+ *
+ * A reader started on a feed loads straight from the data received so far,
+ * and only calls wait() when it gets to the end of it.
+ */
+class ImageFeed {
+public:
+	virtual ~ImageFeed() {}
+
+	/*
+	 * Block until at least word_count words have arrived or no more will.
+	 * Returns the data received so far, which must stay in place until the
+	 * next call.  Sets ready to its length in words, and done to true if that
+	 * is all of the data.
+	 */
+	virtual const u32 *wait(u32 word_count, u32 &ready, bool &done) = 0;
+};
+
+
 //// ImageReader
 
 class ImageReader {
@@ -45,6 +72,26 @@ public:
 	static const u32 MAX_X = (1 << MAX_X_BITS) - 1;
 	static const u32 MAX_Y_BITS = 14;
 	static const u32 MAX_Y = (1 << MAX_Y_BITS) - 1;
+	static const u32 MIN_FILE_WORDS = 2; // Enough for header
+
+	/*
+	 * Striped files
+	 *
+	 * Large images may be split into horizontal stripes that are each stored
+	 * as a complete GCIF file, so that they can be decoded independently and
+	 * on several threads at once.  The stripes are wrapped in a container:
+	 *
+	 * Word 0: STRIPE_MAGIC
+	 * Word 1: Same xsize, ysize bits as the normal header
+	 * Word 2: Rows per stripe (the last stripe takes the remainder)
+	 * Word 3+: Word offset of each stripe from the start of the file
+	 *
+	 * Each stripe runs from its offset up to the next one, or to the end of
+	 * the file for the last stripe.
+	 */
+	static const u32 STRIPE_MAGIC = 0x53494347; // "GCIS" (LE32)
+	static const int STRIPE_HEAD_WORDS = 3;
+	static const int MAX_STRIPES = 1024;
 
 	struct Header {
 		u16 xsize, ysize; // pixels
@@ -58,51 +105,131 @@ protected:
 
 	Header _header;
 
-	bool _eof;
+	/*
+	 * 64-bit refills
+	 *
+	 * The stream is MSB-first bits in little-endian 32-bit words.  A refill
+	 * loads the pair of words holding the next unread bit with one 64-bit
+	 * load, rotates it by 32 to put the first word on top, and shifts out
+	 * the bits already read.  The bits shifted out are replaced from the
+	 * word after the pair, so every refill leaves 64 bits buffered.
+	 *
+	 * Padded tail
+	 *
+	 * The last few data words are copied into _tail, followed by zero words.
+	 * Refills that would reach the last data words load from the tail
+	 * instead, and past the end the loads stay on its last zero words, so
+	 * they never read outside the data.  Reading past the end returns zero
+	 * bits, as before.
+	 *
+	 * While data is still arriving from a feed, the words past _fastWords
+	 * have not been received yet, so tailWords() waits on the feed for them.
+	 * Once the feed is done the tail is set up as usual.
+	 */
+	static const int LOAD_WORDS = 3;
+	static const int TAIL_WORDS = LOAD_WORDS;
+	static const int PAD_WORDS = LOAD_WORDS;
 
 	const u32 * CAT_RESTRICT _words;
 	int _wordCount;
-	int _wordsLeft;
+
+	u32 _fastWords;			// Refills from before this word load in place
+	u64 _pos;				// Bit position in the stream of the top bit of _bits
+
+	u32 _tail[TAIL_WORDS + PAD_WORDS];
+
+	ImageFeed *_feed;		// Source of more words, or 0 once it is all here
 
 	u64 _bits;
 	int _bitsLeft;
 
+	// Scratch decoder for Huffman tables, shared by all tables in the file
+	HuffmanTableDecoder *_table_decoder;
+
 	void clear();
 
-	u32 refill();
+	// Decode statistics, or 0 when not collecting them
+	GCIFDecodeStats *_stats;
+	double _mark_usec;
+	u64 _mark_bits;
+
+	void chargeSection(int section);
+
+	// Point the bit reader at the data, which is all of it if done
+	void setData(const u32 * CAT_RESTRICT words, u32 wordCount, bool done);
+
+	// Read the magic and header from the first words
+	int readHead();
+
+	// Get the words to load at index from the padded tail or the feed
+	const u32 *tailWords(u32 index);
+
+	// Reload the bits from the next unread bit
+	CAT_INLINE void refill() {
+		CAT_DEBUG_ENFORCE(_bitsLeft >= 0 && _bitsLeft <= 64);
+
+		// Find the word holding the next unread bit
+		const u64 pos = _pos + (64 - _bitsLeft);
+		const u32 index = (u32)(pos >> 5);
+
+		const u32 * CAT_RESTRICT src;
+		if CAT_LIKELY(index < _fastWords) {
+			src = _words + index;
+		} else {
+			src = tailWords(index);
+		}
+
+		// Load the pair at once and put its first word on top
+		u64 pair;
+		memcpy(&pair, src, sizeof(pair));
+		pair = getLE64(pair);
+		pair = (pair << 32) | (pair >> 32);
+
+		// Shift out the bits already read and fill in from the next word
+		const int skip = (int)pos & 31;
+		const u64 next = getLE(src[2]);
+		_bits = (pair << skip) | ((next << skip) >> 32);
+		_bitsLeft = 64;
+		_pos = pos;
+	}
 
 public:
 	ImageReader() {
 		_words = 0;
+		_feed = 0;
+		_table_decoder = 0;
+		_stats = 0;
 	}
-	virtual ~ImageReader() {
-	}
+	virtual ~ImageReader();
 
 	CAT_INLINE int getTotalDataWords() {
 		return _wordCount;
 	}
 
-	CAT_INLINE int getWordsLeft() {
-		return _wordsLeft;
-	}
-
 	// Initialize with file or memory buffer
 #ifdef CAT_COMPILE_MMAP
 	int init(const char * CAT_RESTRICT path);
 #endif // CAT_COMPILE_MMAP
 	int init(const void * CAT_RESTRICT buffer, long bytes);
 
+	// Initialize with data that is still arriving, which blocks until the
+	// header is here.  The feed must outlive the read
+	int init(ImageFeed *feed);
+
 	CAT_INLINE Header *getHeader() {
 		return &_header;
 	}
 
+	// Returns a table decoder that is reused between Huffman table reads
+	HuffmanTableDecoder *getTableDecoder();
+
 	// Returns at least minBits in the high bits, supporting up to 32 bits
 	CAT_INLINE u32 peek(int minBits) {
 		if (_bitsLeft < minBits) {
-			return refill();
-		} else {
-			return (u32)(_bits >> 32);
+			refill();
 		}
+
+		return (u32)(_bits >> 32);
 	}
 
 	// After peeking, consume up to 32 bits
@@ -229,9 +356,44 @@ public:
 		return code;
 	}
 
-	// No bits left to read?
-	CAT_INLINE bool eof() {
-		return _eof;
+	// Were any bits read past the end of the data?
+	bool eof();
+
+	// Bits read from the start of the data so far
+	u64 getBitsRead();
+
+	/*
+	 * Decode statistics
+	 *
+	 * After setStats(), the readers charge the time and bits since the last
+	 * mark to each section of the stats as they finish it.  Set to 0 to stop,
+	 * so that marking only costs a branch.
+	 */
+	void setStats(GCIFDecodeStats *stats);
+
+	CAT_INLINE GCIFDecodeStats *getStats() {
+		return _stats;
+	}
+
+	// Charge everything since the last mark to a GCIF_SECTION_*
+	CAT_INLINE void markSection(int section) {
+		if CAT_UNLIKELY(_stats) {
+			chargeSection(section);
+		}
+	}
+
+	// Count a Huffman table read
+	CAT_INLINE void countTable() {
+		if CAT_UNLIKELY(_stats) {
+			_stats->huffman_tables++;
+		}
+	}
+
+	// Count a table whose decoding tables were copied from an identical one
+	CAT_INLINE void countSharedTable() {
+		if CAT_UNLIKELY(_stats) {
+			_stats->shared_tables++;
+		}
 	}
 };
 
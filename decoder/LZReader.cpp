@@ -29,6 +29,10 @@
 #include "LZReader.hpp"
 using namespace cat;
 
+#if defined(CAT_HAS_SSE2)
+#include <emmintrin.h>
+#endif
+
 #ifdef CAT_DESYNCH_CHECKS
 #define DESYNC_TABLE() \
 	CAT_ENFORCE(reader.readWord() == 1337234);
@@ -141,3 +145,114 @@ int LZReader::read(u16 escape_code, ImageReader & CAT_RESTRICT reader, u32 &dist
 	return len;
 }
 
+
+u32 LZReader::getMaxDist(bool use_short, bool use_long) {
+	// Local neighbors reach up to two pixels right of the pixel above
+	u32 max_dist = _xsize + 2;
+	u32 code;
+
+	// If short distances are used,
+	if (use_short && _sdist_decoder.getLastSymbol(code)) {
+		u32 dist;
+
+		// If the last code is in the 17-pixel wide rows,
+		if (code >= 39) {
+			dist = _xsize * (2 + (code - 39) / 17) + 8;
+		} else {
+			dist = _xsize + 16;
+		}
+
+		if (max_dist < dist) {
+			max_dist = dist;
+		}
+	}
+
+	// If long distances are used,
+	if (use_long && _ldist_decoder.getLastSymbol(code)) {
+		// Same as readLongDist() with all extra bits set
+		u32 EB = (code >> 4) + 1;
+		u32 C0 = ((1 << (EB - 1)) - 1) << 5;
+		u32 D0 = ((code - ((EB - 1) << 4)) << EB) + C0;
+		u32 dist = D0 + (1 << EB) - 1 + 17;
+
+		if (max_dist < dist) {
+			max_dist = dist;
+		}
+	}
+
+	return max_dist;
+}
+
+//// Match copies
+
+void LZReader::copyPixels(u32 *dst, u32 dist, int len) {
+	const u32 *src = dst - dist;
+
+#if defined(CAT_HAS_SSE2)
+	// If each vector reads only pixels that are already final,
+	if (dist >= 4 && len >= 4) {
+		int ii = 0;
+		for (; ii + 4 <= len; ii += 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>( dst + ii ), _mm_loadu_si128(reinterpret_cast<const __m128i *>( src + ii )));
+		}
+
+		// Finish with one vector that overlaps what was just written
+		if (ii < len) {
+			ii = len - 4;
+			_mm_storeu_si128(reinterpret_cast<__m128i *>( dst + ii ), _mm_loadu_si128(reinterpret_cast<const __m128i *>( src + ii )));
+		}
+		return;
+	}
+
+	// If repeating one pixel,
+	if (dist == 1) {
+		const __m128i v = _mm_set1_epi32(src[0]);
+
+		int ii = 0;
+		for (; ii + 4 <= len; ii += 4) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>( dst + ii ), v);
+		}
+		for (; ii < len; ++ii) {
+			dst[ii] = src[0];
+		}
+		return;
+	}
+#endif
+
+	// Copy forward a word at a time, since the match may overlap
+	for (int ii = 0; ii < len; ++ii) {
+		dst[ii] = src[ii];
+	}
+}
+
+void LZReader::copyBytes(u8 *dst, u32 dist, int len) {
+	const u8 *src = dst - dist;
+
+#if defined(CAT_HAS_SSE2)
+	// If each vector reads only bytes that are already final,
+	if (dist >= 16 && len >= 16) {
+		int ii = 0;
+		for (; ii + 16 <= len; ii += 16) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>( dst + ii ), _mm_loadu_si128(reinterpret_cast<const __m128i *>( src + ii )));
+		}
+
+		// Finish with one vector that overlaps what was just written
+		if (ii < len) {
+			ii = len - 16;
+			_mm_storeu_si128(reinterpret_cast<__m128i *>( dst + ii ), _mm_loadu_si128(reinterpret_cast<const __m128i *>( src + ii )));
+		}
+		return;
+	}
+#endif
+
+	// If repeating one byte,
+	if (dist == 1) {
+		memset(dst, src[0], len);
+		return;
+	}
+
+	// Copy forward a byte at a time, since the match may overlap
+	for (int ii = 0; ii < len; ++ii) {
+		dst[ii] = src[ii];
+	}
+}
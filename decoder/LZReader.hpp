@@ -225,6 +225,8 @@ protected:
 
 	static const u32 DIST_MASK = 0xFFFFF; // Mask for valid distances to avoid extra checks
 
+	static const int CACHE_LINE_BYTES = 64; // Prefetch stride
+
 	int _xsize, _ysize;
 
 	u32 _recent[LAST_COUNT];
@@ -242,6 +244,35 @@ public:
 	bool init(int xsize, int ysize, ImageReader & CAT_RESTRICT reader);
 
 	int read(u16 escape_code, ImageReader & CAT_RESTRICT reader, u32 &dist);
+
+	/*
+	 * Returns the longest distance that read() can produce, given whether
+	 * any short or long distance escape codes are in use.  This follows
+	 * from the distance codes that the encoder gave lengths to, so that
+	 * the caller can keep just enough history around.
+	 */
+	u32 getMaxDist(bool use_short, bool use_long);
+
+	/*
+	 * Match copies
+	 *
+	 * Copy len items from dist items back to dst.  Matches may overlap their
+	 * own output when dist < len, which repeats the last dist items.
+	 */
+	static void copyPixels(u32 *dst, u32 dist, int len);
+	static void copyBytes(u8 *dst, u32 dist, int len);
+
+	// Start loading a match source that will be copied later
+	static CAT_INLINE void prefetch(const void *src, int bytes) {
+		const u8 *p = reinterpret_cast<const u8 *>( src );
+
+		for (int ii = 0; ii < bytes; ii += CACHE_LINE_BYTES) {
+			CAT_PREFETCH(p + ii);
+		}
+
+		// Cover the last line when the source is not aligned
+		CAT_PREFETCH(p + bytes - 1);
+	}
 };
 
 
@@ -57,12 +57,77 @@ void MonoReader::cleanup() {
 	}
 }
 
+void MonoReader::findConstant() {
+	_is_constant = false;
+	_constant_predicted = false;
+	_constant = 0;
+
+	const u16 num_syms = _params.num_syms;
+	u16 sym;
+
+	// If using row filters instead of tiled filters,
+	if (_use_row_filters) {
+		// If every residual is the same literal,
+		if (_row_filter_decoder.getConstant(sym) && sym < num_syms) {
+			// RF_PREV accumulates the residuals, so only zero stays constant
+			if (sym == 0 || (_one_row_filter && _row_filter == RF_NOOP)) {
+				_is_constant = true;
+				_constant = static_cast<u8>( sym );
+			}
+		}
+
+		return;
+	}
+
+	// Nothing outside the reads writes the filter tiles, so a predicted
+	// constant filter choice is fine here
+	u8 f;
+	bool predicted;
+	if (!_filter_decoder->isConstant(f, predicted) || f >= _filter_count) {
+		return;
+	}
+
+	// Check if every residual is the same literal
+	bool residuals_constant = true;
+	bool residuals_zero = true;
+	for (int ii = 0, iiend = _chaos.getBinCount(); ii < iiend; ++ii) {
+		if (!_decoder[ii].getConstant(sym) || sym >= num_syms) {
+			residuals_constant = false;
+			break;
+		}
+		if (sym != 0) {
+			residuals_zero = false;
+		}
+	}
+
+	const MonoFilterFunc filter = _sf[f].safe;
+#ifdef CAT_WORD_64
+	const u64 pf = (u64)filter;
+#else
+	const u32 pf = (u32)filter;
+#endif
+
+	// If the filter is a palette symbol,
+	if (pf <= MAX_PALETTE+1) {
+		// LZ mode reads a residual before each tile filter, so it must be free
+		if (!_lz_enabled || residuals_constant) {
+			_is_constant = true;
+			_constant = _palette[pf - 1];
+		}
+	} else if (residuals_constant && residuals_zero) {
+		// Spatial filters predict zero from zero neighbors
+		_is_constant = true;
+		_constant_predicted = true;
+	}
+}
+
 int MonoReader::readTables(const Parameters & CAT_RESTRICT params, ImageReader & CAT_RESTRICT reader) {
 	// Store parameters
 	_params = params;
 
 	// Check if LZ is enabled for this monochrome image
 	_lz_enabled = (reader.readBit() == 1);
+	_lz_count = 0;
 
 	const int num_syms = _params.num_syms + (_lz_enabled ? LZReader::ESCAPE_SYMS : 0);
 
@@ -182,7 +247,7 @@ int MonoReader::readTables(const Parameters & CAT_RESTRICT params, ImageReader &
 
 		// For each chaos level,
 		for (int ii = 0; ii < chaos_levels; ++ii) {
-			if CAT_UNLIKELY(!_decoder[ii].init(num_syms, ZRLE_SYMS, HUFF_LUT_BITS, reader)) {
+			if CAT_UNLIKELY(!_decoder[ii].init(num_syms, ZRLE_SYMS, HUFF_LUT_BITS, reader, _decoder, ii)) {
 				CAT_DEBUG_EXCEPTION();
 				return GCIF_RE_BAD_MONO;
 			}
@@ -234,11 +299,55 @@ int MonoReader::readTables(const Parameters & CAT_RESTRICT params, ImageReader &
 		return GCIF_RE_BAD_MONO;
 	}
 
+	findConstant();
+
 	_current_row = _params.data;
+	_window_end = _params.data + _params.xsize * _params.ysize;
+	_window_history = 0;
 
 	return GCIF_RE_OK;
 }
 
+int MonoReader::getHistoryRows() {
+	// Spatial filters look a couple of rows up
+	int rows = MONO_FILTER_ROWS;
+
+	// If LZ was enabled in header,
+	if (_lz_enabled) {
+		EntropyDecoder *decoders = _decoder;
+		int count = _chaos.getBinCount();
+
+		if (_use_row_filters) {
+			decoders = &_row_filter_decoder;
+			count = 1;
+		}
+
+		// Check which kinds of distances the escape codes use
+		const u32 esc = _params.num_syms;
+		bool use_short = false, use_long = false;
+		for (int ii = 0; ii < count; ++ii) {
+			use_short |= decoders[ii].hasSymbolIn(esc + LZReader::ESC_DIST_SHORT_2, esc + LZReader::ESC_DIST_LONG_2);
+			use_long |= decoders[ii].hasSymbolIn(esc + LZReader::ESC_DIST_LONG_2, esc + LZReader::ESCAPE_SYMS);
+		}
+
+		const u32 dist = _lz.getMaxDist(use_short, use_long);
+		const int lz_rows = (dist + _params.xsize - 1) / _params.xsize;
+
+		if (rows < lz_rows) {
+			rows = lz_rows;
+		}
+	}
+
+	return rows;
+}
+
+void MonoReader::setWindow(u8 * CAT_RESTRICT data, int window_rows, int history_rows) {
+	_params.data = data;
+	_current_row = data;
+	_window_end = data + _params.xsize * window_rows;
+	_window_history = history_rows;
+}
+
 int MonoReader::readRowHeader(u16 y, ImageReader & CAT_RESTRICT reader) {
 	// If using row filters instead of tiled filters,
 	if (_use_row_filters) {
@@ -282,6 +391,15 @@ int MonoReader::readRowHeader(u16 y, ImageReader & CAT_RESTRICT reader) {
 
 	if (y > 0) {
 		_current_row += _params.xsize;
+
+		// If the window is full, move the rows still needed to the front
+		if CAT_UNLIKELY(_current_row >= _window_end) {
+			const int history_bytes = _window_history * _params.xsize;
+
+			memmove(_params.data, _current_row - history_bytes, history_bytes);
+
+			_current_row = _params.data + history_bytes;
+		}
 	}
 
 	DESYNC(0, y);
@@ -310,14 +428,11 @@ u8 MonoReader::read_lz_row_filter(u16 code, ImageReader & CAT_RESTRICT reader, u
 		return 0;
 	}
 
-	// Simple memory move to get it where it needs to be
-	const volatile u8 *src = data - dist;
-	for (int ii = 0; ii < len; ++ii) {
-		data[ii] = src[ii];
-	}
+	LZReader::copyBytes(data, dist, len);
 
 	// Set LZ skip region
 	_lz_xend = x + len;
+	_lz_count += len;
 
 	// After this LZ skip region, the last value will be the prev filter
 	_prev_filter = data[len - 1];
@@ -327,6 +442,13 @@ u8 MonoReader::read_lz_row_filter(u16 code, ImageReader & CAT_RESTRICT reader, u
 }
 
 // Edge-safe row filter version
+u8 MonoReader::read_constant(u16 x, ImageReader & CAT_RESTRICT reader) {
+	CAT_DEBUG_ENFORCE(x < _params.xsize && _current_y < _params.ysize);
+
+	// Store it in case the caller reads the data back
+	return ( _current_row[x] = _constant );
+}
+
 u8 MonoReader::read_row_filter(u16 x, ImageReader & CAT_RESTRICT reader) {
 #ifdef CAT_DEBUG
 	const u16 y = _current_y;
@@ -529,14 +651,11 @@ u8 MonoReader::read_lz_tile(u16 code, ImageReader & CAT_RESTRICT reader, u16 x,
 		return 0;
 	}
 
-	// Simple memory move to get it where it needs to be
-	const volatile u8 *src = data - dist;
-	for (int ii = 0; ii < len; ++ii) {
-		data[ii] = src[ii];
-	}
+	LZReader::copyBytes(data, dist, len);
 
 	// Set LZ skip region
 	_lz_xend = x + len;
+	_lz_count += len;
 
 	// Clear zero region
 	_chaos.zeroRegion(x, len);
@@ -123,13 +123,29 @@ protected:
 	u16 _current_y;
 	u8 *_current_tile;
 
+	// Window state: Rows wrap back to the front of data at _window_end
+	u8 *_window_end;
+	int _window_history;	// Rows kept from before the wrap
+
 	// LZ state
 	bool _lz_enabled;	// LZ enabled in header?
 	LZReader _lz;		// LZ reader subsystem
 	int _lz_xend;		// Next non-LZ pixel x coordinate (to skip over matches, with mask in mind)
+	int _lz_count;		// Values copied by LZ matches
+
+	// Constant plane state
+	bool _is_constant;			// Every read gives _constant without reading bits?
+	bool _constant_predicted;	// Only if every value outside the reads is also _constant?
+	u8 _constant;				// Value of the constant plane
 
 	void cleanup();
 
+	// Detect a plane that decodes to one value without reading any bits
+	void findConstant();
+
+	// Constant version, when every read gives the same value
+	u8 read_constant(u16 x, ImageReader & CAT_RESTRICT reader);
+
 	u8 read_lz_row_filter(u16 code, ImageReader & CAT_RESTRICT reader, u16 x, u8 * CAT_RESTRICT data);
 
 	// Edge-safe row filter version
@@ -152,6 +168,7 @@ protected:
 public:
 	CAT_INLINE MonoReader() {
 		_filter_decoder = 0;
+		_is_constant = false;
 	}
 	CAT_INLINE virtual ~MonoReader() {
 		cleanup();
@@ -161,6 +178,20 @@ public:
 
 	int readRowHeader(u16 y, ImageReader & CAT_RESTRICT reader);
 
+	/*
+	 * Returns how many rows above the current one the reads may look at:
+	 * A couple for the spatial filters, or more for the longest LZ distance
+	 * that the tables can produce.
+	 */
+	int getHistoryRows();
+
+	/*
+	 * Decode into a buffer of window_rows rows, set after readTables().  If
+	 * it has fewer rows than the data, each time it fills up the last
+	 * history_rows rows are moved to the front to make room.
+	 */
+	void setWindow(u8 * CAT_RESTRICT data, int window_rows, int history_rows);
+
 	CAT_INLINE void setupUnordered() {
 		// Set entire matrix to zero to prepare for unordered filter-based reading
 		CAT_CLR(_params.data, _params.xsize * _params.ysize);
@@ -178,8 +209,36 @@ public:
 		return _current_row;
 	}
 
+	CAT_INLINE int getLZCount() {
+		return _lz_count;
+	}
+
+	// Masked pixels that an LZ match ran over are counted as masked instead
+	CAT_INLINE void uncountLZ(u16 x, int len) {
+		if CAT_UNLIKELY(_lz_xend > x) {
+			const int covered = _lz_xend - x;
+			_lz_count -= covered < len ? covered : len;
+		}
+	}
+
+	/*
+	 * Returns true if every read will give the same value without reading
+	 * any bits, so that the caller may skip the reads.
+	 *
+	 * If predicted is set, this only holds when every value that the caller
+	 * skips over (such as masked pixels) is also the same value, since the
+	 * spatial filters predict from them.
+	 */
+	CAT_INLINE bool isConstant(u8 &value, bool &predicted) {
+		value = _constant;
+		predicted = _constant_predicted;
+		return _is_constant;
+	}
+
 	CAT_INLINE ReadDelegate getReadDelegate(bool safe) {
-		if (_use_row_filters) {
+		if (_is_constant && !_constant_predicted) {
+			return ReadDelegate::FromMember<MonoReader, &MonoReader::read_constant>(this);
+		} else if (_use_row_filters) {
 			return ReadDelegate::FromMember<MonoReader, &MonoReader::read_row_filter>(this);
 		} else if (_lz_enabled) {
 			if (safe) {
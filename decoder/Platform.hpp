@@ -311,6 +311,32 @@ namespace cat {
 #endif
 
 
+//// SIMD Instruction Sets ////
+
+// SSE2 and AVX2 are enabled when the compiler is already targeting them.
+// CAT_HAS_SIMD_DISPATCH means SSSE3 and AVX2 functions can be built one at a
+// time with CAT_TARGET_SSSE3 and CAT_TARGET_AVX2, and run after CPUID says so
+#if defined(CAT_ISA_X86) && !defined(CAT_DISABLE_SIMD)
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define CAT_HAS_SSE2
+# endif
+# if defined(CAT_HAS_SSE2) && defined(__AVX2__)
+#  define CAT_HAS_AVX2
+# endif
+# if defined(CAT_HAS_SSE2)
+#  if defined(CAT_COMPILER_MSVC) && _MSC_VER >= 1700
+#   define CAT_HAS_SIMD_DISPATCH
+#   define CAT_TARGET_SSSE3
+#   define CAT_TARGET_AVX2
+#  elif defined(__clang__) || (defined(CAT_COMPILER_GCC) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#   define CAT_HAS_SIMD_DISPATCH
+#   define CAT_TARGET_SSSE3 __attribute__ ((target ("ssse3")))
+#   define CAT_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#  endif
+# endif
+#endif
+
+
 //// Endianness ////
 
 // If no override for endianness from Config.hpp,
@@ -756,6 +782,21 @@ template<typename T> CAT_INLINE T AbsVal(const T &x)
 #endif
 
 
+//// Prefetch ////
+
+// Hint that the cache line at address p will be read soon
+#if defined(CAT_COMPILER_GCC)
+# define CAT_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(CAT_COMPILER_MSVC) && defined(CAT_HAS_SSE2)
+} // namespace cat
+#include <xmmintrin.h>
+namespace cat {
+# define CAT_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char *>( p ), _MM_HINT_T0)
+#else
+# define CAT_PREFETCH(p)
+#endif
+
+
 //// No Copy ////
 
 #define CAT_NO_COPY(T) \
@@ -0,0 +1,243 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "RowPipeline.hpp"
+using namespace cat;
+
+#ifdef CAT_COMPILE_THREADS
+
+#if !defined(CAT_OS_WINDOWS)
+#include <sched.h>
+#endif
+
+
+//// RowPipeline
+
+RowPipeline::RowPipeline() {
+	_slots = 1;
+	_wake_rows = 1;
+	_consume = 0;
+	_produce = 0;
+	_data = 0;
+	_pushed = 0;
+	_claimed = 0;
+	_consumed = 0;
+	_concurrent = false;
+	_started = false;
+	_finished = false;
+
+#if defined(CAT_OS_WINDOWS)
+	InitializeCriticalSection(&_lock);
+	_wake[PRODUCER] = CreateEvent(0, FALSE, FALSE, 0);
+	_wake[CONSUMER] = CreateEvent(0, FALSE, FALSE, 0);
+#else
+	pthread_mutex_init(&_lock, 0);
+	pthread_cond_init(&_wake[PRODUCER], 0);
+	pthread_cond_init(&_wake[CONSUMER], 0);
+#endif
+}
+
+RowPipeline::~RowPipeline() {
+#if defined(CAT_OS_WINDOWS)
+	CloseHandle(_wake[PRODUCER]);
+	CloseHandle(_wake[CONSUMER]);
+	DeleteCriticalSection(&_lock);
+#else
+	pthread_cond_destroy(&_wake[PRODUCER]);
+	pthread_cond_destroy(&_wake[CONSUMER]);
+	pthread_mutex_destroy(&_lock);
+#endif
+}
+
+void RowPipeline::signal(int side) {
+#if defined(CAT_OS_WINDOWS)
+	SetEvent(_wake[side]);
+#else
+	pthread_cond_signal(&_wake[side]);
+#endif
+}
+
+void RowPipeline::wait(int side) {
+#if defined(CAT_OS_WINDOWS)
+	// Auto-reset events stay set until a wait, so no wake up is lost here
+	unlock();
+	WaitForSingleObject(_wake[side], INFINITE);
+	lock();
+#else
+	pthread_cond_wait(&_wake[side], &_lock);
+#endif
+}
+
+void RowPipeline::consumeNext() {
+	const int row = _claimed++;
+
+	// If there is more to hand out, pass the wake up on to another consumer
+	if (canClaim()) {
+		signal(CONSUMER);
+	}
+
+	unlock();
+
+	_consume(_data, row);
+
+	lock();
+
+	// Free the slots of the leading rows that are done
+	_done[getSlot(row)] = 1;
+	while (_consumed < _claimed && _done[getSlot(_consumed)]) {
+		_done[getSlot(_consumed)] = 0;
+		++_consumed;
+	}
+
+	// Either side may be waiting on this row
+	signal(PRODUCER);
+	signal(CONSUMER);
+}
+
+void RowPipeline::consume() {
+	lock();
+
+	for (;;) {
+		if (canClaim()) {
+			consumeNext();
+		} else if (_finished && _claimed >= _pushed) {
+			// Pass the news on to any other consumer still waiting
+			signal(CONSUMER);
+			break;
+		} else {
+			wait(CONSUMER);
+		}
+	}
+
+	unlock();
+}
+
+void RowPipeline::consumePushed() {
+	// Help with the rows that are left
+	while (_consumed < _pushed) {
+		if (canClaim()) {
+			consumeNext();
+		} else {
+			wait(PRODUCER);
+		}
+	}
+}
+
+void RowPipeline::finish() {
+	lock();
+
+	_finished = true;
+	signal(CONSUMER);
+
+	consumePushed();
+
+	unlock();
+}
+
+void RowPipeline::start(int slots, ProduceFunction produce, RowFunction consume, void *data, bool concurrent) {
+	_slots = slots > 1 ? slots : 1;
+	_wake_rows = (_slots + 1) / 2;
+	_produce = produce;
+	_consume = consume;
+	_data = data;
+	_pushed = 0;
+	_claimed = 0;
+	_consumed = 0;
+	_concurrent = concurrent;
+	_started = false;
+	_finished = false;
+
+	_done.resize(_slots);
+	_done.fill_00();
+}
+
+void RowPipeline::push() {
+	lock();
+
+	++_pushed;
+
+	// Wake the consumer once it has a few rows to work through, rather than
+	// bouncing between the threads for every row
+	if (_pushed - _consumed >= _wake_rows) {
+		signal(CONSUMER);
+	}
+
+	// While the slot for the next row is still in use,
+	while (_pushed - _consumed >= _slots) {
+		// If no consumer is on it already, do it here
+		if (canClaim()) {
+			consumeNext();
+		} else {
+			wait(PRODUCER);
+		}
+	}
+
+	unlock();
+}
+
+void RowPipeline::drain() {
+	lock();
+
+	consumePushed();
+
+	unlock();
+}
+
+void RowPipeline::run() {
+	lock();
+	const bool producer = !_started;
+	_started = true;
+	unlock();
+
+	if (producer) {
+		_produce(_data);
+		finish();
+	} else {
+		consume();
+	}
+}
+
+u32 RowPipeline::waitProgress(const volatile u32 *progress, u32 value) {
+	u32 reached;
+
+	// Spin briefly, since the other thread is usually just a few pixels away
+	for (int spins = 0; (reached = loadProgress(progress)) < value; ++spins) {
+		// If it is taking a while, let the other thread have the core
+		if (spins >= 64) {
+#if defined(CAT_OS_WINDOWS)
+			SwitchToThread();
+#else
+			sched_yield();
+#endif
+		}
+	}
+
+	return reached;
+}
+
+#endif // CAT_COMPILE_THREADS
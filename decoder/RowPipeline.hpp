@@ -0,0 +1,202 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_ROW_PIPELINE_HPP
+#define CAT_ROW_PIPELINE_HPP
+
+#include "Platform.hpp"
+#include "SmartArray.hpp"
+
+#ifdef CAT_COMPILE_THREADS
+
+#if defined(CAT_OS_WINDOWS)
+# include "WindowsInclude.hpp"
+#else
+# include <pthread.h>
+#endif
+
+/*
+ * Row pipeline for the decoder
+ *
+ * A producer finishes rows in order into a ring of slots, and consumers work
+ * through them a few rows behind on other threads.
+ *
+ * Rows are handed out in order to whichever thread asks first.  When the ring
+ * is full the producer consumes the oldest row itself, and finish() consumes
+ * whatever is left.  So nothing waits on a thread that may never run: if the
+ * pool runs the jobs one after the other, the first does all of the work and
+ * the rest find nothing left to do.
+ *
+ * By default a row is not handed out until the one before it is consumed, so
+ * rows are consumed one at a time.  Started as concurrent, rows are handed
+ * out as soon as they are pushed, and the consumer waits on the rows it needs
+ * with the progress counters below.  A row only ever waits on earlier rows,
+ * which were handed out first to threads that are running, so this cannot
+ * deadlock either.
+ *
+ * Every job calls run(), and the first one in is the producer.
+ */
+
+namespace cat {
+
+
+//// RowPipeline
+
+class RowPipeline {
+public:
+	// Called with each row in order
+	typedef void (*RowFunction)(void *data, int row);
+
+	// Called once on the producer thread to produce all rows with push()
+	typedef void (*ProduceFunction)(void *data);
+
+protected:
+	enum Side {
+		PRODUCER,
+		CONSUMER
+	};
+
+#if defined(CAT_OS_WINDOWS)
+	CRITICAL_SECTION _lock;
+	HANDLE _wake[2];
+#else
+	pthread_mutex_t _lock;
+	pthread_cond_t _wake[2];
+#endif
+
+	int _slots, _wake_rows;
+	RowFunction _consume;
+	ProduceFunction _produce;
+	void *_data;
+
+	// Guarded by the lock
+	int _pushed, _claimed, _consumed;
+	SmartArray<u8> _done;	// Slots consumed out of order
+	bool _concurrent;	// Hand out rows before the last one is consumed?
+	bool _started;		// Producer has been claimed
+	bool _finished;		// Producer is done pushing rows
+
+	CAT_INLINE bool canClaim() {
+		return _claimed < _pushed && (_concurrent || _claimed == _consumed);
+	}
+
+	CAT_INLINE void lock() {
+#if defined(CAT_OS_WINDOWS)
+		EnterCriticalSection(&_lock);
+#else
+		pthread_mutex_lock(&_lock);
+#endif
+	}
+
+	CAT_INLINE void unlock() {
+#if defined(CAT_OS_WINDOWS)
+		LeaveCriticalSection(&_lock);
+#else
+		pthread_mutex_unlock(&_lock);
+#endif
+	}
+
+	// Wake the other side if it is waiting
+	void signal(int side);
+
+	// Wait while locked for the other side to make progress
+	void wait(int side);
+
+	// Consume the next row while locked, unlocking around the work
+	void consumeNext();
+
+	// Consume rows until the producer is done and none are left
+	void consume();
+
+	// Consume rows while locked until every row pushed so far is done
+	void consumePushed();
+
+	// Mark the producer done and consume the rest of the rows
+	void finish();
+
+public:
+	RowPipeline();
+	virtual ~RowPipeline();
+
+	// Set up before the jobs run, with slots rows in the ring
+	void start(int slots, ProduceFunction produce, RowFunction consume, void *data, bool concurrent = false);
+
+	CAT_INLINE int getSlotCount() {
+		return _slots;
+	}
+
+	// Ring slot for a row
+	CAT_INLINE int getSlot(int row) {
+		return row % _slots;
+	}
+
+	// Producer: the next row is in its slot.  Returns once the slot for the
+	// row after it is free
+	void push();
+
+	// Producer: returns once every row pushed so far has been consumed
+	void drain();
+
+	// Job entrypoint for every thread
+	void run();
+
+	/*
+	 * Progress counters let a consumer publish how far along a row it is,
+	 * and another wait for it, without taking the lock.  Writes made before
+	 * storeProgress() are seen by a thread once loadProgress() returns the
+	 * value stored.
+	 */
+	static CAT_INLINE void storeProgress(volatile u32 *progress, u32 value) {
+#if defined(CAT_COMPILER_COMPAT_GCC)
+		__atomic_store_n(progress, value, __ATOMIC_RELEASE);
+#else
+		CAT_FENCE_COMPILER
+		*progress = value;
+#endif
+	}
+
+	static CAT_INLINE u32 loadProgress(const volatile u32 *progress) {
+#if defined(CAT_COMPILER_COMPAT_GCC)
+		return __atomic_load_n(progress, __ATOMIC_ACQUIRE);
+#else
+		const u32 value = *progress;
+		CAT_FENCE_COMPILER
+		return value;
+#endif
+	}
+
+	// Wait for a counter to reach at least value, and return what it reached
+	static u32 waitProgress(const volatile u32 *progress, u32 value);
+};
+
+
+} // namespace cat
+
+#endif // CAT_COMPILE_THREADS
+
+#endif // CAT_ROW_PIPELINE_HPP
@@ -57,11 +57,18 @@ int SmallPaletteReader::readSmallPalette(ImageReader & CAT_RESTRICT reader) {
 	} else if (_palette_size > 1) { // 1 bit/pixel
 		_pack_x = (_xsize + 3) >> 2;
 		_pack_y = (_ysize + 1) >> 1;
-	} else {
-		// Just emit that single color and done!
-		int count = _ysize * _xsize;
-		const u32 COLOR = _palette[0];
-		u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( _rgba );
+	}
+
+	return GCIF_RE_OK;
+}
+
+void SmallPaletteReader::emitSingleColor() {
+	const u32 COLOR = _palette[0];
+
+	for (int y = 0, yend = _output->getRowEnd(); y < yend; ++y) {
+		u32 * CAT_RESTRICT rgba = reinterpret_cast<u32 *>( _output->getRows(y, 1) );
+		const u32 *row = rgba;
+		int count = _xsize;
 
 		// Unroll sets of 4 words for this incredibly important case
 		while (count >= 4) {
@@ -77,9 +84,9 @@ int SmallPaletteReader::readSmallPalette(ImageReader & CAT_RESTRICT reader) {
 			*rgba++ = COLOR;
 			--count;
 		}
-	}
 
-	return GCIF_RE_OK;
+		_output->writeRow(y, reinterpret_cast<const u8 *>( row ));
+	}
 }
 
 int SmallPaletteReader::readPackPalette(ImageReader & CAT_RESTRICT reader) {
@@ -115,8 +122,14 @@ int SmallPaletteReader::readTables(ImageReader & CAT_RESTRICT reader) {
 	return _mono_decoder.readTables(params, reader);
 }
 
+void SmallPaletteReader::maskRun(int x, int len) {
+	memset(_mono_decoder.currentRow() + x, _mask_palette, len);
+	_mono_decoder.zeroRegion(x, len);
+	_mono_decoder.uncountLZ(x, len);
+}
+
 int SmallPaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
-	const u8 MASK_PAL = _mask_palette;
+	const int xend = _pack_x;
 
 	// Set up read delegates
 	MonoReader::ReadDelegate read_safe = _mono_decoder.getReadDelegate(true);
@@ -130,22 +143,11 @@ int SmallPaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 
 		_mono_decoder.readRowHeader(y, reader);
 
-		const u32 *mask_next = _mask->nextScanline();
-		int mask_left = 0;
-		u32 mask;
+		const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		for (int x = 0, xend = _pack_x; x < xend; ++x) {
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
-			}
-
-			if ((s32)mask < 0) {
-				u8 *p = _mono_decoder.currentRow() + x;
-				_mono_decoder.zero(x);
-				*p = MASK_PAL;
-			} else {
+		for (int x = 0;; ++run) {
+			// Read up to the next masked run
+			for (const int xmask = run->x; x < xmask; ++x) {
 #ifdef CAT_DEBUG
 				u8 index =
 #endif
@@ -154,56 +156,38 @@ int SmallPaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 				CAT_DEBUG_ENFORCE(index < _pack_palette_size);
 			}
 
-			mask <<= 1;
+			if (x >= xend) {
+				break;
+			}
+
+			maskRun(x, run->len);
+			x += run->len;
 		}
 	}
 
 	// For each remaining scanline,
-	for (int y = 1, yend = _pack_y; y < yend; ++y) {
+	for (int y = 1, yend = _pack_end; y < yend; ++y) {
 		_mono_decoder.readRowHeader(y, reader);
 
-		const u32 *mask_next = _mask->nextScanline();
-		int mask_left;
-		u32 mask;
+		const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		// Unroll x = 0
-		{
-			const u16 x = 0;
+		for (int x = 0;; ++run) {
+			const int xmask = run->x;
 
-			// Next mask word
-			mask = *mask_next++;
-			mask_left = 31;
-
-			if ((s32)mask < 0) {
-				u8 *p = _mono_decoder.currentRow() + x;
-				_mono_decoder.zero(x);
-				*p = MASK_PAL;
-			} else {
+			// Unroll x = 0
+			if (x == 0 && xmask > 0) {
 #ifdef CAT_DEBUG
 				u8 index =
 #endif
 				read_safe(x, reader);
 
 				CAT_DEBUG_ENFORCE(index < _pack_palette_size);
+				++x;
 			}
 
-			mask <<= 1;
-		}
-
-		//// THIS IS THE INNER LOOP ////
+			//// THIS IS THE INNER LOOP ////
 
-		for (int x = 1, xend = (int)_pack_x - 1; x < xend; ++x) {
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
-			}
-
-			if ((s32)mask < 0) {
-				u8 *p = _mono_decoder.currentRow() + x;
-				_mono_decoder.zero(x);
-				*p = MASK_PAL;
-			} else {
+			for (const int xunsafe = xmask < xend - 1 ? xmask : xend - 1; x < xunsafe; ++x) {
 #ifdef CAT_DEBUG
 				u8 index =
 #endif
@@ -212,57 +196,38 @@ int SmallPaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 				CAT_DEBUG_ENFORCE(index < _pack_palette_size);
 			}
 
-			mask <<= 1;
-		}
-
-		//// THIS IS THE INNER LOOP ////
-
-		// Unroll x = pack_x - 1
-		{
-			const int x = _pack_x - 1;
-
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
-			}
+			//// THIS IS THE INNER LOOP ////
 
-			if ((s32)mask < 0) {
-				u8 *p = _mono_decoder.currentRow() + x;
-				_mono_decoder.zero(x);
-				*p = MASK_PAL;
-			} else {
+			// Unroll x = pack_x - 1
+			if (x < xmask) {
 #ifdef CAT_DEBUG
 				u8 index =
 #endif
 				read_safe(x, reader);
 
 				CAT_DEBUG_ENFORCE(index < _pack_palette_size);
+				++x;
+			}
+
+			if (x >= xend) {
+				break;
 			}
+
+			maskRun(x, run->len);
+			x += run->len;
 		}
 	}
 
 #else
 
-	for (int y = 0, yend = _pack_y; y < yend; ++y) {
+	for (int y = 0, yend = _pack_end; y < yend; ++y) {
 		_mono_decoder.readRowHeader(y, reader);
 
-		const u32 *mask_next = _mask->nextScanline();
-		int mask_left = 0;
-		u32 mask;
+		const ImageMaskReader::Run * CAT_RESTRICT run = _mask->nextScanlineRuns();
 
-		for (int x = 0, xend = _pack_x; x < xend; ++x) {
-			// Next mask word
-			if (mask_left-- <= 0) {
-				mask = *mask_next++;
-				mask_left = 31;
-			}
-
-			if ((s32)mask < 0) {
-				u8 *p = _mono_decoder.currentRow() + x;
-				_mono_decoder.zero(x);
-				*p = MASK_PAL;
-			} else {
+		for (int x = 0;; ++run) {
+			// Read up to the next masked run
+			for (const int xmask = run->x; x < xmask; ++x) {
 #ifdef CAT_DEBUG
 				u8 index =
 #endif
@@ -271,7 +236,12 @@ int SmallPaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 				CAT_DEBUG_ENFORCE(index < _pack_palette_size);
 			}
 
-			mask <<= 1;
+			if (x >= xend) {
+				break;
+			}
+
+			maskRun(x, run->len);
+			x += run->len;
 		}
 	}
 
@@ -280,28 +250,60 @@ int SmallPaletteReader::readPixels(ImageReader & CAT_RESTRICT reader) {
 	return GCIF_RE_OK;
 }
 
+void SmallPaletteReader::initUnpack(int stride) {
+	_unpack.resize(MAX_SYMS * stride);
+	u32 * CAT_RESTRICT unpack = _unpack.get();
+
+	// For each packed symbol, write the pixels it covers: the top row first,
+	// followed by the bottom row for layouts that pack two rows together
+	for (int sym = 0; sym < _pack_palette_size; ++sym, unpack += stride) {
+		u8 p = _pack_palette[sym];
+
+		switch (stride) {
+		case 2: // 3-4 bits/pixel
+			unpack[0] = _palette[p >> 4];
+			unpack[1] = _palette[p & 15];
+			break;
+		case 4: // 2 bits/pixel
+			unpack[0] = _palette[p & 3];
+			unpack[1] = _palette[(p >> 2) & 3];
+			unpack[2] = _palette[(p >> 4) & 3];
+			unpack[3] = _palette[p >> 6];
+			break;
+		default: // 1 bit/pixel
+			for (int ii = 0; ii < 8; ++ii) {
+				unpack[ii] = _palette[(p >> (7 - ii)) & 1];
+			}
+			break;
+		}
+	}
+}
+
 int SmallPaletteReader::unpackPixels() {
 	CAT_DEBUG_ENFORCE(_pack_palette_size > 1);
 
-	u32 *rgba = reinterpret_cast<u32 *>( _rgba );
 	const u8 *image = _image.get();
+	// Output rows may be further apart than the image width
+	const int row_bytes = _output->getRowPitch();
+	const int pitch = row_bytes >> 2;
 
 	if (_palette_size > 4) { // 3-4 bits/pixel
 		CAT_DEBUG_ENFORCE(_pack_y == _ysize);
 		CAT_DEBUG_ENFORCE(_pack_x == (_xsize+1)/2);
 
-		for (int y = 0; y < _pack_y; ++y) {
-			u32 *pixel = rgba;
+		initUnpack(2);
+		const u32 * CAT_RESTRICT unpack = _unpack.get();
+
+		for (int y = 0; y < _pack_end; ++y) {
+			u8 *row = _output->getRows(y, 1);
+			u32 *pixel = reinterpret_cast<u32 *>( row );
 
 			for (int x = 0, xlen = _xsize >> 1; x < xlen; ++x, pixel += 2) {
 				u8 p = *image++;
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				pixel[0] = _palette[p >> 4];
-				pixel[1] = _palette[p & 15];
+				memcpy(pixel, unpack + p * 2, 2 * sizeof(u32));
 			}
 
 			if (_xsize & 1) {
@@ -314,26 +316,30 @@ int SmallPaletteReader::unpackPixels() {
 				pixel[0] = _palette[p];
 			}
 
-			rgba += _xsize;
+			_output->writeRow(y, row);
 		}
 	} else if (_palette_size > 2) { // 2 bits/pixel
 		CAT_DEBUG_ENFORCE(_pack_y == (_ysize+1)/2);
 		CAT_DEBUG_ENFORCE(_pack_x == (_xsize+1)/2);
 
-		for (int y = 0, ylen = _ysize >> 1; y < ylen; ++y) {
-			u32 *pixel = rgba;
+		initUnpack(4);
+		const u32 * CAT_RESTRICT unpack = _unpack.get();
+
+		// Packed rows that cover two image rows
+		const int pair_end = (_pack_end < (_ysize >> 1)) ? _pack_end : (_ysize >> 1);
+
+		for (int y = 0; y < pair_end; ++y) {
+			u8 *row = _output->getRows(y * 2, 2);
+			u32 *pixel = reinterpret_cast<u32 *>( row );
 
 			for (int x = 0, xlen = _xsize >> 1; x < xlen; ++x, pixel += 2) {
 				u8 p = *image++;
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				pixel[0] = _palette[p & 3];
-				pixel[1] = _palette[(p >> 2) & 3];
-				pixel[_xsize] = _palette[(p >> 4) & 3];
-				pixel[_xsize+1] = _palette[p >> 6];
+				const u32 *src = unpack + p * 4;
+				memcpy(pixel, src, 2 * sizeof(u32));
+				memcpy(pixel + pitch, src + 2, 2 * sizeof(u32));
 			}
 
 			if (_xsize & 1) {
@@ -341,27 +347,26 @@ int SmallPaletteReader::unpackPixels() {
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				pixel[0] = _palette[p & 3];
-				pixel[_xsize] = _palette[(p >> 4) & 3];
+				const u32 *src = unpack + p * 4;
+				pixel[0] = src[0];
+				pixel[pitch] = src[2];
 			}
 
-			rgba += _xsize;
+			_output->writeRow(y * 2, row);
+			_output->writeRow(y * 2 + 1, row + row_bytes);
 		}
 
-		if (_ysize & 1) {
-			u32 *pixel = rgba;
+		// If the last image row is needed and unpaired,
+		if (pair_end < _pack_end) {
+			u8 *row = _output->getRows(pair_end * 2, 1);
+			u32 *pixel = reinterpret_cast<u32 *>( row );
 
 			for (int x = 0, xlen = _xsize >> 1; x < xlen; ++x, pixel += 2) {
 				u8 p = *image++;
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				pixel[0] = _palette[p & 3];
-				pixel[1] = _palette[(p >> 2) & 3];
+				memcpy(pixel, unpack + p * 4, 2 * sizeof(u32));
 			}
 
 			if (_xsize & 1) {
@@ -369,115 +374,86 @@ int SmallPaletteReader::unpackPixels() {
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				pixel[0] = _palette[p & 3];
+				pixel[0] = unpack[p * 4];
 			}
+
+			_output->writeRow(pair_end * 2, row);
 		}
 	} else { // 1 bit/pixel
 		CAT_DEBUG_ENFORCE(_pack_y == (_ysize+1)/2);
 		CAT_DEBUG_ENFORCE(_pack_x == (_xsize+3)/4);
 
-		int x, xlen = _xsize >> 2;
-		for (int y = 0, ylen = _ysize >> 1; y < ylen; ++y) {
-			u32 *pixel = rgba;
+		initUnpack(8);
+		const u32 * CAT_RESTRICT unpack = _unpack.get();
 
-			for (x = 0; x < xlen; ++x, pixel += 4) {
-				u8 p = *image++;
+		// Packed rows that cover two image rows
+		const int pair_end = (_pack_end < (_ysize >> 1)) ? _pack_end : (_ysize >> 1);
 
-				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
+		// Pixels covered by the last packed byte of each row
+		const int xlen = _xsize >> 2, xtail = _xsize & 3;
 
-				p = _pack_palette[p];
-
-				// Unpack byte into 8 pixels
-				pixel[0] = _palette[(p >> 7) & 1];
-				pixel[1] = _palette[(p >> 6) & 1];
-				pixel[2] = _palette[(p >> 5) & 1];
-				pixel[3] = _palette[(p >> 4) & 1];
-				u32 *next = pixel + _xsize;
-				next[0] = _palette[(p >> 3) & 1];
-				next[1] = _palette[(p >> 2) & 1];
-				next[2] = _palette[(p >> 1) & 1];
-				next[3] = _palette[p & 1];
-			}
+		for (int y = 0; y < pair_end; ++y) {
+			u8 *row = _output->getRows(y * 2, 2);
+			u32 *pixel = reinterpret_cast<u32 *>( row );
 
-			if (_xsize & 3) {
+			// Unpack each byte into 8 pixels
+			for (int x = 0; x < xlen; ++x, pixel += 4) {
 				u8 p = *image++;
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
+				const u32 *src = unpack + p * 8;
+				memcpy(pixel, src, 4 * sizeof(u32));
+				memcpy(pixel + pitch, src + 4, 4 * sizeof(u32));
+			}
 
-				u32 *out = pixel;
-				for (int jj = 0; jj < 2; ++jj) {
-					for (int ii = 0; ii < 4; ++ii) {
-						int px = x + ii, py = y + jj;
+			if (xtail) {
+				u8 p = *image++;
 
-						if (px < _xsize && py < _ysize) {
-							out[ii] = _palette[p >> 7];
-						}
+				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-						p <<= 1;
-					}
-					out += _xsize;
-				}
+				const u32 *src = unpack + p * 8;
+				memcpy(pixel, src, xtail * sizeof(u32));
+				memcpy(pixel + pitch, src + 4, xtail * sizeof(u32));
 			}
 
-			rgba += _xsize << 1;
+			_output->writeRow(y * 2, row);
+			_output->writeRow(y * 2 + 1, row + row_bytes);
 		}
 
-		if (_ysize & 1) {
-			u32 *pixel = rgba;
+		// If the last image row is needed and unpaired,
+		if (pair_end < _pack_end) {
+			u8 *row = _output->getRows(pair_end * 2, 1);
+			u32 *pixel = reinterpret_cast<u32 *>( row );
 
-			for (x = 0, xlen = _xsize >> 2; x < xlen; ++x, pixel += 4) {
+			for (int x = 0; x < xlen; ++x, pixel += 4) {
 				u8 p = *image++;
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				// Unpack byte into 8 pixels
-				pixel[0] = _palette[(p >> 7) & 1];
-				pixel[1] = _palette[(p >> 6) & 1];
-				pixel[2] = _palette[(p >> 5) & 1];
-				pixel[3] = _palette[(p >> 4) & 1];
+				memcpy(pixel, unpack + p * 8, 4 * sizeof(u32));
 			}
 
-			if (_xsize & 3) {
+			if (xtail) {
 				u8 p = *image++;
 
 				CAT_DEBUG_ENFORCE(p < _pack_palette_size);
 
-				p = _pack_palette[p];
-
-				for (int ii = 0; ii < 4; ++ii) {
-					int px = x + ii;
-
-					if (px < _xsize) {
-						pixel[ii] = _palette[p >> 7];
-					}
-
-					p <<= 1;
-				}
+				memcpy(pixel, unpack + p * 8, xtail * sizeof(u32));
 			}
+
+			_output->writeRow(pair_end * 2, row);
 		}
 	}
 
 	return GCIF_RE_OK;
 }
 
-int SmallPaletteReader::readHead(ImageReader & CAT_RESTRICT reader, u8 * CAT_RESTRICT rgba) {
+int SmallPaletteReader::readInfo(ImageReader & CAT_RESTRICT reader) {
 	// Initialize dimensions
 	ImageReader::Header *header = reader.getHeader();
 	_xsize = header->xsize;
 	_ysize = header->ysize;
-	_rgba = rgba;
-
-#ifdef CAT_COLLECT_STATS
-	m_clock = Clock::ref();
-
-	double t0 = m_clock->usec();
-#endif // CAT_COLLECT_STATS
 
 	// If enabled,
 	if (reader.readBit()) {
@@ -488,6 +464,45 @@ int SmallPaletteReader::readHead(ImageReader & CAT_RESTRICT reader, u8 * CAT_RES
 		_palette_size = 0;
 	}
 
+	return GCIF_RE_OK;
+}
+
+int SmallPaletteReader::readHead(ImageReader & CAT_RESTRICT reader, ImageOutput & CAT_RESTRICT output) {
+	_output = &output;
+
+#ifdef CAT_COLLECT_STATS
+	m_clock = Clock::ref();
+
+	double t0 = m_clock->usec();
+#endif // CAT_COLLECT_STATS
+
+	int err;
+
+	if ((err = readInfo(reader))) {
+		return err;
+	}
+
+	// If enabled,
+	if (enabled()) {
+		// If the output format can be written from the palette, convert it once
+		if (output.usePalette()) {
+			output.convertColors(_palette, _palette_size);
+		}
+
+		if (multipleColors()) {
+			// Packed rows cover one or two image rows
+			const int row_end = output.getRowEnd();
+			_pack_end = (_pack_y == _ysize) ? row_end : (row_end + 1) >> 1;
+		} else {
+			reader.markSection(GCIF_SECTION_HEAD);
+
+			// Just emit that single color and done!
+			emitSingleColor();
+
+			reader.markSection(GCIF_SECTION_PIXELS);
+		}
+	}
+
 #ifdef CAT_COLLECT_STATS
 	double t1 = m_clock->usec();
 
@@ -522,6 +537,8 @@ int SmallPaletteReader::readTail(ImageReader & CAT_RESTRICT reader, ImageMaskRea
 		return err;
 	}
 
+	reader.markSection(GCIF_SECTION_TABLES);
+
 #ifdef CAT_COLLECT_STATS
 	double t2 = m_clock->usec();
 #endif // CAT_COLLECT_STATS
@@ -538,6 +555,8 @@ int SmallPaletteReader::readTail(ImageReader & CAT_RESTRICT reader, ImageMaskRea
 		return err;
 	}
 
+	reader.markSection(GCIF_SECTION_PIXELS);
+
 #ifdef CAT_COLLECT_STATS
 	double t4 = m_clock->usec();
 
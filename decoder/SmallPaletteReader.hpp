@@ -34,6 +34,7 @@
 #include "ImageReader.hpp"
 #include "ImageMaskReader.hpp"
 #include "MonoReader.hpp"
+#include "ImageOutput.hpp"
 
 #include <vector>
 #include <map>
@@ -59,8 +60,9 @@ protected:
 
 	ImageMaskReader * CAT_RESTRICT _mask;
 
-	u8 * CAT_RESTRICT _rgba;
+	ImageOutput * CAT_RESTRICT _output;
 	u16 _xsize, _ysize, _pack_x, _pack_y;
+	u16 _pack_end;	// Packed rows needed for the output
 
 	SmartArray<u8> _image;
 
@@ -68,12 +70,22 @@ protected:
 	u8 _pack_palette[MAX_SYMS];
 	u8 _mask_palette;	// Masked palette index
 
+	// Pixels covered by each packed symbol, see initUnpack()
+	SmartArray<u32> _unpack;
+
 	MonoReader _mono_decoder;
 
 	int readSmallPalette(ImageReader & CAT_RESTRICT reader);
 	int readPackPalette(ImageReader & CAT_RESTRICT reader);
+	void emitSingleColor();
 	int readTables(ImageReader & CAT_RESTRICT reader);
+	// Fill a run of masked pixels
+	void maskRun(int x, int len);
+
 	int readPixels(ImageReader & CAT_RESTRICT reader);
+
+	// Expand each packed symbol into stride pixels up front
+	void initUnpack(int stride);
 	int unpackPixels();
 
 #ifdef CAT_COLLECT_STATS
@@ -98,7 +110,14 @@ public:
 		return _palette_size > 1;
 	}
 
-	int readHead(ImageReader & CAT_RESTRICT reader, u8 * CAT_RESTRICT rgba);
+	CAT_INLINE int getPaletteSize() {
+		return _palette_size;
+	}
+
+	// Read just the small palette without writing any pixels
+	int readInfo(ImageReader & CAT_RESTRICT reader);
+
+	int readHead(ImageReader & CAT_RESTRICT reader, ImageOutput & CAT_RESTRICT output);
 	int readTail(ImageReader & CAT_RESTRICT reader, ImageMaskReader & CAT_RESTRICT mask);
 
 	CAT_INLINE u16 getPackX() {
@@ -108,6 +127,16 @@ public:
 		return _pack_y;
 	}
 
+	// Packed rows decoded for the output
+	CAT_INLINE u16 getPackEnd() {
+		return _pack_end;
+	}
+
+	// Packed bytes copied by LZ matches
+	CAT_INLINE int getLZCount() {
+		return _mono_decoder.getLZCount();
+	}
+
 #ifdef CAT_COLLECT_STATS
 	bool dumpStats();
 #else
@@ -128,6 +128,7 @@ public:
 	CAT_INLINE SmartArray() {
 		_data = 0;
 		_size = 0;
+		_alloc = 0;
 	}
 	CAT_INLINE virtual ~SmartArray() {
 		if (_data) {
@@ -160,6 +161,27 @@ public:
 		_size = size;
 	}
 
+	// Resize and keep the existing contents, growing geometrically
+	void resizeKeep(int size) {
+		if (!_data) {
+			alloc(size);
+		} else if (size > _alloc) {
+			int alloc_size = _alloc * 2;
+			if (alloc_size < size) {
+				alloc_size = size;
+			}
+
+			T *data = aligned_malloc(alloc_size);
+			memcpy(data, _data, _size * sizeof(T));
+			aligned_free(_data);
+
+			_data = data;
+			_alloc = alloc_size;
+		}
+
+		_size = size;
+	}
+
 	CAT_INLINE void fill_00() {
 		CAT_DEBUG_ENFORCE(_data != 0);
 
@@ -178,6 +200,25 @@ public:
 		return _size;
 	}
 
+	// Elements that fit before the memory has to move
+	CAT_INLINE int capacity() {
+		return _alloc;
+	}
+
+	// Trade memory with another array
+	CAT_INLINE void swap(SmartArray<T> &other) {
+		T *data = _data;
+		const int size = _size, alloc = _alloc;
+
+		_data = other._data;
+		_size = other._size;
+		_alloc = other._alloc;
+
+		other._data = data;
+		other._size = size;
+		other._alloc = alloc;
+	}
+
 	CAT_INLINE T *get() {
 		CAT_DEBUG_ENFORCE(_data != 0);
 
@@ -0,0 +1,332 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ThreadPool.hpp"
+using namespace cat;
+
+#ifdef CAT_COMPILE_THREADS
+
+#if defined(CAT_OS_WINDOWS)
+#include <process.h>
+#endif
+
+
+//// ThreadPool
+
+ThreadPool::ThreadPool() {
+	_worker_count = 0;
+	_quit = false;
+	_batch = 0;
+	_busy = false;
+	_queue_count = 0;
+	_remaining = 0;
+
+#if defined(CAT_OS_WINDOWS)
+	InitializeCriticalSection(&_lock);
+	_wake = CreateSemaphore(0, 0, MAX_THREADS * 2, 0);
+	_done = CreateEvent(0, FALSE, FALSE, 0);
+#else
+	pthread_mutex_init(&_lock, 0);
+	pthread_cond_init(&_wake, 0);
+	pthread_cond_init(&_done, 0);
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+	cleanup();
+
+#if defined(CAT_OS_WINDOWS)
+	CloseHandle(_wake);
+	CloseHandle(_done);
+	DeleteCriticalSection(&_lock);
+#else
+	pthread_cond_destroy(&_wake);
+	pthread_cond_destroy(&_done);
+	pthread_mutex_destroy(&_lock);
+#endif
+}
+
+void ThreadPool::cleanup() {
+	if (_worker_count <= 0) {
+		return;
+	}
+
+	// Wake everyone up and tell them to quit
+	lock();
+	_quit = true;
+#if defined(CAT_OS_WINDOWS)
+	ReleaseSemaphore(_wake, _worker_count, 0);
+#else
+	pthread_cond_broadcast(&_wake);
+#endif
+	unlock();
+
+	for (int ii = 0; ii < _worker_count; ++ii) {
+#if defined(CAT_OS_WINDOWS)
+		WaitForSingleObject(_workers[ii].thread, INFINITE);
+		CloseHandle(_workers[ii].thread);
+#else
+		pthread_join(_workers[ii].thread, 0);
+#endif
+	}
+
+	_worker_count = 0;
+	_quit = false;
+}
+
+bool ThreadPool::init(int thread_count) {
+	cleanup();
+
+	if (thread_count > MAX_THREADS) {
+		thread_count = MAX_THREADS;
+	}
+
+	// For each worker thread to start,
+	for (int ii = 0; ii < thread_count - 1; ++ii) {
+		Worker *worker = &_workers[ii];
+		worker->pool = this;
+		worker->index = ii + 1;
+
+#if defined(CAT_OS_WINDOWS)
+		u32 thread_id;
+		worker->thread = (HANDLE)_beginthreadex(0, 0, &ThreadPool::WorkerWrapper, worker, 0, &thread_id);
+		if (!worker->thread) {
+			return false;
+		}
+		worker->id = thread_id;
+#else
+		if (pthread_create(&worker->thread, 0, &ThreadPool::WorkerWrapper, worker)) {
+			return false;
+		}
+#endif
+
+		++_worker_count;
+	}
+
+	return true;
+}
+
+#if defined(CAT_OS_WINDOWS)
+
+unsigned int __stdcall ThreadPool::WorkerWrapper(void *param) {
+	Worker *worker = reinterpret_cast<Worker *>( param );
+
+	worker->pool->workerLoop(worker->index);
+
+	_endthreadex(0);
+	return 0;
+}
+
+#else
+
+void *ThreadPool::WorkerWrapper(void *param) {
+	Worker *worker = reinterpret_cast<Worker *>( param );
+
+	worker->pool->workerLoop(worker->index);
+
+	return 0;
+}
+
+#endif
+
+int ThreadPool::callerIndex() {
+	for (int ii = 0; ii < _worker_count; ++ii) {
+#if defined(CAT_OS_WINDOWS)
+		if (_workers[ii].id == GetCurrentThreadId()) {
+#else
+		if (pthread_equal(_workers[ii].thread, pthread_self())) {
+#endif
+			return _workers[ii].index;
+		}
+	}
+
+	return 0;
+}
+
+bool ThreadPool::nextJob(int thread_index, int &job_index) {
+	const int queue_count = _queue_count;
+
+	// If this thread has jobs of its own left,
+	Queue *queue = &_queues[thread_index];
+	if (thread_index < queue_count && queue->front < queue->back) {
+		job_index = thread_index + queue->front++ * queue_count;
+		return true;
+	}
+
+	// Find the thread with the most jobs left
+	int victim = -1, most = 0;
+	for (int ii = 0; ii < queue_count; ++ii) {
+		const int left = _queues[ii].back - _queues[ii].front;
+
+		if (left > most) {
+			most = left;
+			victim = ii;
+		}
+	}
+
+	if (victim < 0) {
+		return false;
+	}
+
+	// Steal its last job, which is the smallest when ordered by size
+	job_index = victim + --_queues[victim].back * queue_count;
+	return true;
+}
+
+void ThreadPool::work(int thread_index) {
+	lock();
+
+	int job_index;
+
+	// While jobs remain to be started,
+	while (nextJob(thread_index, job_index)) {
+		JobFunction job = _job;
+		void *data = _data;
+
+		unlock();
+
+		job(data, job_index, thread_index);
+
+		lock();
+
+		// If that was the last one to finish,
+		if (--_remaining <= 0) {
+#if defined(CAT_OS_WINDOWS)
+			SetEvent(_done);
+#else
+			pthread_cond_signal(&_done);
+#endif
+		}
+	}
+
+	unlock();
+}
+
+void ThreadPool::workerLoop(int thread_index) {
+#if defined(CAT_OS_WINDOWS)
+
+	for (;;) {
+		WaitForSingleObject(_wake, INFINITE);
+
+		if (_quit) {
+			break;
+		}
+
+		work(thread_index);
+	}
+
+#else
+
+	u32 seen = 0;
+
+	lock();
+
+	for (;;) {
+		// Wait for a new batch
+		while (!_quit && seen == _batch) {
+			pthread_cond_wait(&_wake, &_lock);
+		}
+
+		if (_quit) {
+			break;
+		}
+
+		seen = _batch;
+
+		unlock();
+
+		work(thread_index);
+
+		lock();
+	}
+
+	unlock();
+
+#endif
+}
+
+void ThreadPool::run(int job_count, JobFunction job, void *data) {
+	if (job_count <= 0) {
+		return;
+	}
+
+	lock();
+
+	// If there is nobody to share the work with, or this was called from a
+	// job in the running batch so every thread is already taken,
+	if (_worker_count <= 0 || job_count == 1 || _busy) {
+		unlock();
+
+		// Run it here
+		const int thread_index = callerIndex();
+		for (int ii = 0; ii < job_count; ++ii) {
+			job(data, ii, thread_index);
+		}
+		return;
+	}
+
+	// Post the batch
+	_busy = true;
+	_job = job;
+	_data = data;
+	_remaining = job_count;
+
+	// Deal the jobs out round-robin
+	const int queue_count = _worker_count + 1;
+	_queue_count = queue_count;
+	for (int ii = 0; ii < queue_count; ++ii) {
+		_queues[ii].front = 0;
+		_queues[ii].back = (job_count - ii + queue_count - 1) / queue_count;
+	}
+	++_batch;
+#if defined(CAT_OS_WINDOWS)
+	ReleaseSemaphore(_wake, _worker_count, 0);
+#else
+	pthread_cond_broadcast(&_wake);
+#endif
+	unlock();
+
+	// Pitch in
+	work(0);
+
+	// Wait for the stragglers
+	lock();
+	while (_remaining > 0) {
+#if defined(CAT_OS_WINDOWS)
+		unlock();
+		WaitForSingleObject(_done, INFINITE);
+		lock();
+#else
+		pthread_cond_wait(&_done, &_lock);
+#endif
+	}
+	_busy = false;
+	unlock();
+}
+
+#endif // CAT_COMPILE_THREADS
@@ -0,0 +1,179 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_THREAD_POOL_HPP
+#define CAT_THREAD_POOL_HPP
+
+#include "Platform.hpp"
+
+#ifdef CAT_COMPILE_THREADS
+
+#if defined(CAT_OS_WINDOWS)
+# include "WindowsInclude.hpp"
+#else
+# include <pthread.h>
+#endif
+
+/*
+ * Minimal fork-join thread pool for the decoder
+ *
+ * The encoder has a full threading library, but the decoder is meant to be
+ * dropped into other projects by itself, so this is all it gets.
+ *
+ * Worker threads are started once and then sleep until run() hands them a
+ * batch of jobs.  The calling thread works on the batch too, and run() does
+ * not return until every job in the batch has completed.
+ *
+ * Jobs are dealt out to the threads round-robin, so with jobs ordered from
+ * largest to smallest each thread starts on one of the largest.  A thread
+ * that runs out of jobs steals the last job of the thread with the most left.
+ *
+ * Each job is told which thread is running it: 0 for the calling thread and
+ * 1..getThreadCount()-1 for the workers.  This lets jobs keep per-thread
+ * scratch state without any locking.
+ *
+ * A job may call run() itself.  Since every thread is already busy with the
+ * outer batch, the nested batch is run by the thread that posted it, and its
+ * jobs are told the index of that thread.
+ */
+
+namespace cat {
+
+
+//// ThreadPool
+
+class ThreadPool {
+public:
+	static const int MAX_THREADS = 64;
+
+	typedef void (*JobFunction)(void *data, int job_index, int thread_index);
+
+protected:
+	struct Worker {
+		ThreadPool *pool;
+		int index;
+#if defined(CAT_OS_WINDOWS)
+		HANDLE thread;
+		u32 id;
+#else
+		pthread_t thread;
+#endif
+	} _workers[MAX_THREADS];
+
+	int _worker_count;
+
+#if defined(CAT_OS_WINDOWS)
+	CRITICAL_SECTION _lock;
+	HANDLE _wake, _done;
+#else
+	pthread_mutex_t _lock;
+	pthread_cond_t _wake, _done;
+#endif
+
+	volatile bool _quit;
+	volatile u32 _batch;
+	bool _busy;			// A batch is running, so run() calls from jobs stay on their thread
+
+	// Jobs left for one thread: job q + k * _queue_count for k in [front, back)
+	struct Queue {
+		int front, back;
+	} _queues[MAX_THREADS];
+
+	int _queue_count;
+
+	// Current batch
+	JobFunction _job;
+	void *_data;
+	int _remaining;
+
+	CAT_INLINE void lock() {
+#if defined(CAT_OS_WINDOWS)
+		EnterCriticalSection(&_lock);
+#else
+		pthread_mutex_lock(&_lock);
+#endif
+	}
+
+	CAT_INLINE void unlock() {
+#if defined(CAT_OS_WINDOWS)
+		LeaveCriticalSection(&_lock);
+#else
+		pthread_mutex_unlock(&_lock);
+#endif
+	}
+
+	// Pick the next job for a thread while locked, or return false if none
+	bool nextJob(int thread_index, int &job_index);
+
+	// Run jobs from the current batch until there are none left to start
+	void work(int thread_index);
+
+	void workerLoop(int thread_index);
+
+	// Index of the thread calling this: a worker, or else 0
+	int callerIndex();
+
+#if defined(CAT_OS_WINDOWS)
+	static unsigned int __stdcall WorkerWrapper(void *param);
+#else
+	static void *WorkerWrapper(void *param);
+#endif
+
+	void cleanup();
+
+public:
+	ThreadPool();
+	virtual ~ThreadPool();
+
+	// Start thread_count - 1 workers, since the caller is the other thread
+	bool init(int thread_count);
+
+	// Number of threads that run jobs, including the calling thread
+	CAT_INLINE int getThreadCount() {
+		return _worker_count + 1;
+	}
+
+	// Run job(data, ii, thread) for ii in [0, job_count) and wait for them all
+	void run(int job_count, JobFunction job, void *data);
+};
+
+
+} // namespace cat
+
+#else // CAT_COMPILE_THREADS
+
+namespace cat {
+
+// Declared so that a null pool can still be passed around
+class ThreadPool;
+
+} // namespace cat
+
+#endif // CAT_COMPILE_THREADS
+
+#endif // CAT_THREAD_POOL_HPP
@@ -0,0 +1,177 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ChaosSearch.hpp"
+#include "../decoder/Enforcer.hpp"
+using namespace cat;
+
+
+//// ChaosSearch
+
+void ChaosSearch::init(int num_syms, int zrle_syms, int max_levels) {
+	_num_syms = num_syms;
+	_zrle_syms = zrle_syms;
+	_max_levels = max_levels;
+
+	_bins.clear();
+	_symbols.clear();
+	_top_bin = 0;
+}
+
+void ChaosSearch::evaluate(int job_index) {
+	// Jobs alternate between a tail and a single bin, so every thread gets some tails
+	const int bin = job_index >> 1;
+	const bool tail = (job_index & 1) == 0;
+
+	u32 &cost = tail ? _tail_costs[bin] : _bin_costs[bin];
+
+	// If nothing was recorded at or above this bin,
+	if (bin > _top_bin) {
+		// Empty encoders cost nothing
+		cost = 0;
+		return;
+	}
+
+	CAT_DEBUG_ENFORCE(bin < _max_levels - 1);
+
+	EntropyEncoder encoder;
+	encoder.init(_num_syms, _zrle_syms);
+
+	const u8 *bins = &_bins[0];
+	const u16 *symbols = &_symbols[0];
+	const int count = (int)_bins.size();
+
+	if (tail) {
+		for (int ii = 0; ii < count; ++ii) {
+			if (bins[ii] >= bin) {
+				encoder.add(symbols[ii]);
+			}
+		}
+	} else {
+		for (int ii = 0; ii < count; ++ii) {
+			if (bins[ii] == bin) {
+				encoder.add(symbols[ii]);
+			}
+		}
+	}
+
+	cost = encoder.finalize();
+}
+
+void ChaosSearch::EvaluateJob(void *data, int job_index, int thread_index) {
+	ChaosSearch *searches = reinterpret_cast<ChaosSearch *>( data );
+	const int jobs_per_search = (searches[0]._max_levels - 1) * 2;
+
+	searches[job_index / jobs_per_search].evaluate(job_index % jobs_per_search);
+}
+
+u32 ChaosSearch::cost(int chaos_levels) {
+	CAT_DEBUG_ENFORCE(chaos_levels >= 1 && chaos_levels < _max_levels);
+
+	const int tail = chaos_levels - 1;
+
+	u32 bits = _tail_costs[tail];
+	for (int ii = 0; ii < tail; ++ii) {
+		bits += _bin_costs[ii];
+	}
+
+	return bits;
+}
+
+void ChaosSearch::train(int chaos_levels, EntropyEncoder encoders[]) {
+	const int tail = chaos_levels - 1;
+
+	for (int ii = 0; ii < chaos_levels; ++ii) {
+		encoders[ii].init(_num_syms, _zrle_syms);
+	}
+
+	for (int ii = 0, iiend = (int)_bins.size(); ii < iiend; ++ii) {
+		int bin = _bins[ii];
+		if (bin > tail) {
+			bin = tail;
+		}
+
+		encoders[bin].add(_symbols[ii]);
+	}
+
+	for (int ii = 0; ii < chaos_levels; ++ii) {
+		encoders[ii].finalize();
+	}
+}
+
+int ChaosSearch::Search(ChaosSearch searches[], int count, ThreadPool *pool, u32 &entropy) {
+	const int max_levels = searches[0]._max_levels;
+	const int jobs_per_search = (max_levels - 1) * 2;
+
+	for (int ii = 0; ii < count; ++ii) {
+		CAT_DEBUG_ENFORCE(searches[ii]._max_levels == max_levels);
+
+		searches[ii]._bin_costs.resize(max_levels - 1);
+		searches[ii]._tail_costs.resize(max_levels - 1);
+	}
+
+	const int job_count = jobs_per_search * count;
+
+#ifdef CAT_COMPILE_THREADS
+	// If there is a thread pool to share the work,
+	if (pool) {
+		pool->run(job_count, &ChaosSearch::EvaluateJob, searches);
+	} else
+#endif
+	{
+		for (int ii = 0; ii < job_count; ++ii) {
+			EvaluateJob(searches, ii, 0);
+		}
+	}
+
+	u32 best_entropy = 0x7fffffff;
+	int best_levels = 0;
+
+	// For each chaos level,
+	for (int chaos_levels = 1; chaos_levels < max_levels; ++chaos_levels) {
+		u32 bits = 0;
+		for (int ii = 0; ii < count; ++ii) {
+			bits += searches[ii].cost(chaos_levels);
+		}
+
+		// If this is the best chaos levels so far,
+		if (best_entropy > bits + 128) {
+			best_entropy = bits;
+			best_levels = chaos_levels;
+		}
+
+		// If we have not found a better one in 2 moves,
+		if (chaos_levels - best_levels >= 2) {
+			// Stop where the full replay would have stopped
+			break;
+		}
+	}
+
+	entropy = best_entropy;
+	return best_levels;
+}
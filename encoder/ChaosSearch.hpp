@@ -0,0 +1,101 @@
+/*
+	Copyright (c) 2013 Game Closure.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of GCIF nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CHAOS_SEARCH_HPP
+#define CHAOS_SEARCH_HPP
+
+#include "../decoder/Platform.hpp"
+#include "../decoder/ThreadPool.hpp"
+#include "EntropyEncoder.hpp"
+#include <vector>
+
+namespace cat {
+
+
+/*
+ * Chaos Search
+ *
+ * The chaos tables for different numbers of chaos levels only differ in
+ * where they stop ramping up.  With L levels, a neighbor residual sum that
+ * the table for the most levels puts in bin b will land in bin min(b, L-1).
+ *
+ * So instead of replaying the image once for each number of chaos levels,
+ * the writer replays it once with the largest table and records the bin and
+ * symbol of everything it would have added to an entropy encoder.  Then for
+ * L levels the first L-1 bins are the same as recorded, and the last bin is
+ * all of the recorded bins from L-1 up merged together in order.
+ *
+ * Zero runs depend on the order of symbols within a bin, so each bin and
+ * each merged tail is costed by feeding its symbols through an entropy
+ * encoder rather than by adding up plain histograms.  This costs exactly the
+ * same as the full replay, and all of the bins and tails can be costed in
+ * parallel.
+ */
+
+class ChaosSearch {
+	int _num_syms, _zrle_syms;
+	int _max_levels;
+
+	// Recorded symbols and the bin each was added to
+	std::vector<u8> _bins;
+	std::vector<u16> _symbols;
+	int _top_bin;
+
+	std::vector<u32> _bin_costs;	// Cost of each bin alone
+	std::vector<u32> _tail_costs;	// Cost of each bin merged with all higher bins
+
+	void evaluate(int job_index);
+
+	static void EvaluateJob(void *data, int job_index, int thread_index);
+
+public:
+	void init(int num_syms, int zrle_syms, int max_levels);
+
+	CAT_INLINE void add(u8 bin, u16 symbol) {
+		_bins.push_back(bin);
+		_symbols.push_back(symbol);
+
+		if (_top_bin < bin) {
+			_top_bin = bin;
+		}
+	}
+
+	// Cost in bits of the recorded symbols with the given number of levels
+	u32 cost(int chaos_levels);
+
+	// Initialize and finalize encoders with the recorded symbols
+	void train(int chaos_levels, EntropyEncoder encoders[]);
+
+	// Cost the searches and return the best number of chaos levels for all of them together
+	static int Search(ChaosSearch searches[], int count, ThreadPool *pool, u32 &entropy);
+};
+
+
+} // namespace cat
+
+#endif // CHAOS_SEARCH_HPP
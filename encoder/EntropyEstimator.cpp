@@ -99,6 +99,22 @@ void EntropyEstimator::subtract(const u8 * CAT_RESTRICT symbols, int count) {
 	}
 }
 
+void EntropyEstimator::add(const EntropyEstimator &other) {
+	_hist_total += other._hist_total;
+
+	for (int ii = 0; ii < NUM_SYMS; ++ii) {
+		_hist[ii] += other._hist[ii];
+	}
+}
+
+void EntropyEstimator::subtract(const EntropyEstimator &other) {
+	_hist_total -= other._hist_total;
+
+	for (int ii = 0; ii < NUM_SYMS; ++ii) {
+		_hist[ii] -= other._hist[ii];
+	}
+}
+
 u32 EntropyEstimator::entropy(const u8 * CAT_RESTRICT symbols, int count) {
 	if (count == 0) {
 		return 0;
@@ -69,6 +69,10 @@ public:
 	// Subtract symbols from running histogram
 	void subtract(const u8 *symbols, int count);
 
+	// Add or subtract another running histogram
+	void add(const EntropyEstimator &other);
+	void subtract(const EntropyEstimator &other);
+
 	// Calculate entropy of given symbols, counting zeroes as free
 	u32 entropy(const u8 *symbols, int count);
 };
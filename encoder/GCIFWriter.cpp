@@ -32,6 +32,9 @@
 #include "ImagePaletteWriter.hpp"
 #include "ImageRGBAWriter.hpp"
 #include "SmallPaletteWriter.hpp"
+#include "SystemInfo.hpp"
+#include "../decoder/MappedFile.hpp"
+#include "../decoder/ThreadPool.hpp"
 using namespace cat;
 
 
@@ -106,6 +109,10 @@ static const GCIFKnobs DEFAULT_KNOBS[COMPRESS_LEVELS] = {
 		0,			// mono_revisitCount
 		2070,		// mono_lzPrematchLimit
 		512,		// mono_lzInmatchLimit
+
+		0,			// stripe_rows
+
+		1,			// threads
 	},
 	{	// L1 Better
 		0,			// Bump
@@ -156,6 +163,10 @@ static const GCIFKnobs DEFAULT_KNOBS[COMPRESS_LEVELS] = {
 		0,			// mono_revisitCount
 		2070,		// mono_lzPrematchLimit
 		512,		// mono_lzInmatchLimit
+
+		0,			// stripe_rows
+
+		1,			// threads
 	},
 	{	// L2 Harder
 		0,			// Bump
@@ -206,6 +217,10 @@ static const GCIFKnobs DEFAULT_KNOBS[COMPRESS_LEVELS] = {
 		0,			// mono_revisitCount
 		2070,		// mono_lzPrematchLimit
 		512,		// mono_lzInmatchLimit
+
+		0,			// stripe_rows
+
+		1,			// threads
 	},
 	{	// L3 Stronger
 		0,			// Bump
@@ -256,6 +271,10 @@ static const GCIFKnobs DEFAULT_KNOBS[COMPRESS_LEVELS] = {
 		4096,		// mono_revisitCount
 		2070,		// mono_lzPrematchLimit
 		512,		// mono_lzInmatchLimit
+
+		0,			// stripe_rows
+
+		1,			// threads
 	}
 };
 
@@ -278,34 +297,18 @@ void stripTransparentRGB(const u8 *rgba, int xsize, int ysize, SmartArray<u8> &i
 }
 
 
-extern "C" int gcif_write_ex(const void *pixels, int xsize, int ysize, const char *output_file_path, const GCIFKnobs *knobs, int strip_transparent_color) {
-	// Validate input
-	if (!pixels || xsize < 0 || ysize < 0 || !output_file_path || !*output_file_path) {
-		return GCIF_WE_BAD_PARAMS;
-	}
-
+// Compress one image into the given writer and finalize it
+static int gcif_write_image(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ThreadPool *pool, ImageWriter &writer) {
 	int err;
 
-	// Select RGBA data from input pixels
-	SmartArray<u8> image;
-	const u8 *rgba = reinterpret_cast<const u8*>( pixels );
-
-	// If stripping RGB color data from fully-transparent pixels,
-	if (strip_transparent_color) {
-		// Make a copy of the image and strip out the RGB information from fully-transparent pixels
-		stripTransparentRGB(rgba, xsize, ysize, image);
-		rgba = image.get();
-	}
-
 	// Initialize image writer
-	ImageWriter writer;
 	if ((err = writer.init(xsize, ysize))) {
 		return err;
 	}
 
 	// Small Palette
 	SmallPaletteWriter smallPaletteWriter;
-	if ((err = smallPaletteWriter.init(rgba, xsize, ysize, knobs))) {
+	if ((err = smallPaletteWriter.init(rgba, xsize, ysize, knobs, pool))) {
 		return err;
 	}
 
@@ -349,7 +352,7 @@ extern "C" int gcif_write_ex(const void *pixels, int xsize, int ysize, const cha
 
 		// Global Palette
 		ImagePaletteWriter imagePaletteWriter;
-		if ((err = imagePaletteWriter.init(rgba, xsize, ysize, knobs, imageMaskWriter))) {
+		if ((err = imagePaletteWriter.init(rgba, xsize, ysize, knobs, imageMaskWriter, pool))) {
 			return err;
 		}
 
@@ -359,7 +362,7 @@ extern "C" int gcif_write_ex(const void *pixels, int xsize, int ysize, const cha
 		if (!imagePaletteWriter.enabled()) {
 			// Context Modeling Decompression
 			ImageRGBAWriter imageRGBAWriter;
-			if ((err = imageRGBAWriter.init(rgba, xsize, ysize, imageMaskWriter, knobs))) {
+			if ((err = imageRGBAWriter.init(rgba, xsize, ysize, imageMaskWriter, knobs, pool))) {
 				return err;
 			}
 
@@ -371,6 +374,121 @@ extern "C" int gcif_write_ex(const void *pixels, int xsize, int ysize, const cha
 	// Finalize file
 	writer.finalize();
 
+	return GCIF_WE_OK;
+}
+
+/*
+ * Compress each stripe of rows as a separate image and wrap them in the
+ * stripe container described in ImageReader.hpp
+ */
+static int gcif_write_stripes(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ThreadPool *pool, const char *output_file_path) {
+	int err;
+
+	const int stripe_rows = knobs->stripe_rows;
+	const int stripe_count = (ysize + stripe_rows - 1) / stripe_rows;
+
+	if (stripe_count > ImageReader::MAX_STRIPES ||
+		xsize > (int)ImageWriter::MAX_X || ysize > (int)ImageWriter::MAX_Y) {
+		return GCIF_WE_BAD_DIMS;
+	}
+
+	ImageWriter *stripes = new ImageWriter[stripe_count];
+
+	// Compress each stripe
+	int word_count = ImageReader::STRIPE_HEAD_WORDS + stripe_count;
+	for (int ii = 0; ii < stripe_count; ++ii) {
+		const int y = ii * stripe_rows;
+		const int rows = ysize - y < stripe_rows ? ysize - y : stripe_rows;
+
+		if ((err = gcif_write_image(rgba + y * xsize * 4, xsize, rows, knobs, pool, stripes[ii]))) {
+			delete []stripes;
+			return err;
+		}
+
+		word_count += stripes[ii].getWordCount();
+	}
+
+	// Map the file
+	MappedFile file;
+	MappedView fileView;
+	u8 *fileData;
+
+	if (!file.OpenWrite(output_file_path, word_count * sizeof(u32)) ||
+		!fileView.Open(&file) ||
+		!(fileData = fileView.MapView())) {
+		delete []stripes;
+		return GCIF_WE_FILE;
+	}
+
+	u32 *words = reinterpret_cast<u32 *>( fileData );
+
+	// Write header
+	words[0] = getLE(ImageReader::STRIPE_MAGIC);
+	words[1] = getLE(((u32)xsize << (32 - ImageReader::MAX_X_BITS)) | ((u32)ysize << (32 - ImageReader::MAX_X_BITS - ImageReader::MAX_Y_BITS)));
+	words[2] = getLE(stripe_rows);
+
+	// Write offset table and stripe data
+	int offset = ImageReader::STRIPE_HEAD_WORDS + stripe_count;
+	for (int ii = 0; ii < stripe_count; ++ii) {
+		words[ImageReader::STRIPE_HEAD_WORDS + ii] = getLE(offset);
+
+		stripes[ii].write(words + offset);
+		offset += stripes[ii].getWordCount();
+	}
+
+	delete []stripes;
+
+	return GCIF_WE_OK;
+}
+
+extern "C" int gcif_write_ex(const void *pixels, int xsize, int ysize, const char *output_file_path, const GCIFKnobs *knobs, int strip_transparent_color) {
+	// Validate input
+	if (!pixels || xsize < 0 || ysize < 0 || !output_file_path || !*output_file_path) {
+		return GCIF_WE_BAD_PARAMS;
+	}
+
+	int err;
+
+	// Select RGBA data from input pixels
+	SmartArray<u8> image;
+	const u8 *rgba = reinterpret_cast<const u8*>( pixels );
+
+	// If stripping RGB color data from fully-transparent pixels,
+	if (strip_transparent_color) {
+		// Make a copy of the image and strip out the RGB information from fully-transparent pixels
+		stripTransparentRGB(rgba, xsize, ysize, image);
+		rgba = image.get();
+	}
+
+	ThreadPool *pool = 0;
+
+#ifdef CAT_COMPILE_THREADS
+	// 0 is left from knobs that were cleared, so only -1 asks for every processor
+	int threads = knobs->threads;
+	if (threads < 0) {
+		threads = SystemInfo::ref()->GetProcessorCount();
+	}
+
+	// Workers for splitting up image analysis
+	ThreadPool thread_pool;
+	if (threads > 1) {
+		// If the threads cannot all be started, stay on this thread so the output does not change
+		if (thread_pool.init(threads)) {
+			pool = &thread_pool;
+		}
+	}
+#endif
+
+	// If splitting the image into stripes,
+	if (knobs->stripe_rows > 0 && knobs->stripe_rows < ysize) {
+		return gcif_write_stripes(rgba, xsize, ysize, knobs, pool, output_file_path);
+	}
+
+	ImageWriter writer;
+	if ((err = gcif_write_image(rgba, xsize, ysize, knobs, pool, writer))) {
+		return err;
+	}
+
 	// Write it out
 	if ((err = writer.write(output_file_path))) {
 		return err;
@@ -379,6 +497,16 @@ extern "C" int gcif_write_ex(const void *pixels, int xsize, int ysize, const cha
 	return GCIF_WE_OK;
 }
 
+extern "C" void gcif_get_knobs(int compression_level, GCIFKnobs *knobs) {
+	if (compression_level < 0) {
+		compression_level = 0;
+	} else if (compression_level >= COMPRESS_LEVELS) {
+		compression_level = COMPRESS_LEVELS - 1;
+	}
+
+	*knobs = DEFAULT_KNOBS[compression_level];
+}
+
 extern "C" int gcif_write(const void *rgba, int xsize, int ysize, const char *output_file_path, int compression_level, int strip_transparent_color) {
 	// Error on invalid input
 	if (compression_level < 0) {
@@ -125,6 +125,12 @@ struct GCIFKnobs {
 	int mono_revisitCount;			// 4096: Number of pixels to revisit
 	int mono_lzPrematchLimit;		// 2070: How far to walk the hash chain during LZ match finding on first pixel of a match
 	int mono_lzInmatchLimit;		// 512: How far to walk the hash chain during LZ match finding inside a match (for optimal matching)
+
+	//// Stripes
+	int stripe_rows;				// 0: Rows per independently decodable stripe for multi-threaded decoding, or 0 to write one stripe
+
+	//// Threads
+	int threads;					// 1: Threads to use for image analysis, where 0 also means 1 and -1 means one per processor.  Output only depends on the thread count
 };
 
 /*
@@ -134,6 +140,12 @@ struct GCIFKnobs {
  */
 int gcif_write_ex(const void *rgba, int xsize, int ysize, const char *output_file_path, const GCIFKnobs *knobs, int strip_transparent_color);
 
+/*
+ * Fills in knobs with the ones gcif_write() uses for a compression level,
+ * as a starting point for changing just a few of them.
+ */
+void gcif_get_knobs(int compression_level, GCIFKnobs *knobs);
+
 
 #ifdef __cplusplus
 };
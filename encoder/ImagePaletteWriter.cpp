@@ -195,12 +195,14 @@ void ImagePaletteWriter::generateMonoWriter() {
 	params.award_count = 4;
 	params.write_order = 0;
 	params.lz_enable = _knobs->pal_enableLZ;
+	params.pool = _pool;
 
 	_mono_writer.init(params);
 }
 
-int ImagePaletteWriter::init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ImageMaskWriter &mask) {
+int ImagePaletteWriter::init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ImageMaskWriter &mask, ThreadPool *pool) {
 	_knobs = knobs;
+	_pool = pool;
 	_rgba = rgba;
 	_xsize = xsize;
 	_ysize = ysize;
@@ -64,6 +64,9 @@ class ImagePaletteWriter {
 
 	const GCIFKnobs *_knobs;
 
+	// Worker threads for analysis, or 0 to stay on the calling thread
+	ThreadPool *_pool;
+
 	const u8 *_rgba;		// Original image
 	SmartArray<u8> _image;	// Palette-encoded image
 	int _xsize, _ysize;	// In pixels
@@ -104,7 +107,7 @@ public:
 #endif
 
 public:
-	int init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ImageMaskWriter &mask);
+	int init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ImageMaskWriter &mask, ThreadPool *pool);
 
 	CAT_INLINE bool enabled() {
 		return _palette_size > 0;
@@ -27,6 +27,7 @@
 */
 
 #include "ImageRGBAWriter.hpp"
+#include "ChaosSearch.hpp"
 #include "../decoder/BitMath.hpp"
 #include "../decoder/Filters.hpp"
 #include "EntropyEstimator.hpp"
@@ -337,194 +338,310 @@ void ImageRGBAWriter::designTilesFast() {
 	}
 }
 
-void ImageRGBAWriter::designTiles() {
-	CAT_INANE("RGBA") << "Designing SF/CF tiles for " << _tiles_x << "x" << _tiles_y << "...";
-
+void ImageRGBAWriter::designTile(int tx, int ty, bool revisit, EntropyEstimator ee[3], u8 *codes[3]) {
 	const u16 tile_xsize = _tile_xsize, tile_ysize = _tile_ysize;
 	const u16 xsize = _xsize, ysize = _ysize;
+	const u16 x = tx << _tile_bits_x, y = ty << _tile_bits_y;
+	const u8 *topleft = _rgba + (x + y * xsize) * 4;
+	const u32 code_stride = tile_xsize * tile_ysize;
+	u8 *sf = _sf_tiles.get() + tx + ty * _tiles_x;
+	u8 *cf = _cf_tiles.get() + tx + ty * _tiles_x;
 	u8 FPT[3];
 
-	EntropyEstimator ee[3];
-	ee[0].init();
-	ee[1].init();
-	ee[2].init();
+	// If revisiting an old choice,
+	if (revisit) {
+		const u8 osf = *sf, ocf = *cf;
+		int code_count = 0;
+
+		// For each element in the tile,
+		const u8 *row = topleft;
+		u16 py = y, cy = tile_ysize;
+		while (cy-- > 0 && py < ysize) {
+			const u8 *data = row;
+			u16 px = x, cx = tile_xsize;
+			while (cx-- > 0 && px < xsize) {
+				// If element is not masked,
+				if (!IsMasked(px, py)) {
+					const u8 *pred = _sf[osf].safe(data, FPT, px, py, xsize);
+					u8 residual_rgb[3] = {
+						data[0] - pred[0],
+						data[1] - pred[1],
+						data[2] - pred[2]
+					};
+
+					u8 yuv[3];
+					RGB2YUV_FILTERS[ocf](residual_rgb, yuv);
+
+					codes[0][code_count] = yuv[0];
+					codes[1][code_count] = yuv[1];
+					codes[2][code_count] = yuv[2];
+					++code_count;
+				}
+				++px;
+				data += 4;
+			}
+			++py;
+			row += xsize * 4;
+		}
 
-	// Allocate temporary space for entropy analysis
-	const u32 code_stride = _tile_xsize * _tile_ysize;
-	const u32 codes_size = code_stride * _sf_count * CF_COUNT;
-	_ecodes[0].resize(codes_size);
-	_ecodes[1].resize(codes_size);
-	_ecodes[2].resize(codes_size);
-	u8 *codes[3] = {
-		_ecodes[0].get(),
-		_ecodes[1].get(),
-		_ecodes[2].get()
-	};
+		ee[0].subtract(codes[0], code_count);
+		ee[1].subtract(codes[1], code_count);
+		ee[2].subtract(codes[2], code_count);
+	}
 
-	// Until revisits are done,
-	int passes = 0;
+	int code_count = 0;
+
+	// For each element in the tile,
+	const u8 *row = topleft;
+	u16 py = y, cy = tile_ysize;
+	while (cy-- > 0 && py < ysize) {
+		const u8 *data = row;
+		u16 px = x, cx = tile_xsize;
+		while (cx-- > 0 && px < xsize) {
+			// If element is not masked,
+			if (!IsMasked(px, py)) {
+				u8 *dest_y = codes[0] + code_count;
+				u8 *dest_u = codes[1] + code_count;
+				u8 *dest_v = codes[2] + code_count;
+
+				// For each spatial filter,
+				for (int sfi = 0, sfi_end = _sf_count; sfi < sfi_end; ++sfi) {
+					const u8 *pred = _sf[sfi].safe(data, FPT, px, py, xsize);
+					u8 residual_rgb[3] = {
+						data[0] - pred[0],
+						data[1] - pred[1],
+						data[2] - pred[2]
+					};
+
+					// For each color filter,
+					for (int cfi = 0; cfi < CF_COUNT; ++cfi) {
+						u8 yuv[3];
+						RGB2YUV_FILTERS[cfi](residual_rgb, yuv);
+
+						*dest_y = yuv[0];
+						*dest_u = yuv[1];
+						*dest_v = yuv[2];
+						dest_y += code_stride;
+						dest_u += code_stride;
+						dest_v += code_stride;
+					}
+				}
+
+				++code_count;
+			}
+			++px;
+			data += 4;
+		}
+		++py;
+		row += xsize * 4;
+	}
+
+	// Evaluate entropy of codes
+	u8 *src_y = codes[0];
+	u8 *src_u = codes[1];
+	u8 *src_v = codes[2];
+	int lowest_entropy = 0x7fffffff;
+	int best_sf = 0, best_cf = 0;
+	u8 *src_best_y = src_y;
+	u8 *src_best_u = src_u;
+	u8 *src_best_v = src_v;
+
+	for (int sfi = 0, sfi_end = _sf_count; sfi < sfi_end; ++sfi) {
+		for (int cfi = 0; cfi < CF_COUNT; ++cfi) {
+			int entropy = ee[0].entropy(src_y, code_count);
+			entropy += ee[1].entropy(src_u, code_count);
+			entropy += ee[2].entropy(src_v, code_count);
+
+			if (lowest_entropy > entropy) {
+				lowest_entropy = entropy;
+				best_sf = sfi;
+				best_cf = cfi;
+				src_best_y = src_y;
+				src_best_u = src_u;
+				src_best_v = src_v;
+			}
+
+			src_y += code_stride;
+			src_u += code_stride;
+			src_v += code_stride;
+		}
+	}
+
+	// Update entropy histogram
+	ee[0].add(src_best_y, code_count);
+	ee[1].add(src_best_u, code_count);
+	ee[2].add(src_best_v, code_count);
+
+	*sf = best_sf;
+	*cf = best_cf;
+}
+
+void ImageRGBAWriter::designTileRow(int ty, EntropyEstimator ee[3], u8 *codes[3]) {
+	const u8 *cf = _cf_tiles.get() + ty * _tiles_x;
+
+	// For each tile in the row,
+	for (int tx = 0, txend = _tiles_x; tx < txend; ++tx) {
+		// If tile is not masked,
+		if (cf[tx] != MASK_TILE) {
+			designTile(tx, ty, false, ee, codes);
+		}
+	}
+}
+
+void ImageRGBAWriter::revisitTiles(EntropyEstimator ee[3], u8 *codes[3]) {
 	int revisitCount = _knobs->rgba_revisitCount;
-	while (passes < MAX_PASSES) {
-		const u8 *topleft_row = _rgba;
-		int ty = 0;
-		u8 *sf = _sf_tiles.get();
-		u8 *cf = _cf_tiles.get();
 
-		// For each tile,
-		for (u16 y = 0; y < ysize; y += tile_ysize, ++ty) {
-			const u8 *topleft = topleft_row;
-			int tx = 0;
+	// Until revisits are done,
+	for (int passes = 1; passes < MAX_PASSES; ++passes) {
+		CAT_INANE("RGBA") << "Revisiting filter selections from the top... " << revisitCount << " left";
 
-			for (u16 x = 0; x < xsize; x += tile_xsize, ++sf, ++cf, topleft += tile_xsize * 4, ++tx) {
-				u8 ocf = *cf;
+		const u8 *cf = _cf_tiles.get();
 
+		// For each tile,
+		for (int ty = 0, tyend = _tiles_y; ty < tyend; ++ty) {
+			for (int tx = 0, txend = _tiles_x; tx < txend; ++tx, ++cf) {
 				// If tile is masked,
-				if (ocf == MASK_TILE) {
+				if (*cf == MASK_TILE) {
 					continue;
 				}
 
-				u8 osf = *sf;
+				// If just finished revisiting old zones,
+				if (--revisitCount < 0) {
+					// Done!
+					return;
+				}
 
-				// If we are on the second or later pass,
-				if (passes > 0) {
-					// If just finished revisiting old zones,
-					if (--revisitCount < 0) {
-						// Done!
-						return;
-					}
+				designTile(tx, ty, true, ee, codes);
+			}
+		}
+	}
+}
 
-					int code_count = 0;
-
-					// For each element in the tile,
-					const u8 *row = topleft;
-					u16 py = y, cy = tile_ysize;
-					while (cy-- > 0 && py < ysize) {
-						const u8 *data = row;
-						u16 px = x, cx = tile_xsize;
-						while (cx-- > 0 && px < xsize) {
-							// If element is not masked,
-							if (!IsMasked(px, py)) {
-								const u8 *pred = _sf[osf].safe(data, FPT, px, py, xsize);
-								u8 residual_rgb[3] = {
-									data[0] - pred[0],
-									data[1] - pred[1],
-									data[2] - pred[2]
-								};
+#ifdef CAT_COMPILE_THREADS
 
-								u8 yuv[3];
-								RGB2YUV_FILTERS[ocf](residual_rgb, yuv);
+void ImageRGBAWriter::DesignBandJob(void *data, int job_index, int thread_index) {
+	ImageRGBAWriter *writer = reinterpret_cast<ImageRGBAWriter *>( data );
+	TileBand *band = &writer->_bands[job_index];
 
-								codes[0][code_count] = yuv[0];
-								codes[1][code_count] = yuv[1];
-								codes[2][code_count] = yuv[2];
-								++code_count;
-							}
-							++px;
-							data += 4;
-						}
-						++py;
-						row += xsize * 4;
-					}
+	int ty = band->ty, tyend = ty + BAND_SYNC_ROWS;
+	if (tyend > band->ty_end) {
+		tyend = band->ty_end;
+	}
 
-					ee[0].subtract(codes[0], code_count);
-					ee[1].subtract(codes[1], code_count);
-					ee[2].subtract(codes[2], code_count);
-				}
+	// For each tile row in this round,
+	for (; ty < tyend; ++ty) {
+		writer->designTileRow(ty, band->ee, band->codes);
+	}
 
-				int code_count = 0;
-
-				// For each element in the tile,
-				const u8 *row = topleft;
-				u16 py = y, cy = tile_ysize;
-				while (cy-- > 0 && py < ysize) {
-					const u8 *data = row;
-					u16 px = x, cx = tile_xsize;
-					while (cx-- > 0 && px < xsize) {
-						// If element is not masked,
-						if (!IsMasked(px, py)) {
-							u8 *dest_y = codes[0] + code_count;
-							u8 *dest_u = codes[1] + code_count;
-							u8 *dest_v = codes[2] + code_count;
-
-							// For each spatial filter,
-							for (int sfi = 0, sfi_end = _sf_count; sfi < sfi_end; ++sfi) {
-								const u8 *pred = _sf[sfi].safe(data, FPT, px, py, xsize);
-								u8 residual_rgb[3] = {
-									data[0] - pred[0],
-									data[1] - pred[1],
-									data[2] - pred[2]
-								};
-
-								// For each color filter,
-								for (int cfi = 0; cfi < CF_COUNT; ++cfi) {
-									u8 yuv[3];
-									RGB2YUV_FILTERS[cfi](residual_rgb, yuv);
-
-									*dest_y = yuv[0];
-									*dest_u = yuv[1];
-									*dest_v = yuv[2];
-									dest_y += code_stride;
-									dest_u += code_stride;
-									dest_v += code_stride;
-								}
-							}
+	band->ty = ty;
+}
 
-							++code_count;
-						}
-						++px;
-						data += 4;
-					}
-					++py;
-					row += xsize * 4;
-				}
+void ImageRGBAWriter::designTilesBands(int band_count) {
+	CAT_INANE("RGBA") << "Designing SF/CF tiles for " << _tiles_x << "x" << _tiles_y << " in " << band_count << " bands...";
 
-				// Evaluate entropy of codes
-				u8 *src_y = codes[0];
-				u8 *src_u = codes[1];
-				u8 *src_v = codes[2];
-				int lowest_entropy = 0x7fffffff;
-				int best_sf = 0, best_cf = 0;
-				u8 *src_best_y = src_y;
-				u8 *src_best_u = src_u;
-				u8 *src_best_v = src_v;
+	// Give each band its own slice of the workspace
+	const u32 codes_size = _tile_xsize * _tile_ysize * _sf_count * CF_COUNT;
+	_ecodes[0].resize(codes_size * band_count);
+	_ecodes[1].resize(codes_size * band_count);
+	_ecodes[2].resize(codes_size * band_count);
+	_bands.resize(band_count);
 
-				for (int sfi = 0, sfi_end = _sf_count; sfi < sfi_end; ++sfi) {
-					for (int cfi = 0; cfi < CF_COUNT; ++cfi) {
-						int entropy = ee[0].entropy(src_y, code_count);
-						entropy += ee[1].entropy(src_u, code_count);
-						entropy += ee[2].entropy(src_v, code_count);
-
-						if (lowest_entropy > entropy) {
-							lowest_entropy = entropy;
-							best_sf = sfi;
-							best_cf = cfi;
-							src_best_y = src_y;
-							src_best_u = src_u;
-							src_best_v = src_v;
-						}
+	EntropyEstimator ee[3];
+	ee[0].init();
+	ee[1].init();
+	ee[2].init();
 
-						src_y += code_stride;
-						src_u += code_stride;
-						src_v += code_stride;
-					}
-				}
+	// Split the tile rows evenly between the bands
+	for (int ii = 0; ii < band_count; ++ii) {
+		TileBand *band = &_bands[ii];
+
+		band->ty = ii * _tiles_y / band_count;
+		band->ty_end = (ii + 1) * _tiles_y / band_count;
+
+		for (int jj = 0; jj < 3; ++jj) {
+			band->codes[jj] = _ecodes[jj].get() + ii * codes_size;
+		}
+	}
 
-				// Update entropy histogram
-				ee[0].add(src_best_y, code_count);
-				ee[1].add(src_best_u, code_count);
-				ee[2].add(src_best_v, code_count);
+	// Enough rounds for the widest band
+	const int band_rows = (_tiles_y + band_count - 1) / band_count;
+	const int rounds = (band_rows + BAND_SYNC_ROWS - 1) / BAND_SYNC_ROWS;
 
-				*sf = best_sf;
-				*cf = best_cf;
+	// For each round,
+	for (int round = 0; round < rounds; ++round) {
+		// Start each band from the merged histograms
+		for (int ii = 0; ii < band_count; ++ii) {
+			for (int jj = 0; jj < 3; ++jj) {
+				_bands[ii].ee[jj] = ee[jj];
 			}
+		}
+
+		_pool->run(band_count, &ImageRGBAWriter::DesignBandJob, this);
+
+		// Merge in what each band added this round
+		EntropyEstimator merged[3];
+		for (int jj = 0; jj < 3; ++jj) {
+			merged[jj] = ee[jj];
 
-			topleft_row += _xsize * 4 * _tile_ysize;
+			for (int ii = 0; ii < band_count; ++ii) {
+				merged[jj].add(_bands[ii].ee[jj]);
+				merged[jj].subtract(ee[jj]);
+			}
+
+			ee[jj] = merged[jj];
 		}
+	}
 
-		++passes;
+	// Refine the top of the image against the histograms for the whole image
+	revisitTiles(ee, _bands[0].codes);
+}
 
-		CAT_INANE("RGBA") << "Revisiting filter selections from the top... " << revisitCount << " left";
+#endif // CAT_COMPILE_THREADS
+
+void ImageRGBAWriter::designTiles() {
+#ifdef CAT_COMPILE_THREADS
+	// If there is a thread pool to share the work,
+	if (_pool) {
+		int band_count = _pool->getThreadCount();
+
+		// Do not make bands too thin to be worth it
+		if (band_count > _tiles_y / MIN_BAND_ROWS) {
+			band_count = _tiles_y / MIN_BAND_ROWS;
+		}
+
+		// If there is enough work for more than one band,
+		if (band_count > 1) {
+			designTilesBands(band_count);
+			return;
+		}
 	}
+#endif
+
+	CAT_INANE("RGBA") << "Designing SF/CF tiles for " << _tiles_x << "x" << _tiles_y << "...";
+
+	EntropyEstimator ee[3];
+	ee[0].init();
+	ee[1].init();
+	ee[2].init();
+
+	// Allocate temporary space for entropy analysis
+	const u32 code_stride = _tile_xsize * _tile_ysize;
+	const u32 codes_size = code_stride * _sf_count * CF_COUNT;
+	_ecodes[0].resize(codes_size);
+	_ecodes[1].resize(codes_size);
+	_ecodes[2].resize(codes_size);
+	u8 *codes[3] = {
+		_ecodes[0].get(),
+		_ecodes[1].get(),
+		_ecodes[2].get()
+	};
+
+	// For each tile row,
+	for (int ty = 0, tyend = _tiles_y; ty < tyend; ++ty) {
+		designTileRow(ty, ee, codes);
+	}
+
+	revisitTiles(ee, codes);
 }
 
 void ImageRGBAWriter::sortFilters() {
@@ -586,6 +703,7 @@ bool ImageRGBAWriter::compressAlpha() {
 	params.award_count = 4;
 	params.write_order = 0;
 	params.lz_enable = _knobs->alpha_enableLZ;
+	params.pool = _pool;
 
 	_a_encoder.init(params);
 
@@ -659,96 +777,69 @@ void ImageRGBAWriter::computeResiduals() {
 void ImageRGBAWriter::designChaos() {
 	CAT_INANE("RGBA") << "Designing chaos...";
 
-	u32 best_entropy = 0x7fffffff;
+	ChaosSearch search[3];
+	search[0].init(ImageRGBAReader::NUM_Y_SYMS, ImageRGBAReader::NUM_ZRLE_SYMS, MAX_CHAOS_LEVELS);
+	search[1].init(ImageRGBAReader::NUM_U_SYMS, ImageRGBAReader::NUM_ZRLE_SYMS, MAX_CHAOS_LEVELS);
+	search[2].init(ImageRGBAReader::NUM_V_SYMS, ImageRGBAReader::NUM_ZRLE_SYMS, MAX_CHAOS_LEVELS);
 
-	Encoders *best = 0;
-	Encoders *encoders = new Encoders;
-
-	// For each chaos level,
-	for (int chaos_levels = 1; chaos_levels < MAX_CHAOS_LEVELS; ++chaos_levels) {
-		encoders->chaos.init(chaos_levels, _xsize);
-		encoders->chaos.start();
+	// Record bins with the most chaos levels, which all the others are capped from
+	RGBChaos chaos;
+	chaos.init(MAX_CHAOS_LEVELS, _xsize);
+	chaos.start();
 
-		// For each chaos level,
-		for (int ii = 0; ii < chaos_levels; ++ii) {
-			encoders->y[ii].init(ImageRGBAReader::NUM_Y_SYMS, ImageRGBAReader::NUM_ZRLE_SYMS);
-			encoders->u[ii].init(ImageRGBAReader::NUM_U_SYMS, ImageRGBAReader::NUM_ZRLE_SYMS);
-			encoders->v[ii].init(ImageRGBAReader::NUM_V_SYMS, ImageRGBAReader::NUM_ZRLE_SYMS);
-		}
+	// Reset LZ
+	u32 offset = 0;
+	LZMatchFinder::LZMatch *lzm = _lz_enabled ? _lz.getHead() : 0;
 
-		// Reset LZ
-		u32 offset = 0;
-		LZMatchFinder::LZMatch *lzm = _lz_enabled ? _lz.getHead() : 0;
-
-		// For each row,
-		const u8 *residuals = _residuals.get();
-		for (int y = 0; y < _ysize; ++y) {
-			// For each column,
-			for (int x = 0; x < _xsize; ++x, ++offset) {
-				// If we just hit the start of the next LZ copy region,
-				if (lzm && offset == lzm->offset) {
-					// Get chaos bin
-					u8 cy, cu, cv;
-					encoders->chaos.get(x, cy, cu, cv);
-
-					_lz.train(lzm, encoders->y[cy]);
-					lzm = lzm->next;
-				}
+	// For each row,
+	const u8 *residuals = _residuals.get();
+	for (int y = 0; y < _ysize; ++y) {
+		// For each column,
+		for (int x = 0; x < _xsize; ++x, ++offset) {
+			// If we just hit the start of the next LZ copy region,
+			if (lzm && offset == lzm->offset) {
+				// Get chaos bin
+				u8 cy, cu, cv;
+				chaos.get(x, cy, cu, cv);
 
-				if (IsMasked(x, y)) {
-					// Will eat LZ pixels too
-					encoders->chaos.zero(x);
-				} else {
-					// Get chaos bin
-					u8 cy, cu, cv;
-					encoders->chaos.get(x, cy, cu, cv);
+				search[0].add(cy, lzm->escape_code);
+				lzm = lzm->next;
+			}
 
-					// Update chaos
-					encoders->chaos.store(x, residuals);
+			if (IsMasked(x, y)) {
+				// Will eat LZ pixels too
+				chaos.zero(x);
+			} else {
+				// Get chaos bin
+				u8 cy, cu, cv;
+				chaos.get(x, cy, cu, cv);
 
-					// Add to histogram for this chaos bin
-					encoders->y[cy].add(residuals[0]);
-					encoders->u[cu].add(residuals[1]);
-					encoders->v[cv].add(residuals[2]);
-				}
+				// Update chaos
+				chaos.store(x, residuals);
 
-				residuals += 4;
+				// Record for this chaos bin
+				search[0].add(cy, residuals[0]);
+				search[1].add(cu, residuals[1]);
+				search[2].add(cv, residuals[2]);
 			}
-		}
 
-		// For each chaos level,
-		u32 entropy = 0;
-		for (int ii = 0; ii < chaos_levels; ++ii) {
-			entropy += encoders->y[ii].finalize();
-			entropy += encoders->u[ii].finalize();
-			entropy += encoders->v[ii].finalize();
+			residuals += 4;
 		}
+	}
 
-		// If this is the best chaos levels so far,
-		if (best_entropy > entropy + 128) {
-			best_entropy = entropy;
-			Encoders *temp = best;
-			best = encoders;
-			if (temp) {
-				encoders = temp;
-			} else {
-				encoders = new Encoders;
-			}
-		}
+	u32 entropy;
+	const int chaos_levels = ChaosSearch::Search(search, 3, _pool, entropy);
 
-		// If we have not found a better one in 2 moves,
-		if (chaos_levels - best->chaos.getBinCount() >= 2) {
-			// Stop early to save time
-			break;
-		}
-	}
+	CAT_INANE("RGBA") << "Chose " << chaos_levels << " chaos levels";
 
 	// Record the best option found
-	_encoders = best;
+	Encoders *encoders = new Encoders;
+	encoders->chaos.init(chaos_levels, _xsize);
+	search[0].train(chaos_levels, encoders->y);
+	search[1].train(chaos_levels, encoders->u);
+	search[2].train(chaos_levels, encoders->v);
 
-	if (encoders) {
-		delete encoders;
-	}
+	_encoders = encoders;
 }
 
 void ImageRGBAWriter::generateWriteOrder() {
@@ -780,6 +871,7 @@ bool ImageRGBAWriter::compressSF() {
 	params.award_count = 4;
 	params.write_order = &_filter_order[0];
 	params.lz_enable = _knobs->sf_enableLZ;
+	params.pool = _pool;
 
 	CAT_INANE("RGBA") << "Compressing spatial filter matrix...";
 
@@ -809,6 +901,7 @@ bool ImageRGBAWriter::compressCF() {
 	params.award_count = 4;
 	params.write_order = &_filter_order[0];
 	params.lz_enable = _knobs->cf_enableLZ;
+	params.pool = _pool;
 
 	CAT_INANE("RGBA") << "Compressing color filter matrix...";
 
@@ -829,8 +922,9 @@ bool ImageRGBAWriter::IsSFMasked(u16 x, u16 y) {
 	return _cf_tiles[x + _tiles_x * y] == MASK_TILE;
 }
 
-int ImageRGBAWriter::init(const u8 *rgba, int xsize, int ysize, ImageMaskWriter &mask, const GCIFKnobs *knobs) {
+int ImageRGBAWriter::init(const u8 *rgba, int xsize, int ysize, ImageMaskWriter &mask, const GCIFKnobs *knobs, ThreadPool *pool) {
 	_knobs = knobs;
+	_pool = pool;
 	_rgba = rgba;
 	_mask = &mask;
 
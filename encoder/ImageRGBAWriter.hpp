@@ -38,6 +38,8 @@
 #include "GCIFWriter.h"
 #include "PaletteOptimizer.hpp"
 #include "LZMatchFinder.hpp"
+#include "EntropyEstimator.hpp"
+#include "../decoder/ThreadPool.hpp"
 
 #include <vector>
 
@@ -75,6 +77,8 @@ protected:
 	static const int MAX_FILTERS = ImageRGBAReader::MAX_FILTERS;
 	static const int MAX_PASSES = 4;
 	static const int MAX_SYMS = 256;
+	static const int BAND_SYNC_ROWS = 8;	// Tile rows each band designs between merging histograms
+	static const int MIN_BAND_ROWS = 32;	// Fewest tile rows worth giving a band of their own
 
 	static const u8 MASK_TILE = 255;
 	static const u8 TODO_TILE = 0;
@@ -82,6 +86,9 @@ protected:
 	// Twiddly knobs from the write API
 	const GCIFKnobs *_knobs;
 
+	// Worker threads for analysis, or 0 to stay on the calling thread
+	ThreadPool *_pool;
+
 	// Dominat color mask
 	ImageMaskWriter *_mask;
 
@@ -103,6 +110,23 @@ protected:
 	SmartArray<u8> _ecodes[3];	// Entropy temp workspace
 	std::vector<u16> _filter_order;
 
+	/*
+	 * Tile Bands
+	 *
+	 * For multi-threaded tile design the tile rows are split into one band
+	 * per thread.  Each band chooses filters against its own copy of the
+	 * entropy histograms, and every BAND_SYNC_ROWS tile rows the choices of
+	 * all the bands are merged into the copies for the next round.  Since the
+	 * merge does not depend on which band finished first, the result only
+	 * depends on the number of bands.
+	 */
+	struct TileBand {
+		EntropyEstimator ee[3];
+		u8 *codes[3];		// Slice of _ecodes for this band
+		int ty, ty_end;		// Next tile row to design, and end of band
+	};
+	std::vector<TileBand> _bands;
+
 	// Chosen spatial filter set
 	RGBAFilterFuncs _sf[MAX_FILTERS];
 	u16 _sf_indices[MAX_FILTERS];
@@ -158,6 +182,13 @@ protected:
 	void maskTiles();
 	void designFilters();
 	void designTilesFast();
+	void designTile(int tx, int ty, bool revisit, EntropyEstimator ee[3], u8 *codes[3]);
+	void designTileRow(int ty, EntropyEstimator ee[3], u8 *codes[3]);
+	void revisitTiles(EntropyEstimator ee[3], u8 *codes[3]);
+#ifdef CAT_COMPILE_THREADS
+	static void DesignBandJob(void *data, int job_index, int thread_index);
+	void designTilesBands(int band_count);
+#endif
 	void designTiles();
 	void sortFilters();
 	void computeResiduals();
@@ -189,7 +220,7 @@ public:
 #endif // CAT_COLLECT_STATS
 
 public:
-	int init(const u8 *rgba, int xsize, int ysize, ImageMaskWriter &mask, const GCIFKnobs *knobs);
+	int init(const u8 *rgba, int xsize, int ysize, ImageMaskWriter &mask, const GCIFKnobs *knobs, ThreadPool *pool);
 
 	void write(ImageWriter &writer);
 
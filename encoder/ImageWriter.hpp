@@ -331,6 +331,16 @@ public:
 
 	// Write finalized data to file
 	int write(const char *path);
+
+	// Number of finalized words
+	CAT_INLINE int getWordCount() {
+		return _words.getWordCount();
+	}
+
+	// Copy finalized data to memory with room for getWordCount() words
+	CAT_INLINE void write(u32 *target) {
+		_words.write(target);
+	}
 };
 
 
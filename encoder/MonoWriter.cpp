@@ -30,6 +30,7 @@
 #include "../decoder/Enforcer.hpp"
 #include "FilterScorer.hpp"
 #include "EntropyEstimator.hpp"
+#include "ChaosSearch.hpp"
 #include "../decoder/BitMath.hpp"
 using namespace cat;
 
@@ -378,7 +379,7 @@ void MonoWriter::maskTiles() {
 				while (cx-- > 0 && px < xsize) {
 					// If it is not masked,
 					if (!_params.mask(px, py)) {
-						if (!_lz_enable || !_lz.masked(px, py)) {
+						if (!_lz_enable || !_lz_matches->masked(px, py)) {
 							// We need to do this tile
 							*m = 0;
 							goto next_tile;
@@ -428,7 +429,7 @@ void MonoWriter::designPaletteFilters() {
 					// If element is not masked,
 					if (!_params.mask(px, py)) {
 						// If LZ not on this pixel,
-						if (!_lz_enable || !_lz.masked(px, py)) {
+						if (!_lz_enable || !_lz_matches->masked(px, py)) {
 							const u8 value = *data;
 
 							if (!seen) {
@@ -533,7 +534,7 @@ void MonoWriter::designFilters() {
 				while (cx-- > 0 && px < xsize) {
 					// If element is not masked,
 					if (!_params.mask(px, py)) {
-						if (!_lz_enable || !_lz.masked(px, py)) {
+						if (!_lz_enable || !_lz_matches->masked(px, py)) {
 							const u8 value = *data;
 
 							if (!seen) {
@@ -791,7 +792,7 @@ void MonoWriter::designTiles() {
 							while (cx-- > 0 && px < xsize) {
 								// If element is not masked,
 								if (!_params.mask(px, py)) {
-									if (!_lz_enable || !_lz.masked(px, py)) {
+									if (!_lz_enable || !_lz_matches->masked(px, py)) {
 										const u8 value = *data;
 
 										u8 prediction = _profile->filters[old_filter].safe(data, num_syms, px, py, xsize);
@@ -825,7 +826,7 @@ void MonoWriter::designTiles() {
 					while (cx-- > 0 && px < xsize) {
 						// If element is not masked,
 						if (!_params.mask(px, py)) {
-							if (!_lz_enable || !_lz.masked(px, py)) {
+							if (!_lz_enable || !_lz_matches->masked(px, py)) {
 								const u8 value = *data;
 
 								u8 *dest = codes + code_count;
@@ -994,7 +995,7 @@ void MonoWriter::computeResiduals() {
 		} else {
 			for (u16 x = 0; x < xsize; ++x, ++residuals, ++data) {
 				// If pixel is LZ masked,
-				if (_lz_enable && _lz.masked(x, y)) {
+				if (_lz_enable && _lz_matches->masked(x, y)) {
 					continue;
 				}
 
@@ -1130,7 +1131,7 @@ void MonoWriter::generateWriteOrder() {
 			// For each pixel,
 			for (u16 x = 0, xsize = _params.xsize; x < xsize; ++x) {
 				// If pixel is LZ matched,
-				if (_lz_enable && _lz.masked(x, y)) {
+				if (_lz_enable && _lz_matches->masked(x, y)) {
 					continue;
 				}
 
@@ -1180,206 +1181,134 @@ void MonoWriter::designChaos() {
 
 	//CAT_INANE("Mono") << "Designing chaos...";
 
-	u32 best_entropy = 0x7fffffff;
+	ChaosSearch search;
+	search.init(_params.num_syms + (_lz_enable ? LZReader::ESCAPE_SYMS : 0), ZRLE_SYMS, MAX_CHAOS_LEVELS);
 
-	MonoWriterProfile::Encoders *best = 0;
-	MonoWriterProfile::Encoders *encoders = new MonoWriterProfile::Encoders;
+	// Record bins with the most chaos levels, which all the others are capped from
+	MonoChaos chaos;
+	chaos.init(MAX_CHAOS_LEVELS, _params.xsize);
+	chaos.start();
 
 	const u16 tile_mask_y = _profile->tile_ysize - 1;
+	const u16 *order = _params.write_order;
+	const u8 *residuals = _profile->residuals.get();
 
-	// For each chaos level,
-	for (int chaos_levels = 1; chaos_levels < MAX_CHAOS_LEVELS; ++chaos_levels) {
-		encoders->chaos.init(chaos_levels, _params.xsize);
-		encoders->chaos.start();
+	LZMatchFinder::LZMatch *lzm = _lz_matches->getHead();
+	int offset = 0;
 
-		const u16 *order = _params.write_order;
-		const u8 *residuals = _profile->residuals.get();
+	// For each row,
+	for (u16 y = 0; y < _params.ysize; ++y) {
+		const u16 ty = y >> _profile->tile_bits_y;
 
-		// For each chaos level,
-		for (int ii = 0; ii < chaos_levels; ++ii) {
-			encoders->encoder[ii].init(_params.num_syms + (_lz_enable ? LZReader::ESCAPE_SYMS : 0), ZRLE_SYMS);
+		// Reset tile seen
+		if ((y & tile_mask_y) == 0) {
+			_tile_seen.fill_00();
 		}
 
-		LZMatchFinder::LZMatch *lzm = _lz.getHead();
-		int offset = 0;
-
-		// For each row,
-		for (u16 y = 0; y < _params.ysize; ++y) {
-			const u16 ty = y >> _profile->tile_bits_y;
-
-			// Reset tile seen
-			if ((y & tile_mask_y) == 0) {
-				_tile_seen.fill_00();
-			}
-
-			// If random write order,
-			if (order) {
-				// After the first one,
-				if (y > 0) {
-					// Simulate zeroing the chaos residuals
-					for (u16 x = 0; x < _params.xsize; ++x) {
-						if (_params.mask(x, y - 1)) {
-							encoders->chaos.zero(x);
-							if (x == 56 && (y - 1) == 40) {
-								CAT_WARN("TESTA:MASK") << " levels " << chaos_levels << encoders;
-							}
-							if (y == 40) {
-								CAT_WARN("TEST") << "ZERO MASK TILE " << x << ", " << (y - 1);
-							}
-						}
+		// If random write order,
+		if (order) {
+			// After the first one,
+			if (y > 0) {
+				// Simulate zeroing the chaos residuals
+				for (u16 x = 0; x < _params.xsize; ++x) {
+					if (_params.mask(x, y - 1)) {
+						chaos.zero(x);
 					}
 				}
+			}
 
-				u16 x;
-				while ((x = *order++) != ORDER_SENTINEL) {
-					CAT_DEBUG_ENFORCE(!_params.mask(x, y));
-
-					const u16 tx = x >> _profile->tile_bits_x;
-					CAT_DEBUG_ENFORCE(tx < _profile->tiles_x);
-
-					const u8 f = _profile->getTile(tx, ty);
-					CAT_DEBUG_ENFORCE(f < _profile->filter_count);
-
-					// If masked or sympal,
-					if (_profile->filter_indices[f] >= SF_COUNT) {
-						encoders->chaos.zero(x);
-
-						if (x == 56 && y == 40 && tx == 7) {
-							CAT_WARN("TESTA:ORDER") << (int)f << " PF filter " << tx << " tx " << chaos_levels << " levels " << encoders;
-						}
-						if (y == 40 && tx >= 6 && ty <= 7) {
-							CAT_WARN("PF") << x;
-							if (x == 55) {
-								CAT_WARN("WUT") << (int)f;
-
-								CAT_WARN("WAT") << _profile->normal_filter_count;
-								CAT_WARN("WAT") << _profile->filter_count;
-							}
-						}
-					} else {
-						// Get residual symbol
-						u8 residual = residuals[x];
+			u16 x;
+			while ((x = *order++) != ORDER_SENTINEL) {
+				CAT_DEBUG_ENFORCE(!_params.mask(x, y));
 
-						if (x == 56 && y == 40 && tx == 7) {
-							CAT_WARN("TEST") << (int)encoders->chaos._pixels[x - 1];
-							CAT_WARN("TEST") << (int)encoders->chaos._pixels[x];
-						}
+				const u16 tx = x >> _profile->tile_bits_x;
+				CAT_DEBUG_ENFORCE(tx < _profile->tiles_x);
 
-						// Calculate and update local chaos
-						int chaos = encoders->chaos.next(x, residual, _params.num_syms);
+				const u8 f = _profile->getTile(tx, ty);
+				CAT_DEBUG_ENFORCE(f < _profile->filter_count);
 
-						if (x == 56 && y == 40 && tx == 7) {
-							CAT_WARN("TESTA:ORDER") << (int)residual << " residual " << (int)f << " filter " << chaos << " chaos " << tx << " tx " << chaos_levels << " levels " << encoders;
-						}
+				// If masked or sympal,
+				if (_profile->filter_indices[f] >= SF_COUNT) {
+					chaos.zero(x);
+				} else {
+					// Get residual symbol
+					u8 residual = residuals[x];
 
-						if (y == 40 && tx >= 6 && tx <= 7) {
-							CAT_WARN("ORDER") << x;
-						}
+					// Calculate and update local chaos
+					int bin = chaos.next(x, residual, _params.num_syms);
 
-						// Add to histogram for this chaos bin
-						encoders->encoder[chaos].add(residual);
-					}
+					// Record for this chaos bin
+					search.add(bin, residual);
 				}
+			}
 
-				residuals += _params.xsize;
-			} else {
-				// For each column,
-				for (u16 x = 0; x < _params.xsize; ++x, ++residuals, ++offset) {
-					// If using LZ,
-					if (_lz_enable) {
-						// If LZ match is here,
-						if (lzm && offset == lzm->offset) {
-							int chaos = encoders->chaos.get(x);
-							_lz.train(lzm, encoders->encoder[chaos]);
-							lzm = lzm->next;
-						}
-
-						// If pixel is LZ masked,
-						if (_lz.masked(x, y)) {
-							encoders->chaos.zero(x);
-							continue;
-						}
+			residuals += _params.xsize;
+		} else {
+			// For each column,
+			for (u16 x = 0; x < _params.xsize; ++x, ++residuals, ++offset) {
+				// If using LZ,
+				if (_lz_enable) {
+					// If LZ match is here,
+					if (lzm && offset == lzm->offset) {
+						search.add(chaos.get(x), lzm->escape_code);
+						lzm = lzm->next;
 					}
 
-					const u16 tx = x >> _profile->tile_bits_x;
-					CAT_DEBUG_ENFORCE(tx < _profile->tiles_x);
-
-					if (_params.mask(x, y)) {
-						encoders->chaos.zero(x);
+					// If pixel is LZ masked,
+					if (_lz_matches->masked(x, y)) {
+						chaos.zero(x);
+						continue;
+					}
+				}
 
-						if (x == 56 && y == 40 && tx == 7) {
-							CAT_WARN("TESTB:MASK") << tx << " tx " << chaos_levels << " levels " << encoders;
-						}
-					} else {
-						const u8 f = _profile->getTile(tx, ty);
-						CAT_DEBUG_ENFORCE(f < _profile->filter_count);
+				const u16 tx = x >> _profile->tile_bits_x;
+				CAT_DEBUG_ENFORCE(tx < _profile->tiles_x);
 
-						if (x == 56 && y == 40 && tx == 7) {
-							CAT_WARN("TESTB:RES") << (int)f << " filter " << tx << " tx " << chaos_levels << " levels " << encoders;
-						}
+				if (_params.mask(x, y)) {
+					chaos.zero(x);
+				} else {
+					const u8 f = _profile->getTile(tx, ty);
+					CAT_DEBUG_ENFORCE(f < _profile->filter_count);
 
-						// If sympal,
-						if (_profile->filter_indices[f] >= SF_COUNT) {
-							if (x == 56 && y == 40 && tx == 7) {
-								CAT_WARN("TESTB:RES") << "PF " << (int)f << " filter " << tx << " tx " << chaos_levels << " levels " << encoders;
-							}
-							// If in LZ mode,
-							if (_lz_enable) {
-								// If PF was not seen,
-								if (_tile_seen[tx] == 0) {
-									_tile_seen[tx] = 1;
-
-									// Will be writing a zero here
-									int chaos = encoders->chaos.get(x);
-									encoders->encoder[chaos].add(0);
-								}
+					// If sympal,
+					if (_profile->filter_indices[f] >= SF_COUNT) {
+						// If in LZ mode,
+						if (_lz_enable) {
+							// If PF was not seen,
+							if (_tile_seen[tx] == 0) {
+								_tile_seen[tx] = 1;
+
+								// Will be writing a zero here
+								search.add(chaos.get(x), 0);
 							}
+						}
 
-							encoders->chaos.zero(x);
-						} else {
-							// Get residual symbol
-							u8 residual = residuals[0];
+						chaos.zero(x);
+					} else {
+						// Get residual symbol
+						u8 residual = residuals[0];
 
-							// Calculate and update local chaos
-							int chaos = encoders->chaos.next(x, residual, _params.num_syms);
+						// Calculate and update local chaos
+						int bin = chaos.next(x, residual, _params.num_syms);
 
-							if (x == 56 && y == 40 && tx == 7) {
-								CAT_WARN("TESTB:RES") << "residual " << (int)residual << " and chaos " << chaos << " tx=" << tx << " levels " << chaos_levels << " " << encoders;
-							}
-							encoders->encoder[chaos].add(residual);
-						}
+						// Record for this chaos bin
+						search.add(bin, residual);
 					}
 				}
 			}
 		}
+	}
 
-		// For each chaos level,
-		u32 entropy = 0;
-		for (int ii = 0; ii < chaos_levels; ++ii) {
-			entropy += encoders->encoder[ii].finalize();
-		}
+	u32 entropy;
+	const int chaos_levels = ChaosSearch::Search(&search, 1, _params.pool, entropy);
 
-		//CAT_WARN("CHAOS") << chaos_levels << " -> " << entropy;
+	//CAT_WARN("CHAOS") << chaos_levels << " -> " << entropy;
 
-		// If this is the best chaos levels so far,
-		if (best_entropy > entropy + 128) {
-			best_entropy = entropy;
-			MonoWriterProfile::Encoders *temp = best;
-			best = encoders;
-			best->bits = entropy;
-			if (temp) {
-				encoders = temp;
-			} else {
-				encoders = new MonoWriterProfile::Encoders;
-			}
-		}
-
-		// If we have not found a better one in 4 moves,
-		if (chaos_levels - best->chaos.getBinCount() >= 2) {
-			// Stop early to save time
-			break;
-		}
-	}
+	// Record the best option found
+	MonoWriterProfile::Encoders *best = new MonoWriterProfile::Encoders;
+	best->bits = entropy;
+	best->chaos.init(chaos_levels, _params.xsize);
+	search.train(chaos_levels, best->encoder);
 
 	// Delete old one
 	if (_profile->encoders) {
@@ -1387,10 +1316,6 @@ void MonoWriter::designChaos() {
 	}
 
 	_profile->encoders = best;
-
-	if (encoders) {
-		delete encoders;
-	}
 }
 
 u32 MonoWriter::simulate() {
@@ -1423,15 +1348,90 @@ u32 MonoWriter::simulate() {
 	return bits;
 }
 
+u32 MonoWriter::designProfile() {
+	// Generate tile-based encoder
+	maskTiles();
+	designPaletteFilters();
+	designFilters();
+	designPaletteTiles();
+	designTiles();
+	computeResiduals();
+	optimizeTiles();
+	generateWriteOrder();
+	recurseCompress();
+	designChaos();
+
+	return simulate();
+}
+
+#ifdef CAT_COMPILE_THREADS
+
+void MonoWriter::DesignProfileJob(void *data, int job_index, int thread_index) {
+	MonoWriter *trial = reinterpret_cast<MonoWriter *>( data ) + job_index;
+
+	trial->_trial_entropy = trial->designProfile();
+}
+
+MonoWriterProfile *MonoWriter::designProfilesParallel(u32 &best_entropy) {
+	const int trial_count = _params.max_bits - _params.min_bits + 1;
+
+	// Set up a writer for each tile size, sharing the LZ matches
+	MonoWriter *trials = new MonoWriter[trial_count];
+	for (int ii = 0; ii < trial_count; ++ii) {
+		MonoWriter *trial = &trials[ii];
+
+		trial->_params = _params;
+		trial->_lz_enable = _lz_enable;
+		trial->_lz_matches = _lz_matches;
+		trial->_tile_bits_field_bc = _tile_bits_field_bc;
+		trial->_use_row_filters = false;
+
+		trial->_profile = new MonoWriterProfile;
+		trial->_profile->init(_params.xsize, _params.ysize, _params.min_bits + ii);
+	}
+
+	_params.pool->run(trial_count, &MonoWriter::DesignProfileJob, trials);
+
+	MonoWriterProfile *best_profile = 0;
+
+	// For each tile size in the order they would be tried one at a time,
+	for (int ii = 0; ii < trial_count; ++ii) {
+		MonoWriter *trial = &trials[ii];
+
+		// If this is the best profile found so far,
+		if (best_entropy > trial->_trial_entropy) {
+			best_entropy = trial->_trial_entropy;
+			best_profile = trial->_profile;
+			trial->_profile = 0;
+		} else {
+			// Stop where the serial search would have stopped
+			break;
+		}
+	}
+
+	// The child writer checks the mask through its parent, so point it here
+	if (best_profile) {
+		best_profile->filter_encoder->_params.mask.SetMember<MonoWriter, &MonoWriter::IsMasked>(this);
+	}
+
+	delete []trials;
+
+	return best_profile;
+}
+
+#endif // CAT_COMPILE_THREADS
+
 void MonoWriter::init(const Parameters &params) {
 	cleanup();
 
 	// Initialize
 	_params = params;
 	_lz_enable = false;
+	_lz_matches = &_lz;
 
-	// Only allow LZ to be enabled when write order is not specified
-	CAT_DEBUG_ENFORCE(!params.lz_enable || !params.write_order);
+	// Only allow LZ to be enabled when write order is not specified, since
+	// the LZ trial prices residuals in raster order
+	const bool lz_enable = params.lz_enable && !params.write_order;
 
 	_row_filters.resize(_params.ysize);
 
@@ -1451,7 +1451,7 @@ void MonoWriter::init(const Parameters &params) {
 	const u32 pixel_count = _params.xsize * _params.ysize;
 
 	// If LZ77 is enabled,
-	if (params.lz_enable && pixel_count >= LZ_THRESH) {
+	if (lz_enable && pixel_count >= LZ_THRESH) {
 		// Do a fast trial of filtering without LZ masking to measure the cost per bit
 		_profile = new MonoWriterProfile;
 		_profile->init(params.xsize, params.ysize, params.min_bits);
@@ -1489,39 +1489,35 @@ void MonoWriter::init(const Parameters &params) {
 		// Disable it for now
 		_use_row_filters = false;
 
-		// For each tile size to try,
-		for (int bits = params.min_bits; bits <= params.max_bits; ++bits) {
-			// Set up a profile
-			_profile = new MonoWriterProfile;
-			_profile->init(params.xsize, params.ysize, bits);
-
-			// Generate tile-based encoder
-			maskTiles();
-			designPaletteFilters();
-			designFilters();
-			designPaletteTiles();
-			designTiles();
-			computeResiduals();
-			optimizeTiles();
-			generateWriteOrder();
-			recurseCompress();
-			designChaos();
-
-			// Calculate bits required to represent the data with this tile size
-			u32 entropy = simulate();
-
-			// If this is the best profile found so far,
-			if (best_entropy > entropy) {
-				best_entropy = entropy;
-
-				if (best_profile) {
-					delete best_profile;
+#ifdef CAT_COMPILE_THREADS
+		// If there is a thread pool to share the work,
+		if (_params.pool && params.max_bits > params.min_bits) {
+			best_profile = designProfilesParallel(best_entropy);
+		} else
+#endif
+		{
+			// For each tile size to try,
+			for (int bits = params.min_bits; bits <= params.max_bits; ++bits) {
+				// Set up a profile
+				_profile = new MonoWriterProfile;
+				_profile->init(params.xsize, params.ysize, bits);
+
+				// Calculate bits required to represent the data with this tile size
+				u32 entropy = designProfile();
+
+				// If this is the best profile found so far,
+				if (best_entropy > entropy) {
+					best_entropy = entropy;
+
+					if (best_profile) {
+						delete best_profile;
+					}
+					best_profile = _profile;
+				} else {
+					// Stop trying options
+					delete _profile;
+					break;
 				}
-				best_profile = _profile;
-			} else {
-				// Stop trying options
-				delete _profile;
-				break;
 			}
 		}
 		_profile = best_profile;
@@ -39,6 +39,7 @@
 #include "../decoder/SmartArray.hpp"
 #include "PaletteOptimizer.hpp"
 #include "LZMatchFinder.hpp"
+#include "../decoder/ThreadPool.hpp"
 
 #include <vector>
 
@@ -133,6 +134,7 @@ public:
 		float filter_inc_thresh;		// 0.05 Normalized coverage increment to stop adding filters
 		u32 AWARDS[MAX_AWARDS];			// Awards to give for top N filters
 		int award_count;				// Number of awards to give out
+		ThreadPool *pool;				// Worker threads for analysis, or 0 to stay on the calling thread
 	};
 
 	struct _Stats {
@@ -167,12 +169,14 @@ protected:
 	u8 _sympal_filter_map[MAX_PALETTE];		// Filter index for this palette entry
 	u8 _prev_filter;						// Previous filter for row encoding
 	MonoMatchFinder _lz;					// LZ match finder
+	MonoMatchFinder *_lz_matches;			// LZ matches to design around: _lz, or the parent's for a trial
 	LZMatchFinder::LZMatch *_lz_next;		// Next LZ match
 	PaletteOptimizer _optimizer;			// Optimizer for filter indices
 	u32 _residual_entropy;					// Calculated entropy of residuals
 	SmartArray<u8> _ecodes;					// Used when evaluating options
 	SmartArray<u8> _tile_seen;				// Tile seen yet during a tile row
 	SmartArray<u8> _replay;					// Used during computing residuals
+	u32 _trial_entropy;						// Simulated bits for the profile of a trial writer
 
 	// Row filter mode
 	SmartArray<u8> _row_filters;			// Selected row filters
@@ -229,6 +233,15 @@ protected:
 	// Simulate number of bits required to encode the data this way
 	u32 simulate();
 
+	// Design the current profile and simulate it
+	u32 designProfile();
+
+#ifdef CAT_COMPILE_THREADS
+	// Design a profile for each tile size at once on trial writers
+	static void DesignProfileJob(void *data, int job_index, int thread_index);
+	MonoWriterProfile *designProfilesParallel(u32 &best_entropy);
+#endif
+
 	// Free dynamic objects
 	void cleanup();
 
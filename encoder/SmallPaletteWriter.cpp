@@ -173,6 +173,9 @@ void SmallPaletteWriter::generatePacked() {
 				// Store packed pixels
 				*image++ = (p3 << 6) | (p2 << 4) | (p1 << 2) | p0;
 			}
+
+			// Skip the second row of the pair
+			color += _xsize;
 		}
 	} else if (_palette_size > 1) { // 1 bit/pixel
 		/*
@@ -223,8 +226,9 @@ void SmallPaletteWriter::generatePacked() {
 	// Else: 0 bits per pixel, just need to transmit palette
 }
 
-int SmallPaletteWriter::init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs) {
+int SmallPaletteWriter::init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ThreadPool *pool) {
 	_knobs = knobs;
+	_pool = pool;
 	_rgba = rgba;
 	_xsize = xsize;
 	_ysize = ysize;
@@ -350,6 +354,7 @@ void SmallPaletteWriter::generateMonoWriter() {
 	params.award_count = 4;
 	params.write_order = 0;
 	params.lz_enable = _knobs->spal_enableLZ;
+	params.pool = _pool;
 
 	_mono_writer.init(params);
 }
@@ -440,7 +445,10 @@ bool SmallPaletteWriter::dumpStats() {
 	if (!enabled()) {
 		CAT_INANE("stats") << "(Small Palette) Disabled.";
 	} else {
-		_mono_writer.dumpStats();
+		// Single color images never initialize the pixel writer
+		if (!isSingleColor()) {
+			_mono_writer.dumpStats();
+		}
 
 		CAT_INANE("stats") << "(Small Palette)              Size : " << Stats.palette_size << " colors";
 		CAT_INANE("stats") << "(Small Palette)     Small Palette : " << Stats.small_palette_bits / 8 << " bytes (" << Stats.small_palette_bits * 100.f / Stats.total_bits << "% total)";
@@ -69,6 +69,9 @@ class SmallPaletteWriter {
 
 	const GCIFKnobs *_knobs;
 
+	// Worker threads for analysis, or 0 to stay on the calling thread
+	ThreadPool *_pool;
+
 	int _xsize, _ysize;	// In pixels
 	const u8 *_rgba;		// Original image
 
@@ -124,7 +127,7 @@ public:
 #endif
 
 public:
-	int init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs);
+	int init(const u8 *rgba, int xsize, int ysize, const GCIFKnobs *knobs, ThreadPool *pool);
 	int compress(ImageMaskWriter &mask);
 
 	CAT_INLINE bool enabled() {
@@ -640,6 +640,409 @@ static int replace(const char *path) {
 
 
 
+// Checks that a rectangle from the middle of the image reads back the same as the full image
+static int testRegion(GCIFDecoder *decoder, const u8 *fileData, int fileLen, const GCIFImage &image, const string &filename) {
+	const int x = image.xsize / 3, y = image.ysize / 2;
+	const int w = image.xsize - x * 2, h = image.ysize - y;
+
+	vector<unsigned char> region(w * h * 4);
+
+	int err;
+	if ((err = gcif_decoder_read_region(decoder, fileData, fileLen, x, y, w, h, &region[0]))) {
+		CAT_WARN("main") << "Error while reading a region: " << gcif_read_errstr(err) << " for " << filename;
+		return err;
+	}
+
+	for (int ii = 0; ii < h; ++ii) {
+		if (memcmp(&region[ii * w * 4], image.rgba + ((y + ii) * image.xsize + x) * 4, w * 4)) {
+			CAT_WARN("main") << "Region does not match full image for " << filename << " at row " << y + ii;
+			return GCIF_RE_BAD_DATA;
+		}
+	}
+
+	return GCIF_RE_OK;
+}
+
+// Rows passed to the streaming callback so far
+struct StreamedRows {
+	vector<unsigned char> rgba;
+	int rows;
+};
+
+static void testStreamBand(void *context, const unsigned char *rgba, int y, int rows, int xsize) {
+	StreamedRows *streamed = (StreamedRows *)context;
+
+	// Bands must arrive in order
+	if (y == streamed->rows) {
+		memcpy(&streamed->rgba[y * xsize * 4], rgba, rows * xsize * 4);
+		streamed->rows += rows;
+	}
+}
+
+// Checks that the bands passed to a stream callback add up to the full image
+static int testStream(GCIFDecoder *decoder, const u8 *fileData, int fileLen, const GCIFImage &image, const string &filename) {
+	StreamedRows streamed;
+	streamed.rgba.resize(image.xsize * image.ysize * 4);
+	streamed.rows = 0;
+
+	int err;
+	if ((err = gcif_decoder_read_stream(decoder, fileData, fileLen, 7, testStreamBand, &streamed))) {
+		CAT_WARN("main") << "Error while streaming: " << gcif_read_errstr(err) << " for " << filename;
+		return err;
+	}
+
+	if (streamed.rows != image.ysize || memcmp(&streamed.rgba[0], image.rgba, image.xsize * image.ysize * 4)) {
+		CAT_WARN("main") << "Streamed rows do not match full image for " << filename;
+		return GCIF_RE_BAD_DATA;
+	}
+
+	return GCIF_RE_OK;
+}
+
+/*
+ * Checks that the image lands inside a surface with padded rows as RGBA and
+ * as BGRA, and that nothing around it is touched
+ */
+static int testSurface(GCIFDecoder *decoder, const u8 *fileData, int fileLen, const GCIFImage &image, const string &filename) {
+	const int pad = 3, guard = 0xCD;
+
+	GCIFSurface surface;
+	surface.xsize = image.xsize + pad;
+	surface.ysize = image.ysize + pad;
+	surface.stride = surface.xsize * 4 + 12;
+	surface.x = 1;
+	surface.y = 2;
+
+	vector<unsigned char> pixels(surface.stride * surface.ysize);
+	surface.pixels = &pixels[0];
+
+	for (int format = GCIF_FORMAT_RGBA; format <= GCIF_FORMAT_BGRA; ++format) {
+		memset(&pixels[0], guard, pixels.size());
+
+		gcif_decoder_set_format(decoder, format);
+
+		int err = gcif_decoder_read_memory_to_surface(decoder, fileData, fileLen, &surface);
+
+		gcif_decoder_set_format(decoder, GCIF_FORMAT_RGBA);
+
+		if (err) {
+			CAT_WARN("main") << "Error while reading to a surface: " << gcif_read_errstr(err) << " for " << filename;
+			return err;
+		}
+
+		// R and B swap places for BGRA
+		const bool swap = format == GCIF_FORMAT_BGRA;
+
+		for (int y = 0; y < surface.ysize; ++y) {
+			const u8 *row = &pixels[y * surface.stride];
+			const int iy = y - surface.y;
+
+			for (int x = 0; x < surface.stride; ++x) {
+				const int ix = x / 4 - surface.x;
+
+				int expected = guard;
+				if (iy >= 0 && iy < image.ysize && ix >= 0 && ix < image.xsize && x < surface.xsize * 4) {
+					const int channel = x % 4;
+					expected = image.rgba[(iy * image.xsize + ix) * 4 + (swap && channel < 3 ? 2 - channel : channel)];
+				}
+
+				if (row[x] != expected) {
+					CAT_WARN("main") << "Surface does not match full image for " << filename << " at byte " << x << " of row " << y << " in format " << format;
+					return GCIF_RE_BAD_DATA;
+				}
+			}
+		}
+	}
+
+	return GCIF_RE_OK;
+}
+
+/*
+ * Reads a GCIF file again in the ways that decode into a window of rows, and
+ * compares with the full image.  work_bytes is set to the most working memory
+ * any of the reads held for decoded rows.
+ */
+static int testReads(const char *filename, const GCIFImage &image, long &work_bytes) {
+	MappedFile file;
+	MappedView fileView;
+
+	if (!file.OpenRead(filename) || !fileView.Open(&file)) {
+		return GCIF_RE_FILE;
+	}
+
+	u8 *fileData = fileView.MapView();
+	if (!fileData) {
+		return GCIF_RE_FILE;
+	}
+
+	const int fileLen = fileView.GetLength();
+
+	GCIFDecoder *decoder = gcif_decoder_create();
+	if (!decoder) {
+		return GCIF_RE_FILE;
+	}
+
+	GCIFDecodeStats stats;
+	memset(&stats, 0, sizeof(stats));
+	gcif_decoder_set_stats(decoder, &stats);
+
+	int err = GCIF_RE_OK;
+
+	// Once on the calling thread, and once with rows pipelined across threads
+	for (int threads = 1; threads <= 3 && !err; threads += 2) {
+#ifdef CAT_COMPILE_THREADS
+		gcif_decoder_set_threads(decoder, threads);
+#endif
+
+		if (!(err = testRegion(decoder, fileData, fileLen, image, filename)) &&
+			!(err = testStream(decoder, fileData, fileLen, image, filename))) {
+			err = testSurface(decoder, fileData, fileLen, image, filename);
+		}
+	}
+
+	gcif_decoder_destroy(decoder);
+
+	work_bytes = stats.work_bytes;
+
+	return err;
+}
+
+// Returns true if the two files hold the same bytes
+static bool sameFiles(const char *a, const char *b) {
+	MappedFile fileA, fileB;
+	MappedView viewA, viewB;
+
+	if (!fileA.OpenRead(a) || !viewA.Open(&fileA) || !fileB.OpenRead(b) || !viewB.Open(&fileB)) {
+		return false;
+	}
+
+	const u8 *dataA = viewA.MapView();
+	const u8 *dataB = viewB.MapView();
+
+	return dataA && dataB && viewA.GetLength() == viewB.GetLength() && !memcmp(dataA, dataB, viewA.GetLength());
+}
+
+// Encodes the image again after dirtying freed heap memory, and checks that the output does not change
+static int testRepeat(const vector<unsigned char> &image, int xsize, int ysize, int compress_level, const string &filename) {
+	// Leave freed blocks of assorted sizes full of junk for the encoder to be handed
+	for (int size = 16; size <= (1 << 24); size *= 2) {
+		vector<void *> blocks;
+		for (int ii = 0; ii < 8; ++ii) {
+			void *block = malloc(size + ii * 24);
+			if (block) {
+				memset(block, 0xA5 + ii, size + ii * 24);
+				blocks.push_back(block);
+			}
+		}
+		for (int ii = 0; ii < (int)blocks.size(); ++ii) {
+			free(blocks[ii]);
+		}
+	}
+
+	string firstfile = filename + ".gci";
+	string againfile = filename + ".again.gci";
+
+	int err;
+	if ((err = gcif_write(&image[0], xsize, ysize, againfile.c_str(), compress_level, 1))) {
+		CAT_WARN("main") << "Error while compressing the image again: " << gcif_write_errstr(err) << " for " << filename;
+		return err;
+	}
+
+	if (!sameFiles(firstfile.c_str(), againfile.c_str())) {
+		CAT_WARN("main") << "Compressing the image again gave a different file for " << filename;
+		err = GCIF_WE_BUG;
+	}
+
+	remove(againfile.c_str());
+
+	return err;
+}
+
+// Encodes a tall RGB noise image, which has no LZ matches, so partial reads slide a small window down it
+static int testNoise(string filename) {
+	const int xsize = 64, ysize = 1024;
+
+	vector<unsigned char> image(xsize * ysize * 4);
+
+	u32 seed = 1;
+	for (int ii = 0; ii < xsize * ysize * 4; ii += 4) {
+		seed = seed * 1103515245 + 12345;
+		image[ii] = (u8)(seed >> 24);
+		image[ii + 1] = (u8)(seed >> 16);
+		image[ii + 2] = (u8)(seed >> 8);
+		image[ii + 3] = 255;
+	}
+
+	string noisefile = filename + ".noise.gci";
+	const char *cnoisefile = noisefile.c_str();
+
+	int err;
+
+	// Fastest level, since only the reads are being tested
+	if ((err = gcif_write(&image[0], xsize, ysize, cnoisefile, 0, 1))) {
+		CAT_WARN("main") << "Error while compressing the noise image: " << gcif_write_errstr(err);
+		return err;
+	}
+
+	GCIFImage outimage;
+	if ((err = gcif_read_file(cnoisefile, &outimage))) {
+		CAT_WARN("main") << "Error while decompressing the noise image: " << gcif_read_errstr(err);
+		return err;
+	}
+
+	if (memcmp(outimage.rgba, &image[0], xsize * ysize * 4)) {
+		CAT_WARN("main") << "Noise image does not match input image";
+		err = GCIF_RE_BAD_DATA;
+	} else {
+		long work_bytes;
+		err = testReads(cnoisefile, outimage, work_bytes);
+
+		// The window of rows should be a small part of the image
+		if (!err && work_bytes > xsize * ysize * 4 / 8) {
+			CAT_WARN("main") << "Partial reads of the noise image held " << work_bytes << " bytes of rows";
+			err = GCIF_RE_BAD_DATA;
+		}
+	}
+
+	free(outimage.rgba);
+	remove(cnoisefile);
+
+	return err;
+}
+
+// Encodes images with 1 to 16 colors at odd sizes, so each small palette packing round-trips its edges
+static int testSmallPalette(string filename) {
+	const int xsize = 37, ysize = 29;
+	const int PALETTE_SIZES[] = { 1, 2, 3, 4, 5, 16 };
+
+	string palfile = filename + ".spal.gci";
+	const char *cpalfile = palfile.c_str();
+
+	for (int pp = 0; pp < (int)(sizeof(PALETTE_SIZES) / sizeof(PALETTE_SIZES[0])); ++pp) {
+		const int palette_size = PALETTE_SIZES[pp];
+
+		vector<unsigned char> image(xsize * ysize * 4);
+
+		u32 seed = 1;
+		for (int ii = 0; ii < xsize * ysize * 4; ii += 4) {
+			seed = seed * 1103515245 + 12345;
+
+			// Color 0 is the most common, so the rows differ from each other
+			u32 index = (seed >> 16) % (palette_size + 2);
+			if (index >= (u32)palette_size) {
+				index = 0;
+			}
+
+			image[ii] = (u8)(index * 15);
+			image[ii + 1] = (u8)(255 - index * 15);
+			image[ii + 2] = (u8)(index * 7);
+			image[ii + 3] = 255;
+		}
+
+		int err;
+
+		// Fastest level, since only the packing is being tested
+		if ((err = gcif_write(&image[0], xsize, ysize, cpalfile, 0, 1))) {
+			CAT_WARN("main") << "Error while compressing the " << palette_size << " color image: " << gcif_write_errstr(err);
+			return err;
+		}
+
+		GCIFImage outimage;
+		if ((err = gcif_read_file(cpalfile, &outimage))) {
+			CAT_WARN("main") << "Error while decompressing the " << palette_size << " color image: " << gcif_read_errstr(err);
+			return err;
+		}
+
+		if (memcmp(outimage.rgba, &image[0], xsize * ysize * 4)) {
+			CAT_WARN("main") << "The " << palette_size << " color image does not match input image";
+			err = GCIF_RE_BAD_DATA;
+		}
+
+		free(outimage.rgba);
+		remove(cpalfile);
+
+		if (err) {
+			return err;
+		}
+	}
+
+	return GCIF_RE_OK;
+}
+
+// Encodes a striped image whose first stripe is one solid color, and checks that the decode stats count every pixel
+static int testStats(string filename) {
+	const int xsize = 64, ysize = 96, stripe_rows = 32;
+
+	vector<unsigned char> image(xsize * ysize * 4);
+
+	u32 seed = 1;
+	for (int ii = 0; ii < xsize * ysize * 4; ii += 4) {
+		seed = seed * 1103515245 + 12345;
+
+		// First stripe is solid, the rest is noise
+		const bool solid = ii < xsize * stripe_rows * 4;
+		image[ii] = solid ? 0x80 : (u8)(seed >> 24);
+		image[ii + 1] = solid ? 0x40 : (u8)(seed >> 16);
+		image[ii + 2] = solid ? 0x20 : (u8)(seed >> 8);
+		image[ii + 3] = 255;
+	}
+
+	GCIFKnobs knobs;
+	gcif_get_knobs(0, &knobs);
+	knobs.stripe_rows = stripe_rows;
+
+	string statsfile = filename + ".stats.gci";
+	const char *cstatsfile = statsfile.c_str();
+
+	int err;
+
+	if ((err = gcif_write_ex(&image[0], xsize, ysize, cstatsfile, &knobs, 1))) {
+		CAT_WARN("main") << "Error while compressing the striped image: " << gcif_write_errstr(err);
+		return err;
+	}
+
+	GCIFImage outimage;
+	GCIFDecodeStats stats;
+	outimage.rgba = 0;
+
+	{
+		MappedFile file;
+		MappedView fileView;
+
+		u8 *fileData = 0;
+		if (file.OpenRead(cstatsfile) && fileView.Open(&file)) {
+			fileData = fileView.MapView();
+		}
+
+		if (!fileData) {
+			err = GCIF_RE_FILE;
+		} else {
+			err = gcif_read_memory_ex(fileData, fileView.GetLength(), &outimage, &stats);
+		}
+	}
+
+	remove(cstatsfile);
+
+	if (err) {
+		CAT_WARN("main") << "Error while decompressing the striped image: " << gcif_read_errstr(err);
+		return err;
+	}
+
+	const long counted = stats.masked_pixels + stats.lz_pixels + stats.literal_pixels;
+
+	if (memcmp(outimage.rgba, &image[0], xsize * ysize * 4)) {
+		CAT_WARN("main") << "Striped image does not match input image";
+		err = GCIF_RE_BAD_DATA;
+	} else if (stats.stripes != ysize / stripe_rows || counted != xsize * ysize) {
+		CAT_WARN("main") << "Decode stats counted " << counted << " pixels in " << stats.stripes << " stripes for a " << xsize << "x" << ysize << " image";
+		err = GCIF_RE_BAD_DATA;
+	}
+
+	free(outimage.rgba);
+
+	return err;
+}
+
 static int testfile(string filename) {
 	vector<unsigned char> image;
 	unsigned xsize, ysize;
@@ -680,20 +1083,40 @@ static int testfile(string filename) {
 
 	double t3 = Clock::ref()->usec();
 
+	bool match = true;
 	for (u32 ii = 0; ii < xsize * ysize * 4; ii += 4) {
 		if (image[ii + 3] == 0) {
 			if (*(u32*)&outimage.rgba[ii] != 0) {
 				CAT_WARN("main") << "Output image does not match input image for " << filename << " at " << ii << " (on transparency)";
+				match = false;
 				break;
 			}
 		} else {
 			if (*(u32*)&outimage.rgba[ii] != *(u32*)&image[ii]) {
 				CAT_WARN("main") << "Output image does not match input image for " << filename << " at " << ii;
+				match = false;
 				break;
 			}
 		}
 	}
 
+	if ((err = testRepeat(image, xsize, ysize, compress_level, filename))) {
+		free(outimage.rgba);
+		return err;
+	}
+
+	// Partial reads are compared with the full read, so only once that is right
+	long work_bytes;
+	if (match && (err = testReads(cbenchfile, outimage, work_bytes))) {
+		free(outimage.rgba);
+		return err;
+	}
+
+	if ((err = testNoise(filename)) || (err = testStats(filename)) || (err = testSmallPalette(filename))) {
+		free(outimage.rgba);
+		return err;
+	}
+
 	struct stat png, gci;
 	const char *cfilename = filename.c_str();
 	stat(cfilename, &png);
@@ -717,13 +1140,48 @@ static int testfile(string filename) {
 
 
 
-static int profileit(const char *filename) {
-	CAT_WARN("main") << "Decoding input GCIF image file hard: " << filename;
-
+// Average microseconds per decode of a GCIF file in memory, with the given decoder threads
+static int timeReads(const u8 *fileData, int fileLen, int threads, int iterations, double &usec) {
 	int err;
 
 	Clock *clock = Clock::ref();
 
+	// Reuse one decoder context to avoid reallocating between reads
+	GCIFDecoder *decoder = gcif_decoder_create();
+	if (!decoder) {
+		return GCIF_RE_FILE;
+	}
+
+#ifdef CAT_COMPILE_THREADS
+	if (threads > 1) {
+		gcif_decoder_set_threads(decoder, threads);
+	}
+#endif
+
+	double t0 = clock->usec();
+
+	for (int ii = 0; ii < iterations; ++ii) {
+		GCIFImage image;
+		if ((err = gcif_decoder_read_memory(decoder, fileData, fileLen, &image))) {
+			CAT_WARN("main") << "Error while decompressing the image: " << gcif_read_errstr(err);
+			gcif_decoder_destroy(decoder);
+			return err;
+		}
+	}
+
+	double t1 = clock->usec();
+
+	gcif_decoder_destroy(decoder);
+
+	usec = (t1 - t0) / iterations;
+
+	return GCIF_RE_OK;
+}
+
+static int profileit(const char *filename) {
+	CAT_WARN("main") << "Decoding input GCIF image file hard: " << filename;
+
+	int err;
 
 	const int ITERATIONS = 100;
 
@@ -750,21 +1208,25 @@ static int profileit(const char *filename) {
 
 
 
-		double t0 = clock->usec();
+		// Single-threaded, to compare with the PNG decoder and earlier versions
+		double usec;
+		if ((err = timeReads(fileData, fileLen, 1, ITERATIONS, usec))) {
+			return err;
+		}
 
-		for (int ii = 0; ii < ITERATIONS; ++ii) {
-			GCIFImage image;
-			if ((err = gcif_read_memory(fileData, fileLen, &image))) {
-				CAT_WARN("main") << "Error while decompressing the image: " << gcif_read_errstr(err);
+		CAT_WARN("main") << "GCIF takes average of " << usec << " usec / read";
+
+#ifdef CAT_COMPILE_THREADS
+		// Also time it on all cores, which splits up stripes or pipelines the rows
+		const int cpu_count = SystemInfo::ref()->GetProcessorCount();
+		if (cpu_count > 1) {
+			if ((err = timeReads(fileData, fileLen, cpu_count, ITERATIONS, usec))) {
 				return err;
 			}
 
-			free(image.rgba);
+			CAT_WARN("main") << "GCIF takes average of " << usec << " usec / read with " << cpu_count << " threads";
 		}
-
-		double t1 = clock->usec();
-
-		CAT_WARN("main") << "GCIF takes average of " << (t1 - t0) / ITERATIONS << " usec / read";
+#endif
 	}
 
 #ifdef CAT_ENABLE_LIBPNG
@@ -793,7 +1255,7 @@ static int profileit(const char *filename) {
 		CAT_WARN("main") << "Read " << pngfile << " : " << fileLen << " bytes";
 
 
-
+		Clock *clock = Clock::ref();
 
 		double t0 = clock->usec();
 